@@ -0,0 +1,345 @@
+/**
+ * @file   EskProtocol.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Radio protocol shared by the transmitter (remote) and receiver.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include "EskProtocol.h"
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+#define HEADER(type) ((PROTOCOL_VERSION << 4) | ((type) & 0x0F))
+
+// Bytes after the fields sent in every telemetry frame.
+#define TELEMETRY_GROUP_SIZE 5
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE VARIABLES
+ * ****************************************************************************
+ */
+
+// Power every other frame (voltage feeds the battery estimate), distance
+// every fourth, energy and temperatures every eighth.
+static const uint8_t telemetryRotation[PROTOCOL_TELEMETRY_ROTATION] = {
+  PROTOCOL_GROUP_POWER, PROTOCOL_GROUP_DISTANCE,
+  PROTOCOL_GROUP_POWER, PROTOCOL_GROUP_ENERGY,
+  PROTOCOL_GROUP_POWER, PROTOCOL_GROUP_DISTANCE,
+  PROTOCOL_GROUP_POWER, PROTOCOL_GROUP_THERMAL
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+static uint8_t *putUint16(uint8_t *p, uint16_t value);
+static uint8_t *putInt16(uint8_t *p, int16_t value);
+static uint8_t *putInt24(uint8_t *p, int32_t value);
+static uint8_t *putUint32(uint8_t *p, uint32_t value);
+static uint16_t getUint16(const uint8_t *p);
+static int16_t getInt16(const uint8_t *p);
+static int32_t getInt24(const uint8_t *p);
+static uint32_t getUint32(const uint8_t *p);
+static uint16_t toFixed(float value, float scale);
+static int16_t toSignedFixed(float value, float scale);
+static uint8_t finishFrame(uint8_t *frame, uint8_t *end);
+static bool validFrame(const uint8_t *frame, uint8_t size, uint8_t type, uint8_t expectedSize);
+
+
+/**
+ * ****************************************************************************
+ * INTERFACE FUNCTIONS
+ * ****************************************************************************
+ */
+
+uint8_t protocolEncodeThrottle(uint8_t *frame, uint16_t throttle, uint16_t keepalive) {
+  uint8_t *p = frame;
+
+  // Round the keepalive up, so the receiver never expects frames too early.
+  keepalive = (keepalive + PROTOCOL_KEEPALIVE_UNIT_MS - 1) / PROTOCOL_KEEPALIVE_UNIT_MS;
+  if (keepalive > 255) {
+    keepalive = 255;
+  }
+
+  *p++ = HEADER(PROTOCOL_MSG_THROTTLE);
+  p = putUint16(p, throttle);
+  *p++ = keepalive;
+
+  return finishFrame(frame, p);
+}
+
+bool protocolDecodeThrottle(const uint8_t *frame, uint8_t size, uint16_t *throttle, uint16_t *keepalive) {
+  if (!validFrame(frame, size, PROTOCOL_MSG_THROTTLE, PROTOCOL_THROTTLE_FRAME_SIZE)) {
+    return false;
+  }
+
+  *throttle = getUint16(&frame[1]);
+  if (*throttle > PROTOCOL_THROTTLE_MAX) {
+    return false;
+  }
+
+  *keepalive = frame[3] * PROTOCOL_KEEPALIVE_UNIT_MS;
+  return true;
+}
+
+uint8_t protocolEncodeTelemetry(uint8_t *frame, const struct vescValues *values, uint8_t group, uint8_t measurement) {
+  uint8_t *p = frame;
+
+  *p++ = HEADER(PROTOCOL_MSG_TELEMETRY);
+  *p++ = (group << 4) | (measurement & 0x0F);
+  p = putInt24(p, values->rpm);
+  p = putInt16(p, toSignedFixed(values->inputCurrent, 100.0));
+  p = putInt16(p, toSignedFixed(values->motorCurrent, 100.0));
+
+  uint8_t *groupEnd = p + TELEMETRY_GROUP_SIZE;
+
+  switch (group) {
+    case PROTOCOL_GROUP_POWER:
+      p = putUint16(p, toFixed(values->inpVoltage, 100.0));
+      p = putInt16(p, toSignedFixed(values->dutyCycle, 1000.0));
+      *p++ = values->fault;
+      break;
+    case PROTOCOL_GROUP_DISTANCE:
+      p = putUint32(p, values->tachometerAbs);
+      break;
+    case PROTOCOL_GROUP_ENERGY:
+      p = putUint16(p, toFixed(values->ampHours, 100.0));
+      p = putUint16(p, toFixed(values->ampHoursCharged, 100.0));
+      break;
+    case PROTOCOL_GROUP_THERMAL:
+      p = putInt16(p, toSignedFixed(values->tempFet, 10.0));
+      p = putInt16(p, toSignedFixed(values->tempMotor, 10.0));
+      break;
+  }
+
+  while (p < groupEnd) {
+    *p++ = 0;
+  }
+
+  return finishFrame(frame, p);
+}
+
+bool protocolDecodeTelemetry(const uint8_t *frame, uint8_t size, struct vescValues *values, uint8_t *group, uint8_t *measurement) {
+  if (!validFrame(frame, size, PROTOCOL_MSG_TELEMETRY, PROTOCOL_TELEMETRY_FRAME_SIZE)) {
+    return false;
+  }
+
+  *group = frame[1] >> 4;
+  *measurement = frame[1] & 0x0F;
+  if (*group >= PROTOCOL_TELEMETRY_GROUPS) {
+    return false;
+  }
+
+  values->rpm          = getInt24(&frame[2]);
+  values->inputCurrent = getInt16(&frame[5]) / 100.0;
+  values->motorCurrent = getInt16(&frame[7]) / 100.0;
+
+  const uint8_t *p = &frame[9];
+
+  switch (*group) {
+    case PROTOCOL_GROUP_POWER:
+      values->inpVoltage = getUint16(&p[0]) / 100.0;
+      values->dutyCycle  = getInt16(&p[2]) / 1000.0;
+      values->fault      = p[4];
+      break;
+    case PROTOCOL_GROUP_DISTANCE:
+      values->tachometerAbs = getUint32(&p[0]);
+      break;
+    case PROTOCOL_GROUP_ENERGY:
+      values->ampHours        = getUint16(&p[0]) / 100.0;
+      values->ampHoursCharged = getUint16(&p[2]) / 100.0;
+      break;
+    case PROTOCOL_GROUP_THERMAL:
+      values->tempFet   = getInt16(&p[0]) / 10.0;
+      values->tempMotor = getInt16(&p[2]) / 10.0;
+      break;
+  }
+
+  return true;
+}
+
+uint8_t protocolTelemetryGroup(uint8_t slot) {
+  return telemetryRotation[slot % PROTOCOL_TELEMETRY_ROTATION];
+}
+
+uint8_t protocolTelemetryGap(uint8_t group) {
+  uint8_t gap = 0;
+  int8_t last = -1;
+
+  // Two rounds, so the gap across the wrap is counted.
+  for (uint8_t slot = 0; slot < 2 * PROTOCOL_TELEMETRY_ROTATION; slot++) {
+    if (protocolTelemetryGroup(slot) != group) {
+      continue;
+    }
+    if (last >= 0 && slot - last > gap) {
+      gap = slot - last;
+    }
+    last = slot;
+  }
+
+  return gap;
+}
+
+uint8_t protocolEncodeLink(uint8_t *frame, uint8_t dataRate, uint8_t channel) {
+  uint8_t *p = frame;
+
+  *p++ = HEADER(PROTOCOL_MSG_LINK);
+  *p++ = dataRate;
+  *p++ = channel;
+
+  return finishFrame(frame, p);
+}
+
+bool protocolDecodeLink(const uint8_t *frame, uint8_t size, uint8_t *dataRate, uint8_t *channel) {
+  if (!validFrame(frame, size, PROTOCOL_MSG_LINK, PROTOCOL_LINK_FRAME_SIZE)) {
+    return false;
+  }
+
+  *dataRate = frame[1];
+  *channel = frame[2];
+  return *dataRate <= PROTOCOL_RATE_250KBPS && *channel <= PROTOCOL_MAX_CHANNEL;
+}
+
+uint8_t protocolMessageType(const uint8_t *frame, uint8_t size) {
+  if (size < 2 || (frame[0] >> 4) != PROTOCOL_VERSION) {
+    return 0;
+  }
+
+  if (protocolCrc8(frame, size - 1) != frame[size - 1]) {
+    return 0;
+  }
+
+  return frame[0] & 0x0F;
+}
+
+uint8_t protocolCrc8(const uint8_t *data, uint8_t length) {
+  uint8_t crc = 0;
+
+  while (length--) {
+    crc ^= *data++;
+    for (uint8_t i = 0; i < 8; i++) {
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+    }
+  }
+
+  return crc;
+}
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE FUNCTIONS
+ * ****************************************************************************
+ */
+
+static uint8_t *putUint16(uint8_t *p, uint16_t value) {
+  *p++ = value;
+  *p++ = value >> 8;
+  return p;
+}
+
+static uint8_t *putInt16(uint8_t *p, int16_t value) {
+  return putUint16(p, (uint16_t)value);
+}
+
+static uint8_t *putInt24(uint8_t *p, int32_t value) {
+  // Saturate to the 24 bit range.
+  if (value > 0x7FFFFFL) {
+    value = 0x7FFFFFL;
+  } else if (value < -0x800000L) {
+    value = -0x800000L;
+  }
+
+  *p++ = value;
+  *p++ = value >> 8;
+  *p++ = value >> 16;
+  return p;
+}
+
+static uint8_t *putUint32(uint8_t *p, uint32_t value) {
+  *p++ = value;
+  *p++ = value >> 8;
+  *p++ = value >> 16;
+  *p++ = value >> 24;
+  return p;
+}
+
+static uint16_t getUint16(const uint8_t *p) {
+  return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+static int16_t getInt16(const uint8_t *p) {
+  return (int16_t)getUint16(p);
+}
+
+static int32_t getInt24(const uint8_t *p) {
+  uint32_t value = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+
+  // Sign extend
+  if (value & 0x800000UL) {
+    value |= 0xFF000000UL;
+  }
+
+  return (int32_t)value;
+}
+
+static uint32_t getUint32(const uint8_t *p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Convert a non-negative value to unsigned 16 bit fixed point, saturating.
+static uint16_t toFixed(float value, float scale) {
+  float fixed = value * scale + 0.5;
+
+  if (fixed <= 0.0) {
+    return 0;
+  } else if (fixed >= 65535.0) {
+    return 65535;
+  }
+
+  return (uint16_t)fixed;
+}
+
+// Convert a value to signed 16 bit fixed point, saturating.
+static int16_t toSignedFixed(float value, float scale) {
+  float fixed = value * scale;
+
+  if (fixed <= -32768.0) {
+    return -32768;
+  } else if (fixed >= 32767.0) {
+    return 32767;
+  }
+
+  return (int16_t)(fixed < 0.0 ? fixed - 0.5 : fixed + 0.5);
+}
+
+// Append the CRC and return the frame size.
+static uint8_t finishFrame(uint8_t *frame, uint8_t *end) {
+  uint8_t size = end - frame;
+
+  frame[size] = protocolCrc8(frame, size);
+  return size + 1;
+}
+
+static bool validFrame(const uint8_t *frame, uint8_t size, uint8_t type, uint8_t expectedSize) {
+  if (size != expectedSize) {
+    return false;
+  }
+
+  return protocolMessageType(frame, size) == type;
+}
@@ -0,0 +1,181 @@
+/**
+ * @file   EskProtocol.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Radio protocol shared by the transmitter (remote) and receiver.
+ *
+ * Every frame starts with a header byte holding the protocol version in the
+ * high nibble and the message type in the low nibble, and ends with a CRC-8
+ * over the header and payload. Multi-byte fields are little-endian, fixed
+ * point, and only as wide as needed:
+ *
+ *   Throttle  (remote -> receiver):  header, throttle (u16),
+ *                                    keepalive (u8, 10 ms), crc           =  5 bytes
+ *   Telemetry (receiver -> remote):  header, slot (u8), rpm (s24),
+ *                                    inputCurrent (s16, 10 mA),
+ *                                    motorCurrent (s16, 10 mA),
+ *                                    group fields (5), crc                = 15 bytes
+ *   Link      (remote -> receiver):  header, data rate (u8),
+ *                                    channel (u8), crc                    =  4 bytes
+ *
+ * Telemetry is multiplexed: rpm and currents are in every frame, the rest
+ * is split in groups and one group rides along in each frame, following
+ * protocolTelemetryGroup() over consecutive acks:
+ *
+ *   Power:    inpVoltage (u16, 10 mV), dutyCycle (s16, 0.1 %), fault (u8)
+ *   Distance: tachometerAbs (u32)
+ *   Energy:   ampHours (u16, 10 mAh), ampHoursCharged (u16, 10 mAh)
+ *   Thermal:  tempFet (s16, 0.1 C), tempMotor (s16, 0.1 C)
+ *
+ * Unused group bytes are 0. The slot byte holds the group in the high
+ * nibble and a count of VESC measurements (wrapping at 16) in the low, so
+ * the remote can tell a new measurement from a repeated one.
+ *
+ * Throttle is 10 bit: 0 is full brake, PROTOCOL_THROTTLE_NEUTRAL neither
+ * throttle nor brake and PROTOCOL_THROTTLE_MAX full throttle.
+ *
+ * The keepalive field is the longest time the remote will wait before its
+ * next throttle frame, letting the receiver size its failsafe timeout.
+ *
+ * Both sides start on PROTOCOL_RENDEZVOUS_CHANNEL and PROTOCOL_LINK_HOME_RATE.
+ * A link frame is sent before the remote changes data rate or channel, and
+ * the receiver follows once it has acked it. Should the two lose each
+ * other, both return to the rendezvous channel and home rate, the receiver
+ * after PROTOCOL_LINK_FALLBACK_MS without a packet.
+ *
+ * The previous raw layout sent a short (2 bytes) and the vescValues struct
+ * (16 bytes), with no way to tell a foreign or damaged payload from data.
+ */
+#ifndef ESK_PROTOCOL_H
+#define ESK_PROTOCOL_H
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+// Bump when the frame layout changes; frames of another version are rejected.
+#define PROTOCOL_VERSION 7
+
+// Largest payload the nRF24 can carry.
+#define PROTOCOL_MAX_FRAME_SIZE 32
+
+#define PROTOCOL_THROTTLE_FRAME_SIZE  5
+#define PROTOCOL_TELEMETRY_FRAME_SIZE 15
+#define PROTOCOL_LINK_FRAME_SIZE      4
+
+// Telemetry groups, and length of the group rotation.
+#define PROTOCOL_TELEMETRY_GROUPS   4
+#define PROTOCOL_TELEMETRY_ROTATION 8
+
+// Throttle range, and value for no throttle and no brake.
+#define PROTOCOL_THROTTLE_MAX     1023
+#define PROTOCOL_THROTTLE_NEUTRAL 512
+
+// Resolution of the keepalive field.
+#define PROTOCOL_KEEPALIVE_UNIT_MS 10
+
+// Data rate and channel both sides start on and return to after losing
+// the link. The channel is the RF24 library default.
+#define PROTOCOL_LINK_HOME_RATE     PROTOCOL_RATE_1MBPS
+#define PROTOCOL_RENDEZVOUS_CHANNEL 76
+#define PROTOCOL_LINK_FALLBACK_MS   500
+
+// Highest nRF24 channel (2400 + n MHz).
+#define PROTOCOL_MAX_CHANNEL 125
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+// Message types (4 bits).
+enum protocolMessageType {
+  PROTOCOL_MSG_THROTTLE  = 1,
+  PROTOCOL_MSG_TELEMETRY = 2,
+  PROTOCOL_MSG_LINK      = 3
+};
+
+// Radio data rates, same values as rf24_datarate_e.
+enum protocolDataRate {
+  PROTOCOL_RATE_1MBPS   = 0,
+  PROTOCOL_RATE_2MBPS   = 1,
+  PROTOCOL_RATE_250KBPS = 2
+};
+
+// Telemetry groups, see above.
+enum protocolTelemetryGroup {
+  PROTOCOL_GROUP_POWER    = 0,
+  PROTOCOL_GROUP_DISTANCE = 1,
+  PROTOCOL_GROUP_ENERGY   = 2,
+  PROTOCOL_GROUP_THERMAL  = 3
+};
+
+// Defining struct to hold UART data.
+struct vescValues {
+  float ampHours;
+  float ampHoursCharged;
+  float inpVoltage;
+  float inputCurrent;
+  float motorCurrent;
+  float dutyCycle;
+  float tempFet;
+  float tempMotor;
+  long rpm;
+  long tachometerAbs;
+  uint8_t fault;
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+// Encode a throttle frame with the keepalive period in ms. Returns the frame size.
+uint8_t protocolEncodeThrottle(uint8_t *frame, uint16_t throttle, uint16_t keepalive);
+
+// Decode a throttle frame. Returns false if the frame is invalid.
+bool protocolDecodeThrottle(const uint8_t *frame, uint8_t size, uint16_t *throttle, uint16_t *keepalive);
+
+// Encode a telemetry frame with the fields of a group and a measurement
+// count. Returns the frame size.
+uint8_t protocolEncodeTelemetry(uint8_t *frame, const struct vescValues *values, uint8_t group, uint8_t measurement);
+
+// Decode a telemetry frame into the fields it carries, leaving the others.
+// Returns false if the frame is invalid.
+bool protocolDecodeTelemetry(const uint8_t *frame, uint8_t size, struct vescValues *values, uint8_t *group, uint8_t *measurement);
+
+// Return the group sent in a slot of the rotation (wraps).
+uint8_t protocolTelemetryGroup(uint8_t slot);
+
+// Return the most slots from one frame of a group to the next, 0 if the
+// group is not in the rotation.
+uint8_t protocolTelemetryGap(uint8_t group);
+
+// Encode a link frame announcing a new data rate and channel. Returns the frame size.
+uint8_t protocolEncodeLink(uint8_t *frame, uint8_t dataRate, uint8_t channel);
+
+// Decode a link frame. Returns false if the frame is invalid.
+bool protocolDecodeLink(const uint8_t *frame, uint8_t size, uint8_t *dataRate, uint8_t *channel);
+
+// Return the message type of a valid frame of any type, or 0 if invalid.
+uint8_t protocolMessageType(const uint8_t *frame, uint8_t size);
+
+// CRC-8 (polynomial 0x07) over a buffer.
+uint8_t protocolCrc8(const uint8_t *data, uint8_t length);
+
+#endif /* ESK_PROTOCOL_H */
@@ -0,0 +1,131 @@
+/**
+ * @file   LoopTiming.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Loop and stage duration statistics, with a compact binary export
+ *         over Serial.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <Arduino.h>
+#include <EskProtocol.h>
+#include "LoopTiming.h"
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+static uint8_t *putUint16(uint8_t *p, uint16_t value);
+
+
+/**
+ * ****************************************************************************
+ * INTERFACE FUNCTIONS
+ * ****************************************************************************
+ */
+
+void loopTimingReset(struct loopTimingStage *stage) {
+  memset(stage, 0, sizeof(*stage));
+  stage->min = 0xFFFF;
+}
+
+void loopTimingRecord(struct loopTimingStage *stage, uint32_t duration) {
+  uint16_t value = (duration > 0xFFFF) ? 0xFFFF : duration;
+
+  if (stage->count == 0xFFFF) {
+    return;
+  }
+  stage->count++;
+  stage->total += value;
+
+  if (value < stage->min) {
+    stage->min = value;
+  }
+  if (value > stage->max) {
+    stage->max = value;
+  }
+
+  // Number of doublings above the first bucket.
+  uint8_t bucket = 0;
+  value >>= LOOP_TIMING_BUCKET_SHIFT;
+  while (value != 0 && bucket < LOOP_TIMING_BUCKETS - 1) {
+    value >>= 1;
+    bucket++;
+  }
+  stage->histogram[bucket]++;
+}
+
+uint16_t loopTimingAverage(const struct loopTimingStage *stage) {
+  if (stage->count == 0) {
+    return 0;
+  }
+  return stage->total / stage->count;
+}
+
+uint8_t loopTimingEncode(uint8_t *frame, uint8_t source, const struct loopTimingStage *stages, uint8_t numStages) {
+  uint8_t *p = frame;
+
+  numStages = min(numStages, (uint8_t)LOOP_TIMING_MAX_STAGES);
+
+  *p++ = LOOP_TIMING_SYNC;
+  *p++ = source;
+  *p++ = numStages;
+
+  for (uint8_t i = 0; i < numStages; i++) {
+    const struct loopTimingStage *stage = &stages[i];
+
+    p = putUint16(p, stage->count);
+    p = putUint16(p, stage->count ? stage->min : 0);
+    p = putUint16(p, stage->max);
+    p = putUint16(p, loopTimingAverage(stage));
+    for (uint8_t bucket = 0; bucket < LOOP_TIMING_BUCKETS; bucket++) {
+      p = putUint16(p, stage->histogram[bucket]);
+    }
+  }
+
+  *p = protocolCrc8(&frame[1], p - &frame[1]);
+  p++;
+
+  return p - frame;
+}
+
+void loopTimingExportStart(struct loopTimingExport *output, uint8_t source, const struct loopTimingStage *stages, uint8_t numStages) {
+  output->size = loopTimingEncode(output->frame, source, stages, numStages);
+  output->sent = 0;
+}
+
+void loopTimingExportUpdate(struct loopTimingExport *output) {
+  int space = Serial.availableForWrite();
+
+  if (space <= 0 || loopTimingExportBusy(output) == false) {
+    return;
+  }
+
+  uint8_t count = min(space, output->size - output->sent);
+  Serial.write(&output->frame[output->sent], count);
+  output->sent += count;
+}
+
+bool loopTimingExportBusy(const struct loopTimingExport *output) {
+  return output->sent < output->size;
+}
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE FUNCTIONS
+ * ****************************************************************************
+ */
+
+static uint8_t *putUint16(uint8_t *p, uint16_t value) {
+  *p++ = value;
+  *p++ = value >> 8;
+  return p;
+}
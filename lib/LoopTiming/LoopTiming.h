@@ -0,0 +1,107 @@
+/**
+ * @file   LoopTiming.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Loop and stage duration statistics, with a compact binary export
+ *         over Serial.
+ *
+ * Each stage keeps count, min, max and total of its durations in µs, and a
+ * histogram with power of two buckets: bucket 0 holds durations below
+ * LOOP_TIMING_BUCKET_BASE_US, each following bucket twice the range of the
+ * one before, and the last bucket everything above.
+ *
+ * Frame (little-endian):
+ *
+ *   sync (0xA5), source (u8), stage count (u8), then per stage:
+ *   count (u16), min (u16), max (u16), average (u16),
+ *   histogram (LOOP_TIMING_BUCKETS x u16), and a CRC-8 over everything
+ *   after the sync byte.
+ *
+ * Durations and counts saturate at 65535.
+ */
+#ifndef LOOP_TIMING_H
+#define LOOP_TIMING_H
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+#define LOOP_TIMING_SYNC 0xA5
+
+// Histogram buckets, the first one covering 0 - LOOP_TIMING_BUCKET_BASE_US.
+#define LOOP_TIMING_BUCKETS         8
+#define LOOP_TIMING_BUCKET_SHIFT    7
+#define LOOP_TIMING_BUCKET_BASE_US  (1 << LOOP_TIMING_BUCKET_SHIFT)
+
+#define LOOP_TIMING_MAX_STAGES 4
+#define LOOP_TIMING_STAGE_SIZE (8 + 2 * LOOP_TIMING_BUCKETS)
+#define LOOP_TIMING_FRAME_SIZE(stages) (4 + (stages) * LOOP_TIMING_STAGE_SIZE)
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+// Firmware sending a frame.
+enum loopTimingSource {
+  LOOP_TIMING_TRANSMITTER = 1,
+  LOOP_TIMING_RECEIVER    = 2
+};
+
+struct loopTimingStage {
+  uint16_t count;
+  uint16_t min;
+  uint16_t max;
+  uint32_t total;
+  uint16_t histogram[LOOP_TIMING_BUCKETS];
+};
+
+// Frame being written to Serial, a part per call as the TX buffer allows.
+struct loopTimingExport {
+  uint8_t frame[LOOP_TIMING_FRAME_SIZE(LOOP_TIMING_MAX_STAGES)];
+  uint8_t size;
+  uint8_t sent;
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+// Clear the statistics of a stage.
+void loopTimingReset(struct loopTimingStage *stage);
+
+// Add one duration (µs) to a stage.
+void loopTimingRecord(struct loopTimingStage *stage, uint32_t duration);
+
+// Return the average duration of a stage (µs).
+uint16_t loopTimingAverage(const struct loopTimingStage *stage);
+
+// Encode stages into a frame. Returns the frame size.
+uint8_t loopTimingEncode(uint8_t *frame, uint8_t source, const struct loopTimingStage *stages, uint8_t numStages);
+
+// Encode stages for export. Any frame still being sent is dropped.
+void loopTimingExportStart(struct loopTimingExport *output, uint8_t source, const struct loopTimingStage *stages, uint8_t numStages);
+
+// Write as much of the frame as fits in the Serial TX buffer without blocking.
+void loopTimingExportUpdate(struct loopTimingExport *output);
+
+// Return true while a frame is being sent.
+bool loopTimingExportBusy(const struct loopTimingExport *output);
+
+#endif /* LOOP_TIMING_H */
@@ -0,0 +1,155 @@
+/**
+ * @file   TaskScheduler.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Cooperative scheduler for tasks with a fixed period.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <string.h>
+#include "TaskScheduler.h"
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+static uint16_t saturate(unsigned long value);
+static void recordRun(struct taskStats *stats, unsigned long lateness, unsigned long duration, bool overrun);
+
+
+/**
+ * ****************************************************************************
+ * INTERFACE FUNCTIONS
+ * ****************************************************************************
+ */
+
+void taskSchedulerBegin(struct taskScheduler *scheduler, const struct task *tasks, struct taskState *states, uint8_t count, taskClock clock) {
+  scheduler->tasks = tasks;
+  scheduler->states = states;
+  scheduler->count = count;
+  scheduler->running = count;
+  scheduler->clock = clock;
+
+  unsigned long now = clock();
+  for (uint8_t i = 0; i < count; i++) {
+    states[i].release = now;
+    taskStatsReset(&states[i].stats);
+  }
+}
+
+bool taskSchedulerRun(struct taskScheduler *scheduler) {
+  unsigned long now = scheduler->clock();
+
+  for (uint8_t i = 0; i < scheduler->count; i++) {
+    const struct task *task = &scheduler->tasks[i];
+    struct taskState *state = &scheduler->states[i];
+    unsigned long release = state->release;
+    unsigned long lateness = now - release;
+
+    if ((long)lateness < 0) {
+      continue;
+    }
+
+    // Stay on the grid, past any releases that were missed altogether.
+    if (lateness >= task->period) {
+      unsigned long missed = lateness / task->period;
+      state->release += missed * task->period;
+      state->stats.skipped = saturate((unsigned long)state->stats.skipped + missed);
+    }
+    state->release += task->period;
+
+    scheduler->running = i;
+    task->run();
+    scheduler->running = scheduler->count;
+
+    unsigned long end = scheduler->clock();
+    recordRun(&state->stats, lateness, end - now, (end - release) > task->deadline);
+    return true;
+  }
+
+  return false;
+}
+
+bool taskSchedulerPreempted(const struct taskScheduler *scheduler) {
+  unsigned long now = scheduler->clock();
+
+  for (uint8_t i = 0; i < scheduler->running; i++) {
+    if ((long)(now - scheduler->states[i].release) >= 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+unsigned long taskSchedulerIdle(const struct taskScheduler *scheduler) {
+  unsigned long now = scheduler->clock();
+  unsigned long idle = (unsigned long)-1;
+
+  for (uint8_t i = 0; i < scheduler->count; i++) {
+    long wait = scheduler->states[i].release - now;
+
+    if (wait <= 0) {
+      return 0;
+    }
+    if ((unsigned long)wait < idle) {
+      idle = wait;
+    }
+  }
+
+  return idle;
+}
+
+void taskStatsReset(struct taskStats *stats) {
+  memset(stats, 0, sizeof(*stats));
+  stats->minLateness = 0xFFFF;
+}
+
+uint16_t taskStatsAverageLateness(const struct taskStats *stats) {
+  if (stats->runs == 0) {
+    return 0;
+  }
+  return stats->totalLateness / stats->runs;
+}
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE FUNCTIONS
+ * ****************************************************************************
+ */
+
+static uint16_t saturate(unsigned long value) {
+  return (value > 0xFFFF) ? 0xFFFF : value;
+}
+
+static void recordRun(struct taskStats *stats, unsigned long lateness, unsigned long duration, bool overrun) {
+  uint16_t late = saturate(lateness);
+
+  // Each count stops at its limit on its own; the average is over the
+  // runs counted.
+  if (stats->runs < 0xFFFF) {
+    stats->runs++;
+    stats->totalLateness += late;
+  }
+
+  if (late < stats->minLateness) {
+    stats->minLateness = late;
+  }
+  if (late > stats->maxLateness) {
+    stats->maxLateness = late;
+  }
+  if (saturate(duration) > stats->maxDuration) {
+    stats->maxDuration = saturate(duration);
+  }
+  if (overrun && stats->overruns < 0xFFFF) {
+    stats->overruns++;
+  }
+}
@@ -0,0 +1,105 @@
+/**
+ * @file   TaskScheduler.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Cooperative scheduler for tasks with a fixed period.
+ *
+ * Tasks are kept in a table in priority order, the first one highest. Each
+ * call to taskSchedulerRun() runs the highest priority task that is due and
+ * returns, so a long low priority task delays a high priority one by at most
+ * its own run time. Releases follow a fixed grid of periods from the start,
+ * running late does not make a task drift. A task a whole period or more
+ * behind drops the releases it missed instead of running back to back.
+ * A task with a lot to do can do it in steps, checking
+ * taskSchedulerPreempted() between them and returning once a higher
+ * priority task is due.
+ *
+ * Per task the scheduler counts runs, overruns (a run that ended more than
+ * the deadline after its release) and skipped releases, and keeps the
+ * lateness (start after release) and run time in µs. The spread of the
+ * lateness is the jitter of the task. Times and counts saturate at 65535
+ * each, so clear the statistics now and then with taskStatsReset().
+ *
+ * The caller sets up the table of tasks (function, period and deadline),
+ * which stays constant, and an array of the same length for the state the
+ * scheduler keeps per task: the next release and the statistics.
+ *
+ * Time comes from a clock function passed in by the caller, micros() on
+ * the boards.
+ */
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+typedef void (*taskFunction)();
+typedef unsigned long (*taskClock)();
+
+struct taskStats {
+  uint16_t runs;
+  uint16_t overruns;
+  uint16_t skipped;
+  uint16_t minLateness;
+  uint16_t maxLateness;
+  uint32_t totalLateness;
+  uint16_t maxDuration;
+};
+
+struct task {
+  taskFunction run;
+  unsigned long period;   // µs
+  uint16_t deadline;      // µs after the release the run should have ended
+};
+
+struct taskState {
+  unsigned long release;  // Next release
+  struct taskStats stats;
+};
+
+struct taskScheduler {
+  const struct task *tasks; // Highest priority first
+  struct taskState *states; // One per task
+  uint8_t count;
+  uint8_t running;          // Task being run, count if none
+  taskClock clock;
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+// Start the tasks, all of them released right away.
+void taskSchedulerBegin(struct taskScheduler *scheduler, const struct task *tasks, struct taskState *states, uint8_t count, taskClock clock);
+
+// Run the highest priority task that is due. Returns false if none was.
+bool taskSchedulerRun(struct taskScheduler *scheduler);
+
+// Return true if a task of higher priority than the one running is due.
+bool taskSchedulerPreempted(const struct taskScheduler *scheduler);
+
+// Return the time in µs until the next task is due, 0 if one is now.
+unsigned long taskSchedulerIdle(const struct taskScheduler *scheduler);
+
+// Clear the statistics of a task.
+void taskStatsReset(struct taskStats *stats);
+
+// Return the average lateness of a task (µs).
+uint16_t taskStatsAverageLateness(const struct taskStats *stats);
+
+#endif /* TASK_SCHEDULER_H */
@@ -0,0 +1,129 @@
+/**
+ * @file   ServoOutput.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Timer1 driven servo/PPM pulse output for the ESC.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <Arduino.h>
+#include <EskProtocol.h>
+#include "ServoOutput.h"
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE VARIABLES
+ * ****************************************************************************
+ */
+
+static volatile uint8_t *outputRegister;
+static uint8_t outputMask;
+static volatile uint16_t pulseWidth;
+#if !defined(__AVR__)
+static uint16_t framePeriod;    // ICR1 holds it on the board
+static unsigned long frameStart; // Timer1 started, TCNT1 on the board
+#endif
+
+
+/**
+ * ****************************************************************************
+ * INTERFACE FUNCTIONS
+ * ****************************************************************************
+ */
+
+void servoOutputBegin(uint8_t pin, uint16_t frameUs, uint16_t pulseUs) {
+  pinMode(pin, OUTPUT);
+  digitalWrite(pin, LOW);
+
+  outputRegister = portOutputRegister(digitalPinToPort(pin));
+  outputMask = digitalPinToBitMask(pin);
+
+#if defined(__AVR__)
+  noInterrupts();
+  // Fast PWM with ICR1 as top (mode 14), prescaler 8, output pins disconnected.
+  TCCR1A = _BV(WGM11);
+  TCCR1B = _BV(WGM13) | _BV(WGM12) | _BV(CS11);
+  ICR1 = (uint16_t)(frameUs * SERVO_TICKS_PER_US) - 1;
+  TCNT1 = 0;
+  TIFR1 = _BV(TOV1) | _BV(OCF1B);
+  TIMSK1 = _BV(TOIE1) | _BV(OCIE1B);
+  interrupts();
+#else
+  framePeriod = frameUs;
+  frameStart = micros();
+#endif
+
+  servoOutputWrite(pulseUs);
+}
+
+void servoOutputWrite(uint16_t pulseUs) {
+  pulseUs = constrain(pulseUs, SERVO_PULSE_MIN_US, SERVO_PULSE_MAX_US);
+  pulseWidth = pulseUs;
+
+#if defined(__AVR__)
+  // 16 bit register write, must not be split by an interrupt. Also called
+  // from interrupt handlers, so restore rather than enable interrupts.
+  uint8_t oldSREG = SREG;
+  cli();
+  OCR1B = (pulseUs * SERVO_TICKS_PER_US) - 1;
+  SREG = oldSREG;
+#endif
+}
+
+uint16_t servoOutputRead() {
+  return pulseWidth;
+}
+
+uint16_t servoOutputFrame() {
+#if defined(__AVR__)
+  return (ICR1 + 1) / SERVO_TICKS_PER_US;
+#else
+  return framePeriod;
+#endif
+}
+
+uint16_t servoOutputDelay() {
+#if defined(__AVR__)
+  // 16 bit register read, as in servoOutputWrite().
+  uint8_t oldSREG = SREG;
+  cli();
+  uint16_t count = TCNT1;
+  SREG = oldSREG;
+
+  return (ICR1 - count) / SERVO_TICKS_PER_US + pulseWidth;
+#else
+  return framePeriod - (micros() - frameStart) % framePeriod + pulseWidth;
+#endif
+}
+
+uint16_t servoThrottleToPulse(uint16_t throttle) {
+  // Map each side of neutral separately, so neutral is exactly centered.
+  if (throttle >= PROTOCOL_THROTTLE_NEUTRAL) {
+    return map(constrain(throttle, PROTOCOL_THROTTLE_NEUTRAL, PROTOCOL_THROTTLE_MAX), PROTOCOL_THROTTLE_NEUTRAL, PROTOCOL_THROTTLE_MAX, SERVO_PULSE_NEUTRAL_US, SERVO_PULSE_MAX_US);
+  }
+  return map(throttle, 0, PROTOCOL_THROTTLE_NEUTRAL, SERVO_PULSE_MIN_US, SERVO_PULSE_NEUTRAL_US);
+}
+
+
+/**
+ * ****************************************************************************
+ * INTERRUPT HANDLERS
+ * ****************************************************************************
+ */
+
+#if defined(__AVR__)
+// Start of frame.
+ISR(TIMER1_OVF_vect) {
+  *outputRegister |= outputMask;
+}
+
+// End of pulse.
+ISR(TIMER1_COMPB_vect) {
+  *outputRegister &= ~outputMask;
+}
+#endif
@@ -0,0 +1,70 @@
+/**
+ * @file   ServoOutput.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Timer1 driven servo/PPM pulse output for the ESC.
+ *
+ * Timer1 runs in fast PWM mode with ICR1 as top, so one timer period is one
+ * servo frame. The overflow interrupt raises the output and the compare B
+ * interrupt lowers it, giving 0.5 us resolution on any digital pin (the
+ * Timer1 output pins are taken by the radio). OCR1B is double buffered by
+ * the hardware, so a new pulse width always takes effect at the start of a
+ * frame and never cuts one short.
+ *
+ * An edge is late by as long as another interrupt handler keeps interrupts
+ * off, so long handlers should enable them early.
+ */
+#ifndef SERVO_OUTPUT_H
+#define SERVO_OUTPUT_H
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <stdint.h>
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+// Default frame period (50 Hz) and pulse range in microseconds.
+#define SERVO_FRAME_US      20000
+#define SERVO_PULSE_MIN_US  1000
+#define SERVO_PULSE_MAX_US  2000
+#define SERVO_PULSE_NEUTRAL_US ((SERVO_PULSE_MIN_US + SERVO_PULSE_MAX_US) / 2)
+
+// Timer1 ticks per microsecond (prescaler 8).
+#define SERVO_TICKS_PER_US (F_CPU / 8000000UL)
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+// Start output on pin with a frame period and initial pulse width in us.
+void servoOutputBegin(uint8_t pin, uint16_t frameUs, uint16_t pulseUs);
+
+// Set the pulse width in us, used from the next frame on.
+void servoOutputWrite(uint16_t pulseUs);
+
+// Return the current pulse width in us.
+uint16_t servoOutputRead();
+
+// Return the frame period in us.
+uint16_t servoOutputFrame();
+
+// Return the time in us until a pulse width written now has been output
+// in full: the rest of the current frame, then the pulse.
+uint16_t servoOutputDelay();
+
+// Map a throttle value (0-1023, PROTOCOL_THROTTLE_NEUTRAL neutral) to a
+// pulse width in us.
+uint16_t servoThrottleToPulse(uint16_t throttle);
+
+#endif /* SERVO_OUTPUT_H */
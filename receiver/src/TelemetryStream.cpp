@@ -0,0 +1,196 @@
+/**
+ * @file   TelemetryStream.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Framed binary record stream to a host logger.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <Arduino.h>
+#include <EskProtocol.h>
+#include "TelemetryStream.h"
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+#define BUFFER_MASK (TELEMETRY_STREAM_BUFFER_SIZE - 1)
+#define QUEUE_MASK  (TELEMETRY_STREAM_QUEUE_SIZE - 1)
+
+// Type, sequence number and time.
+#define RECORD_HEADER_SIZE 6
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+static uint8_t *startRecord(struct telemetryStream *stream, uint8_t *record, uint8_t type, uint32_t time);
+static void finishRecord(struct telemetryStream *stream, uint8_t *record, uint8_t *end);
+static uint8_t *streamPut16(uint8_t *p, int32_t value);
+static uint8_t *streamPut32(uint8_t *p, uint32_t value);
+
+
+/**
+ * ****************************************************************************
+ * INTERFACE FUNCTIONS
+ * ****************************************************************************
+ */
+
+void telemetryStreamBegin(struct telemetryStream *stream) {
+  memset((void *)stream, 0, sizeof(*stream));
+}
+
+void telemetryStreamThrottle(struct telemetryStream *stream, uint32_t time, uint16_t throttle, uint16_t keepalive) {
+  uint8_t head = stream->queueHead;
+
+  if (((head + 1) & QUEUE_MASK) == stream->queueTail) {
+    stream->queueDropped++;
+    return;
+  }
+
+  stream->queue[head].time = time;
+  stream->queue[head].throttle = throttle;
+  stream->queue[head].keepalive = keepalive;
+  stream->queueHead = (head + 1) & QUEUE_MASK;
+}
+
+void telemetryStreamVesc(struct telemetryStream *stream, uint32_t time, const struct vescMeasurement *values) {
+  uint8_t record[TELEMETRY_STREAM_MAX_RECORD];
+  uint8_t *p = startRecord(stream, record, TELEMETRY_STREAM_VESC, time);
+
+  p = streamPut32(p, values->rpm);
+  p = streamPut16(p, values->inpVoltage * 100.0);
+  p = streamPut16(p, values->inputCurrent * 100.0);
+  p = streamPut16(p, values->motorCurrent * 100.0);
+  p = streamPut16(p, values->dutyCycle * 1000.0);
+  p = streamPut16(p, values->tempFet * 10.0);
+  p = streamPut16(p, values->tempMotor * 10.0);
+  p = streamPut16(p, values->ampHours * 100.0);
+  p = streamPut16(p, values->ampHoursCharged * 100.0);
+  p = streamPut32(p, values->tachometerAbs);
+  *p++ = values->fault;
+
+  finishRecord(stream, record, p);
+}
+
+void telemetryStreamLink(struct telemetryStream *stream, uint32_t time, uint8_t event, uint8_t rate, uint8_t channel) {
+  uint8_t record[TELEMETRY_STREAM_MAX_RECORD];
+  uint8_t *p = startRecord(stream, record, TELEMETRY_STREAM_LINK, time);
+
+  *p++ = event;
+  *p++ = rate;
+  *p++ = channel;
+
+  finishRecord(stream, record, p);
+}
+
+void telemetryStreamUpdate(struct telemetryStream *stream) {
+  // Encode the throttle packets queued by the interrupt handler.
+  while (stream->queueTail != stream->queueHead) {
+    volatile struct telemetryStreamThrottle *queued = &stream->queue[stream->queueTail];
+    uint8_t record[TELEMETRY_STREAM_MAX_RECORD];
+    uint8_t *p = startRecord(stream, record, TELEMETRY_STREAM_THROTTLE, queued->time);
+
+    p = streamPut16(p, queued->throttle);
+    p = streamPut16(p, queued->keepalive);
+    stream->queueTail = (stream->queueTail + 1) & QUEUE_MASK;
+
+    finishRecord(stream, record, p);
+  }
+
+  // Leave a gap in the sequence for packets the queue had no room for.
+  uint8_t queueDropped = stream->queueDropped;
+  stream->seq += queueDropped - stream->queueDroppedSeen;
+  stream->dropped += (uint8_t)(queueDropped - stream->queueDroppedSeen);
+  stream->queueDroppedSeen = queueDropped;
+
+  // Send what fits, in at most two parts around the end of the buffer.
+  int space = STREAMIO.availableForWrite();
+
+  while (space > 0 && stream->tail != stream->head) {
+    uint8_t end = (stream->head > stream->tail) ? stream->head : TELEMETRY_STREAM_BUFFER_SIZE;
+    uint8_t count = min(space, end - stream->tail);
+
+    STREAMIO.write(&stream->buffer[stream->tail], count);
+    stream->tail = (stream->tail + count) & BUFFER_MASK;
+    space -= count;
+  }
+}
+
+uint8_t telemetryStreamEncode(uint8_t *frame, const uint8_t *record, uint8_t size) {
+  uint8_t *code = frame;
+  uint8_t *p = frame + 1;
+
+  // Each code byte gives the distance to the next 0, which is left out.
+  for (uint8_t i = 0; i < size; i++) {
+    if (record[i] == 0) {
+      *code = p - code;
+      code = p++;
+    } else {
+      *p++ = record[i];
+    }
+  }
+  *code = p - code;
+  *p++ = 0;
+
+  return p - frame;
+}
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE FUNCTIONS
+ * ****************************************************************************
+ */
+
+static uint8_t *startRecord(struct telemetryStream *stream, uint8_t *record, uint8_t type, uint32_t time) {
+  record[0] = type;
+  record[1] = stream->seq++;
+  return streamPut32(&record[2], time);
+}
+
+// Add the CRC and encode the record into the buffer, or drop it if it
+// does not fit.
+static void finishRecord(struct telemetryStream *stream, uint8_t *record, uint8_t *end) {
+  uint8_t frame[TELEMETRY_STREAM_MAX_FRAME];
+  uint8_t size = end - record;
+
+  record[size] = protocolCrc8(record, size);
+  size = telemetryStreamEncode(frame, record, size + 1);
+
+  // One byte is kept free to tell a full buffer from an empty one.
+  uint8_t used = (stream->head - stream->tail) & BUFFER_MASK;
+  if (used + size >= TELEMETRY_STREAM_BUFFER_SIZE) {
+    stream->dropped++;
+    return;
+  }
+
+  for (uint8_t i = 0; i < size; i++) {
+    stream->buffer[stream->head] = frame[i];
+    stream->head = (stream->head + 1) & BUFFER_MASK;
+  }
+}
+
+static uint8_t *streamPut16(uint8_t *p, int32_t value) {
+  *p++ = value;
+  *p++ = value >> 8;
+  return p;
+}
+
+static uint8_t *streamPut32(uint8_t *p, uint32_t value) {
+  *p++ = value;
+  *p++ = value >> 8;
+  *p++ = value >> 16;
+  *p++ = value >> 24;
+  return p;
+}
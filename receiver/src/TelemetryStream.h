@@ -0,0 +1,131 @@
+/**
+ * @file   TelemetryStream.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Framed binary record stream to a host logger.
+ *
+ * Every received throttle packet, VESC sample and link event is sent as a
+ * record (little-endian):
+ *
+ *   type (u8), seq (u8), time (u32, ms), fields, CRC-8
+ *
+ *   Throttle: throttle (u16), keepalive (u16, ms)
+ *   VESC:     rpm (s32), inpVoltage (u16, 10 mV), inputCurrent (s16, 10 mA),
+ *             motorCurrent (s16, 10 mA), dutyCycle (s16, 0.1 %),
+ *             tempFet (s16, 0.1 C), tempMotor (s16, 0.1 C),
+ *             ampHours (u16, 10 mAh), ampHoursCharged (u16, 10 mAh),
+ *             tachometerAbs (u32), fault (u8)
+ *   Link:     event (u8), data rate (u8), channel (u8)
+ *
+ * Records are COBS encoded and end with a 0 byte, so a logger can pick up
+ * the stream anywhere. The sequence number counts every record made,
+ * including ones dropped because the buffer was full, so the host sees
+ * each drop as a gap.
+ *
+ * Nothing here waits for the UART: encoded records go into a RAM buffer,
+ * and telemetryStreamUpdate() only writes what the TX buffer has room for.
+ * Throttle packets are queued from the radio interrupt handler and encoded
+ * later from loop().
+ *
+ * STREAMIO is the port written to. An Arduino Nano only has Serial, which
+ * is the VESC port; on boards with a second UART build with
+ * -DSTREAMIO=Serial1.
+ */
+#ifndef TELEMETRY_STREAM_H
+#define TELEMETRY_STREAM_H
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <stdint.h>
+#include "VescAsync.h"
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+#ifndef STREAMIO
+  #define STREAMIO Serial
+#endif
+
+// Encoded bytes waiting for the UART, and throttle packets waiting to be
+// encoded (power of two).
+#define TELEMETRY_STREAM_BUFFER_SIZE 128
+#define TELEMETRY_STREAM_QUEUE_SIZE  4
+
+// Largest record before encoding, and after (COBS code and delimiter).
+#define TELEMETRY_STREAM_MAX_RECORD  32
+#define TELEMETRY_STREAM_MAX_FRAME   (TELEMETRY_STREAM_MAX_RECORD + 2)
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+enum telemetryStreamType {
+  TELEMETRY_STREAM_THROTTLE = 1,
+  TELEMETRY_STREAM_VESC     = 2,
+  TELEMETRY_STREAM_LINK     = 3
+};
+
+enum telemetryStreamEvent {
+  TELEMETRY_STREAM_LINK_CHANGED = 0, // Data rate or channel applied
+  TELEMETRY_STREAM_FAILSAFE     = 1, // Throttle timed out to neutral
+  TELEMETRY_STREAM_VESC_TIMEOUT = 2, // VESC request not answered
+  TELEMETRY_STREAM_FIRST_PACKET = 3  // First throttle packet after power on
+};
+
+struct telemetryStreamThrottle {
+  uint32_t time;
+  uint16_t throttle;
+  uint16_t keepalive;
+};
+
+struct telemetryStream {
+  uint8_t buffer[TELEMETRY_STREAM_BUFFER_SIZE];
+  uint8_t head;   // Next byte to fill
+  uint8_t tail;   // Next byte to send
+  uint8_t seq;
+  uint16_t dropped;
+  // Written by the interrupt handler (head) and loop() (tail).
+  volatile struct telemetryStreamThrottle queue[TELEMETRY_STREAM_QUEUE_SIZE];
+  volatile uint8_t queueHead;
+  volatile uint8_t queueTail;
+  volatile uint8_t queueDropped; // Written by the interrupt handler only
+  uint8_t queueDroppedSeen;
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+// Start an empty stream.
+void telemetryStreamBegin(struct telemetryStream *stream);
+
+// Queue a received throttle packet. Safe to call from the interrupt
+// handler; dropped if the queue is full.
+void telemetryStreamThrottle(struct telemetryStream *stream, uint32_t time, uint16_t throttle, uint16_t keepalive);
+
+// Add a VESC sample.
+void telemetryStreamVesc(struct telemetryStream *stream, uint32_t time, const struct vescMeasurement *values);
+
+// Add a link event.
+void telemetryStreamLink(struct telemetryStream *stream, uint32_t time, uint8_t event, uint8_t rate, uint8_t channel);
+
+// Encode queued throttle packets and write what fits in the TX buffer.
+void telemetryStreamUpdate(struct telemetryStream *stream);
+
+// COBS encode a record, with the trailing 0. Returns the frame size.
+uint8_t telemetryStreamEncode(uint8_t *frame, const uint8_t *record, uint8_t size);
+
+#endif /* TELEMETRY_STREAM_H */
@@ -0,0 +1,274 @@
+/**
+ * @file   VescAsync.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Non-blocking VESC UART telemetry.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <Arduino.h>
+#include "VescUart.h"
+#include "VescAsync.h"
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+// Packet framing bytes.
+#define VESC_START_SHORT 2 // One byte length
+#define VESC_START_LONG  3 // Two byte length
+#define VESC_END         3
+
+// Size of COMM_GET_VALUES reply fields up to and including the fault code.
+#define VESC_VALUES_MIN_LENGTH 54
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+enum vescParserState {
+  PARSER_START,
+  PARSER_LENGTH_HIGH,
+  PARSER_LENGTH_LOW,
+  PARSER_PAYLOAD,
+  PARSER_CRC_HIGH,
+  PARSER_CRC_LOW,
+  PARSER_END
+};
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE VARIABLES
+ * ****************************************************************************
+ */
+
+static struct vescParser rxParser;
+static bool pending = false;
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+static uint8_t restartParser(struct vescParser *parser, uint8_t byte);
+static int16_t getInt16(const uint8_t *p);
+static int32_t getInt32(const uint8_t *p);
+
+
+/**
+ * ****************************************************************************
+ * INTERFACE FUNCTIONS
+ * ****************************************************************************
+ */
+
+void vescParserReset(struct vescParser *parser) {
+  parser->state = PARSER_START;
+  parser->length = 0;
+  parser->index = 0;
+  parser->crc = 0;
+}
+
+uint8_t vescParserFeed(struct vescParser *parser, uint8_t byte) {
+  switch (parser->state) {
+    case PARSER_START:
+      if (byte == VESC_START_SHORT) {
+        parser->state = PARSER_LENGTH_LOW;
+      } else if (byte == VESC_START_LONG) {
+        parser->state = PARSER_LENGTH_HIGH;
+      }
+      // Anything else is noise between packets.
+      parser->length = 0;
+      return VESC_PARSER_BUSY;
+
+    case PARSER_LENGTH_HIGH:
+      parser->length = (uint16_t)byte << 8;
+      parser->state = PARSER_LENGTH_LOW;
+
+      if (parser->length > VESC_PARSER_MAX_PAYLOAD) {
+        return restartParser(parser, byte);
+      }
+      return VESC_PARSER_BUSY;
+
+    case PARSER_LENGTH_LOW:
+      parser->length |= byte;
+      parser->index = 0;
+
+      if (parser->length == 0 || parser->length > VESC_PARSER_MAX_PAYLOAD) {
+        return restartParser(parser, byte);
+      }
+
+      parser->state = PARSER_PAYLOAD;
+      return VESC_PARSER_BUSY;
+
+    case PARSER_PAYLOAD:
+      parser->payload[parser->index++] = byte;
+
+      if (parser->index == parser->length) {
+        parser->state = PARSER_CRC_HIGH;
+      }
+      return VESC_PARSER_BUSY;
+
+    case PARSER_CRC_HIGH:
+      parser->crc = (uint16_t)byte << 8;
+      parser->state = PARSER_CRC_LOW;
+      return VESC_PARSER_BUSY;
+
+    case PARSER_CRC_LOW:
+      parser->crc |= byte;
+      parser->state = PARSER_END;
+      return VESC_PARSER_BUSY;
+
+    case PARSER_END:
+    default:
+      parser->state = PARSER_START;
+
+      if (byte != VESC_END || parser->crc != vescCrc16(parser->payload, parser->length)) {
+        return VESC_PARSER_ERROR;
+      }
+      return VESC_PARSER_COMPLETE;
+  }
+}
+
+bool vescDecodeValues(const uint8_t *payload, uint16_t length, struct vescMeasurement *values) {
+  if (length < VESC_VALUES_MIN_LENGTH || payload[0] != VESC_COMM_GET_VALUES) {
+    return false;
+  }
+
+  const uint8_t *p = &payload[1];
+
+  values->tempFet         = getInt16(p) / 10.0;     p += 2;
+  values->tempMotor       = getInt16(p) / 10.0;     p += 2;
+  values->motorCurrent    = getInt32(p) / 100.0;    p += 4;
+  values->inputCurrent    = getInt32(p) / 100.0;    p += 4;
+  p += 8; // Skip d and q axis currents
+  values->dutyCycle       = getInt16(p) / 1000.0;   p += 2;
+  values->rpm             = getInt32(p);            p += 4;
+  values->inpVoltage      = getInt16(p) / 10.0;     p += 2;
+  values->ampHours        = getInt32(p) / 10000.0;  p += 4;
+  values->ampHoursCharged = getInt32(p) / 10000.0;  p += 4;
+  p += 8; // Skip watt hours
+  values->tachometer      = getInt32(p);            p += 4;
+  values->tachometerAbs   = getInt32(p);            p += 4;
+  values->fault           = *p;
+
+  return true;
+}
+
+uint8_t vescEncodePacket(uint8_t *packet, const uint8_t *payload, uint8_t length) {
+  uint16_t crc = vescCrc16(payload, length);
+  uint8_t i = 0;
+
+  packet[i++] = VESC_START_SHORT;
+  packet[i++] = length;
+  memcpy(&packet[i], payload, length);
+  i += length;
+  packet[i++] = crc >> 8;
+  packet[i++] = crc;
+  packet[i++] = VESC_END;
+
+  return i;
+}
+
+uint8_t vescEncodeCommand(uint8_t *packet, uint8_t command, int32_t value) {
+  uint8_t payload[5];
+
+  payload[0] = command;
+  payload[1] = value >> 24;
+  payload[2] = value >> 16;
+  payload[3] = value >> 8;
+  payload[4] = value;
+
+  return vescEncodePacket(packet, payload, sizeof(payload));
+}
+
+uint16_t vescCrc16(const uint8_t *data, uint16_t length) {
+  uint16_t crc = 0;
+
+  while (length--) {
+    crc ^= (uint16_t)*data++ << 8;
+    for (uint8_t i = 0; i < 8; i++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+  }
+
+  return crc;
+}
+
+void vescAsyncRequest() {
+  const uint8_t payload[] = { VESC_COMM_GET_VALUES };
+  uint8_t packet[sizeof(payload) + 5];
+  uint8_t size = vescEncodePacket(packet, payload, sizeof(payload));
+
+  // Drop whatever is left of an unanswered request.
+  vescParserReset(&rxParser);
+
+  // Fits in the TX buffer, so this does not block.
+  SERIALIO.write(packet, size);
+  pending = true;
+}
+
+bool vescAsyncCommand(uint8_t command, int32_t value) {
+  uint8_t packet[VESC_COMMAND_PACKET_SIZE];
+
+  if (SERIALIO.availableForWrite() < VESC_COMMAND_PACKET_SIZE) {
+    return false;
+  }
+
+  SERIALIO.write(packet, vescEncodeCommand(packet, command, value));
+  return true;
+}
+
+bool vescAsyncPending() {
+  return pending;
+}
+
+bool vescAsyncUpdate(struct vescMeasurement *values) {
+  // Bound the work done per call; the rest stays in the RX buffer.
+  for (uint8_t i = 0; i < VESC_ASYNC_BYTES_PER_UPDATE && SERIALIO.available() > 0; i++) {
+    if (vescParserFeed(&rxParser, SERIALIO.read()) == VESC_PARSER_COMPLETE) {
+      if (vescDecodeValues(rxParser.payload, rxParser.length, values)) {
+        pending = false;
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE FUNCTIONS
+ * ****************************************************************************
+ */
+
+// The start byte was noise, such as the end byte of the previous reply,
+// which equals the long start byte. The byte that gave the bad length may
+// be the real start, so look at it again.
+static uint8_t restartParser(struct vescParser *parser, uint8_t byte) {
+  vescParserReset(parser);
+  vescParserFeed(parser, byte);
+  return VESC_PARSER_ERROR;
+}
+
+static int16_t getInt16(const uint8_t *p) {
+  return (int16_t)(((uint16_t)p[0] << 8) | p[1]);
+}
+
+static int32_t getInt32(const uint8_t *p) {
+  return (int32_t)(((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]);
+}
@@ -0,0 +1,127 @@
+/**
+ * @file   VescAsync.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Non-blocking VESC UART telemetry.
+ *
+ * A COMM_GET_VALUES request is written to the VESC and the reply is parsed
+ * incrementally from the serial port's interrupt-fed RX buffer, a bounded
+ * number of bytes per call, so waiting for the VESC never stalls the loop.
+ *
+ * The packet parser itself does not touch the hardware and can be fed any
+ * byte stream, one byte or one chunk at a time.
+ */
+#ifndef VESC_ASYNC_H
+#define VESC_ASYNC_H
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <stdint.h>
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+// Largest payload accepted. COMM_GET_VALUES replies are 54-80 bytes
+// depending on VESC firmware.
+#define VESC_PARSER_MAX_PAYLOAD 96
+
+// Most bytes consumed from the serial port per call to vescAsyncUpdate().
+#define VESC_ASYNC_BYTES_PER_UPDATE 32
+
+// VESC command ids.
+#define VESC_COMM_GET_VALUES        4
+#define VESC_COMM_SET_DUTY          5
+#define VESC_COMM_SET_CURRENT       6
+#define VESC_COMM_SET_CURRENT_BRAKE 7
+
+// Scale of command arguments (duty 0-1, currents in A).
+#define VESC_DUTY_SCALE    100000
+#define VESC_CURRENT_SCALE 1000
+
+// Size of a packet carrying a command with a 32 bit argument.
+#define VESC_COMMAND_PACKET_SIZE 10
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+enum vescParserResult {
+  VESC_PARSER_BUSY,     // Need more bytes
+  VESC_PARSER_COMPLETE, // A valid packet is in the payload buffer
+  VESC_PARSER_ERROR     // Packet dropped (bad length, CRC or end byte)
+};
+
+struct vescParser {
+  uint8_t state;
+  uint16_t length;
+  uint16_t index;
+  uint16_t crc;
+  uint8_t payload[VESC_PARSER_MAX_PAYLOAD];
+};
+
+// Values decoded from a COMM_GET_VALUES reply.
+struct vescMeasurement {
+  float tempFet;
+  float tempMotor;
+  float motorCurrent;
+  float inputCurrent;
+  float dutyCycle;
+  long rpm;
+  float inpVoltage;
+  float ampHours;
+  float ampHoursCharged;
+  long tachometer;
+  long tachometerAbs;
+  uint8_t fault;
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+// Reset the parser to wait for a new packet.
+void vescParserReset(struct vescParser *parser);
+
+// Feed one byte to the parser.
+uint8_t vescParserFeed(struct vescParser *parser, uint8_t byte);
+
+// Decode a COMM_GET_VALUES payload. Returns false if it is not one.
+bool vescDecodeValues(const uint8_t *payload, uint16_t length, struct vescMeasurement *values);
+
+// Frame a payload as a VESC packet. Returns the packet size.
+uint8_t vescEncodePacket(uint8_t *packet, const uint8_t *payload, uint8_t length);
+
+// Frame a command with a signed 32 bit argument (already scaled) as a VESC
+// packet. Returns the packet size.
+uint8_t vescEncodeCommand(uint8_t *packet, uint8_t command, int32_t value);
+
+// CRC-16/XMODEM as used by the VESC.
+uint16_t vescCrc16(const uint8_t *data, uint16_t length);
+
+// Send a COMM_GET_VALUES request, dropping any reply still in progress.
+void vescAsyncRequest();
+
+// Return true while a request is waiting for its reply.
+bool vescAsyncPending();
+
+// Send a command if it fits in the TX buffer without blocking. Returns
+// false if it was not sent.
+bool vescAsyncCommand(uint8_t command, int32_t value);
+
+// Process received bytes. Returns true when a reply has been decoded.
+bool vescAsyncUpdate(struct vescMeasurement *values);
+
+#endif /* VESC_ASYNC_H */
@@ -3,7 +3,10 @@
  * @author Benjamin Vedder, 2017
  * @author Simon Lövgren, 2018
  * 
- * @brief  Main entry point for nRF24 Esk8 Remote Transmitter.
+ * @brief  Main entry point for nRF24 Esk8 Remote Receiver.
+ *
+ * The nRF24 IRQ line must be wired to pin 2 (INT0); packets are received
+ * in the interrupt handler.
  */
 
 /**
@@ -17,6 +20,12 @@
 #include <nRF24L01.h>
 #include "RF24.h"
 #include "VescUart.h"
+#include "VescAsync.h"
+#include "ServoOutput.h"
+#include "TelemetryStream.h"
+#include <EskProtocol.h>
+#include <LoopTiming.h>
+#include <TaskScheduler.h>
 
 
 /**
@@ -25,6 +34,34 @@
  * ****************************************************************************
  */
 
+// Control the VESC with current commands over UART instead of a servo pulse.
+// Set the VESC app timeout, it stops the motor if the commands stop coming.
+// #define UART_CONTROL
+
+// Measure loop and stage durations, sent as binary frames over Serial
+// (tools/loop_timing.py). Serial is the VESC port, so connect it to a
+// computer instead of the VESC while measuring.
+// #define LOOP_TIMING
+
+// Send every throttle packet, VESC sample and link event as framed binary
+// records on STREAMIO (tools/telemetry_stream.py). STREAMIO defaults to
+// Serial, the VESC port; not together with LOOP_TIMING on the same port.
+// #define TELEMETRY_STREAM
+
+// Print the statistics of one task over Serial every 100 ms, the next task
+// each time, and clear them: "T <task> <runs> <overruns> <skipped> <min
+// late µs> <avg late µs> <max late µs> <max run µs>". Serial is the VESC
+// port, so connect it to a computer instead of the VESC while measuring;
+// not together with the other options using Serial.
+// #define TASK_STATS_SERIAL
+
+#ifdef LOOP_TIMING
+  #define TIMING_START(start)         unsigned long start = micros()
+  #define TIMING_RECORD(stage, start) loopTimingRecord(&timingStages[stage], micros() - (start))
+#else
+  #define TIMING_START(start)
+  #define TIMING_RECORD(stage, start)
+#endif
 
 /**
  * ****************************************************************************
@@ -32,11 +69,14 @@
  * ****************************************************************************
  */
 
-struct vescValues {
-  float ampHours;
-  float inpVoltage;
-  long rpm;
-  long tachometerAbs;
+// Timed parts of the loop, the radio interrupt handler, and the time from
+// packet arrival to output.
+enum timingStage {
+  TIMING_LOOP,
+  TIMING_VESC,
+  TIMING_RADIO,
+  TIMING_OUTPUT,
+  TIMING_NUM_STAGES
 };
 
 
@@ -48,18 +88,56 @@ struct vescValues {
 
 RF24 radio(9, 10);
 const uint64_t pipe = 0xE8E8F0F0E1LL;
-
-bool recievedData = false;
-uint32_t lastTimeReceived = 0;
-
-int motorSpeed = 127;
-int timeoutMax = 500;
+int radioIrqPin = 2;
+
+// Written by the radio interrupt handler.
+volatile uint32_t lastTimeReceived = 0;
+volatile int motorSpeed = PROTOCOL_THROTTLE_NEUTRAL;
+struct loopTimingStage outputLatency; // Packet arrival to output, read with interrupts off
+volatile unsigned long lastArrival;
+volatile unsigned long firstPacketTime = 0; // µs from power on, 0 until the first throttle packet
+
+// Data rate and channel requested by the remote, applied from loop().
+volatile bool linkChanged = false;
+volatile byte pendingDataRate;
+volatile byte pendingChannel;
+byte radioDataRate = PROTOCOL_LINK_HOME_RATE;
+byte radioChannel = PROTOCOL_RENDEZVOUS_CHANNEL;
+
+unsigned long timeoutMax = 500;
+volatile unsigned long timeout = 500; // Current timeout, from the remote's keepalive period (ms)
+byte timeoutKeepalives = 2; // Keepalive periods that may be missed
+int timeoutMargin = 100;
 int speedPin = 5;
+unsigned int servoFrameUs = SERVO_FRAME_US; // Servo pulse frame period (50 Hz)
+
+#ifdef UART_CONTROL
+float uartMaxCurrent = 40.0;      // Motor current at full throttle (A)
+float uartMaxBrakeCurrent = 30.0; // Brake current at full brake (A)
+int uartCommandInterval = 50;     // Resend period, keeps the VESC timeout fed (ms)
+volatile bool outputChanged = true;
+unsigned long lastUartCommand;
+#endif
 
-struct bldcMeasure measuredValues;
+struct vescMeasurement measuredValues;
 
 struct vescValues data;
-unsigned long lastDataCheck;
+uint8_t ackFrames[PROTOCOL_TELEMETRY_GROUPS][PROTOCOL_TELEMETRY_FRAME_SIZE]; // One prebuilt frame per group
+uint8_t ackSlot;        // Position in the group rotation, advanced by the interrupt handler
+uint8_t vescMeasurements; // Counts VESC replies, tells the remote which fields are new
+
+#ifdef TELEMETRY_STREAM
+struct telemetryStream stream; // Throttle packets queued by the interrupt handler
+bool firstPacketStreamed = false;
+#endif
+
+#ifdef LOOP_TIMING
+const unsigned int timingReportPeriod = 1000;
+struct loopTimingStage timingStages[TIMING_NUM_STAGES]; // Radio stage written by the interrupt handler
+struct loopTimingStage timingReport[TIMING_NUM_STAGES];
+struct loopTimingExport timingExport;
+unsigned long lastTimingReport;
+#endif
 
 
 /**
@@ -68,7 +146,48 @@ unsigned long lastDataCheck;
  * ****************************************************************************
  */
 
-void getVescData();
+void readVescData();
+void requestVescData();
+void checkFailsafe();
+void updateAckFrame();
+void queueAckFrame();
+void radioInterrupt();
+void getOutputLatency(struct loopTimingStage *stats);
+void recordOutputLatency(unsigned long arrival);
+void setOutput(int throttle);
+void updateUartControl();
+void updateLink();
+void updateLoopTiming();
+#ifdef TELEMETRY_STREAM
+void updateTelemetryStream();
+#endif
+#ifdef TASK_STATS_SERIAL
+void reportTaskStats();
+#endif
+
+// Tasks run from loop(), highest priority first. Periods and deadlines in
+// µs. The VESC reply is read a few bytes per call, often enough that the
+// serial receive buffer never fills.
+const struct task tasks[] = {
+  { checkFailsafe,          10000,  1000 },
+#ifdef UART_CONTROL
+  { updateUartControl,       1000,  2000 },
+#endif
+  { readVescData,            1000,  2000 },
+  { requestVescData,       250000, 10000 },
+  { updateLink,              1000,  2000 },
+#ifdef TELEMETRY_STREAM
+  { updateTelemetryStream,   2000,  5000 },
+#endif
+#ifdef LOOP_TIMING
+  { updateLoopTiming,        5000, 20000 },
+#endif
+#ifdef TASK_STATS_SERIAL
+  { reportTaskStats,       100000, 20000 },
+#endif
+};
+struct taskState taskStates[sizeof(tasks) / sizeof(tasks[0])];
+struct taskScheduler scheduler;
 
 /**
  * ****************************************************************************
@@ -78,74 +197,402 @@ void getVescData();
 
 void setup() {
   SERIALIO.begin(115200);
+#ifdef TELEMETRY_STREAM
+  STREAMIO.begin(115200);
+  telemetryStreamBegin(&stream);
+#endif
 
   radio.begin();
+  radio.setDataRate((rf24_datarate_e)radioDataRate);
+  radio.setChannel(radioChannel);
   radio.enableAckPayload();
   radio.enableDynamicPayloads();
   radio.openReadingPipe(1, pipe);
+  // Only interrupt on received packets, not on sent ack payloads.
+  radio.maskIRQ(true, true, false);
+
+#ifndef UART_CONTROL
+  servoOutputBegin(speedPin, servoFrameUs, servoThrottleToPulse(motorSpeed));
+#endif
+
+  updateAckFrame();
+  loopTimingReset(&outputLatency);
+
+#ifdef LOOP_TIMING
+  for (byte i = 0; i < TIMING_NUM_STAGES; i++) {
+    loopTimingReset(&timingStages[i]);
+  }
+#endif
+
+  // Queue the first ack payload, then let the interrupt handler take over the radio.
   radio.startListening();
+  queueAckFrame();
+
+  pinMode(radioIrqPin, INPUT);
+  SPI.usingInterrupt(digitalPinToInterrupt(radioIrqPin));
+  attachInterrupt(digitalPinToInterrupt(radioIrqPin), radioInterrupt, FALLING);
 
-  pinMode(speedPin, OUTPUT);
-  analogWrite(speedPin, motorSpeed);
+  taskSchedulerBegin(&scheduler, tasks, taskStates, sizeof(tasks) / sizeof(tasks[0]), micros);
 }
 
 void loop() {
+  TIMING_START(loopStart);
+  taskSchedulerRun(&scheduler);
+  TIMING_RECORD(TIMING_LOOP, loopStart);
+}
 
-  getVescData();
 
-  // If transmission is available
-  if (radio.available())
+/**
+ * ****************************************************************************
+ * PRIVATE FUNCTIONS
+ * ****************************************************************************
+ */
+
+// Packets are handled in radioInterrupt(), only the failsafe is left here.
+void checkFailsafe() {
+#ifdef TELEMETRY_STREAM
+  bool failsafe = false;
+#endif
+  noInterrupts();
+  if ((millis() - lastTimeReceived) > timeout && motorSpeed != PROTOCOL_THROTTLE_NEUTRAL)
   {
-    // The next time a transmission is received on pipe, the data in gotByte will be sent back in the acknowledgement (this could later be changed to data from VESC!)
-    radio.writeAckPayload(pipe, &data, sizeof(data));
+    // No speed is received within the timeout limit.
+    motorSpeed = PROTOCOL_THROTTLE_NEUTRAL;
+    setOutput(motorSpeed);
+#ifdef TELEMETRY_STREAM
+    failsafe = true;
+#endif
+  }
+  interrupts();
 
-    // Read the actual message
-    radio.read(&motorSpeed, sizeof(motorSpeed));
-    recievedData = true;
+#ifdef TELEMETRY_STREAM
+  if (failsafe) {
+    telemetryStreamLink(&stream, millis(), TELEMETRY_STREAM_FAILSAFE, radioDataRate, radioChannel);
   }
+#endif
+}
 
-  if (recievedData == true)
-  {
-    // A speed is received from the transmitter (remote).
+// Pick up the VESC reply as it arrives, a few bytes per call.
+void readVescData() {
+  TIMING_START(vescStart);
+
+  if (vescAsyncUpdate(&measuredValues)) {
+    // Only transmit what we need
+    data.ampHours = measuredValues.ampHours;
+    data.ampHoursCharged = measuredValues.ampHoursCharged;
+    data.inpVoltage = measuredValues.inpVoltage;
+    data.inputCurrent = measuredValues.inputCurrent;
+    data.motorCurrent = measuredValues.motorCurrent;
+    data.dutyCycle = measuredValues.dutyCycle;
+    data.tempFet = measuredValues.tempFet;
+    data.tempMotor = measuredValues.tempMotor;
+    data.rpm = measuredValues.rpm;
+    data.tachometerAbs = measuredValues.tachometerAbs;
+    data.fault = measuredValues.fault;
+
+    vescMeasurements++;
+    updateAckFrame();
+
+#ifdef TELEMETRY_STREAM
+    telemetryStreamVesc(&stream, millis(), &measuredValues);
+#endif
+  }
+
+  TIMING_RECORD(TIMING_VESC, vescStart);
+}
 
-    lastTimeReceived = millis();
-    recievedData = false;
+// Ask the VESC for its values, every 250 ms.
+void requestVescData() {
+  if (vescAsyncPending()) {
+    // The last request was never answered. Zeroed values keep the
+    // measurement count, so the remote sees them age.
+    memset(&data, 0, sizeof(data));
 
-    // Write the PWM signal to the ESC (0-255).
-    analogWrite(speedPin, motorSpeed);
+    updateAckFrame();
+
+#ifdef TELEMETRY_STREAM
+    telemetryStreamLink(&stream, millis(), TELEMETRY_STREAM_VESC_TIMEOUT, radioDataRate, radioChannel);
+#endif
   }
-  else if ((millis() - lastTimeReceived) > timeoutMax)
-  {
-    // No speed is received within the timeout limit.
-    motorSpeed = 127;
-    analogWrite(speedPin, motorSpeed);
+
+  vescAsyncRequest();
+}
+
+// Encode the telemetry for the next ack payloads, one frame per group so
+// the interrupt handler only has to pick one.
+void updateAckFrame() {
+  uint8_t frames[PROTOCOL_TELEMETRY_GROUPS][PROTOCOL_TELEMETRY_FRAME_SIZE];
+
+  for (uint8_t group = 0; group < PROTOCOL_TELEMETRY_GROUPS; group++) {
+    protocolEncodeTelemetry(frames[group], &data, group, vescMeasurements);
   }
+
+  // The interrupt handler may be queueing one of the frames.
+  noInterrupts();
+  memcpy(ackFrames, frames, sizeof(ackFrames));
+  interrupts();
 }
 
+// Queue the frame for the next group in the rotation as ack payload.
+void queueAckFrame() {
+  uint8_t group = protocolTelemetryGroup(ackSlot++);
+  radio.writeAckPayload(1, ackFrames[group], PROTOCOL_TELEMETRY_FRAME_SIZE);
+}
 
-/**
- * ****************************************************************************
- * PRIVATE FUNCTIONS
- * ****************************************************************************
- */
+// Set a new throttle on the ESC.
+void setOutput(int throttle) {
+#ifdef UART_CONTROL
+  // Sent from loop(), never block on the serial port in an interrupt.
+  outputChanged = true;
+#else
+  // Set the servo pulse to the ESC (0-1023 mapped to 1-2 ms).
+  servoOutputWrite(servoThrottleToPulse(throttle));
+#endif
+}
+
+#ifdef UART_CONTROL
+// Send the throttle as a current command when it changed, and periodically.
+void updateUartControl() {
+  bool changed;
+  int speed;
+  unsigned long arrival;
+
+  noInterrupts();
+  changed = outputChanged;
+  speed = motorSpeed;
+  arrival = lastArrival;
+  interrupts();
+
+  if (changed == false && millis() - lastUartCommand < uartCommandInterval) {
+    return;
+  }
+
+  bool sent;
+  if (speed >= PROTOCOL_THROTTLE_NEUTRAL) {
+    // Neutral gives zero current, letting the board roll.
+    long current = (speed - PROTOCOL_THROTTLE_NEUTRAL) * uartMaxCurrent * VESC_CURRENT_SCALE / (PROTOCOL_THROTTLE_MAX - PROTOCOL_THROTTLE_NEUTRAL);
+    sent = vescAsyncCommand(VESC_COMM_SET_CURRENT, current);
+  } else {
+    long current = (PROTOCOL_THROTTLE_NEUTRAL - speed) * uartMaxBrakeCurrent * VESC_CURRENT_SCALE / PROTOCOL_THROTTLE_NEUTRAL;
+    sent = vescAsyncCommand(VESC_COMM_SET_CURRENT_BRAKE, current);
+  }
 
-void getVescData() {
+  if (sent == false) {
+    // TX buffer full, try again next pass.
+    return;
+  }
 
-  if (millis() - lastDataCheck >= 250) {
+  lastUartCommand = millis();
 
-    lastDataCheck = millis();
+  if (changed == true) {
+    noInterrupts();
+    outputChanged = false;
+    interrupts();
 
-    // Only transmit what we need
-    if (VescUartGetValue(measuredValues)) {
-      data.ampHours = measuredValues.ampHours;
-      data.inpVoltage = measuredValues.inpVoltage;
-      data.rpm = measuredValues.rpm;
-      data.tachometerAbs = measuredValues.tachometerAbs;
-    } else {
-      data.ampHours = 0.0;
-      data.inpVoltage = 0.0;
-      data.rpm = 0;
-      data.tachometerAbs = 0;
+    recordOutputLatency(arrival);
+  }
+}
+#endif
+
+#ifdef LOOP_TIMING
+// Start a new timing period and send the last one, once per report period.
+void updateLoopTiming() {
+  loopTimingExportUpdate(&timingExport);
+
+  if (millis() - lastTimingReport < timingReportPeriod || loopTimingExportBusy(&timingExport)) {
+    return;
+  }
+  lastTimingReport = millis();
+
+  noInterrupts();
+  for (byte i = 0; i < TIMING_NUM_STAGES; i++) {
+    timingReport[i] = timingStages[i];
+    loopTimingReset(&timingStages[i]);
+  }
+  interrupts();
+  getOutputLatency(&timingReport[TIMING_OUTPUT]);
+
+  loopTimingExportStart(&timingExport, LOOP_TIMING_RECEIVER, timingReport, TIMING_NUM_STAGES);
+}
+#endif
+
+#ifdef TELEMETRY_STREAM
+// Write out as much of the queued records as the port takes. The first
+// throttle packet is sent once as a link event at its arrival.
+void updateTelemetryStream() {
+  unsigned long first;
+
+  noInterrupts();
+  first = firstPacketTime;
+  interrupts();
+
+  if (first != 0 && firstPacketStreamed == false) {
+    telemetryStreamLink(&stream, first / 1000, TELEMETRY_STREAM_FIRST_PACKET, radioDataRate, radioChannel);
+    firstPacketStreamed = true;
+  }
+
+  telemetryStreamUpdate(&stream);
+}
+#endif
+
+#ifdef TASK_STATS_SERIAL
+// One line fits the transmit buffer, so printing never waits.
+void reportTaskStats() {
+  static byte task = 0;
+  struct taskStats *stats = &taskStates[task].stats;
+
+  Serial.print(F("T "));
+  Serial.print(task);
+  Serial.print(' ');
+  Serial.print(stats->runs);
+  Serial.print(' ');
+  Serial.print(stats->overruns);
+  Serial.print(' ');
+  Serial.print(stats->skipped);
+  Serial.print(' ');
+  Serial.print(stats->minLateness);
+  Serial.print(' ');
+  Serial.print(taskStatsAverageLateness(stats));
+  Serial.print(' ');
+  Serial.print(stats->maxLateness);
+  Serial.print(' ');
+  Serial.println(stats->maxDuration);
+  taskStatsReset(stats);
+
+  task = (task + 1) % (sizeof(tasks) / sizeof(tasks[0]));
+}
+#endif
+
+// Follow the data rate and channel of the remote, or return to the home
+// rate and rendezvous channel when it is lost.
+void updateLink() {
+  bool changed;
+  byte rate;
+  byte channel;
+  unsigned long received;
+
+  noInterrupts();
+  changed = linkChanged;
+  rate = pendingDataRate;
+  channel = pendingChannel;
+  received = lastTimeReceived;
+  linkChanged = false;
+  interrupts();
+
+  if (changed == false) {
+    if (millis() - received <= PROTOCOL_LINK_FALLBACK_MS) {
+      return;
     }
+    rate = PROTOCOL_LINK_HOME_RATE;
+    channel = PROTOCOL_RENDEZVOUS_CHANNEL;
+  }
+
+  if (rate == radioDataRate && channel == radioChannel) {
+    return;
   }
+
+  if (rate != radioDataRate) {
+    radio.setDataRate((rf24_datarate_e)rate);
+    radioDataRate = rate;
+  }
+
+  if (channel != radioChannel) {
+    radio.setChannel(channel);
+    radioChannel = channel;
+  }
+
+#ifdef TELEMETRY_STREAM
+  telemetryStreamLink(&stream, millis(), TELEMETRY_STREAM_LINK_CHANGED, radioDataRate, radioChannel);
+#endif
+}
+
+// Add the time from a packet's arrival until the ESC has its throttle to
+// the statistics. On the servo output that is the end of the first pulse
+// with the new width. A UART command is only queued here, and takes
+// another 0.9 ms on the line.
+void recordOutputLatency(unsigned long arrival) {
+  unsigned long latency = micros() - arrival;
+
+#ifndef UART_CONTROL
+  latency += servoOutputDelay();
+#endif
+  loopTimingRecord(&outputLatency, latency);
+}
+
+// Copy the output latency statistics and start over.
+void getOutputLatency(struct loopTimingStage *stats) {
+  noInterrupts();
+  *stats = outputLatency;
+  loopTimingReset(&outputLatency);
+  interrupts();
+}
+
+// Called on the falling edge of the nRF24 IRQ line.
+void radioInterrupt() {
+  unsigned long arrival = micros();
+  bool txOk, txFail, rxReady;
+
+  // The SPI work below takes about 80 µs. Mask only this interrupt while
+  // it runs, so the servo pulse edges (Timer1) are not held up by it.
+#if defined(__AVR__)
+  EIMSK &= ~_BV(digitalPinToInterrupt(radioIrqPin));
+#endif
+  interrupts();
+
+  radio.whatHappened(txOk, txFail, rxReady);
+
+  while (radio.available())
+  {
+    uint8_t frame[PROTOCOL_MAX_FRAME_SIZE];
+    uint8_t size;
+    uint16_t throttle;
+    uint16_t keepalive;
+    uint8_t rate;
+    uint8_t channel;
+
+    // Read the actual message
+    size = radio.getDynamicPayloadSize();
+    if (size > sizeof(frame)) {
+      size = sizeof(frame);
+    }
+    radio.read(frame, size);
+
+    // The next time a transmission is received on pipe, the VESC data will be sent back in the acknowledgement
+    queueAckFrame();
+
+    // Only accept valid throttle frames, anything else is treated as not received.
+    if (protocolDecodeThrottle(frame, size, &throttle, &keepalive)) {
+      lastTimeReceived = millis();
+      motorSpeed = throttle;
+      if (firstPacketTime == 0) {
+        firstPacketTime = arrival;
+      }
+#ifdef TELEMETRY_STREAM
+      telemetryStreamThrottle(&stream, lastTimeReceived, throttle, keepalive);
+#endif
+
+      // Time out after missing a few keepalives, but never later than timeoutMax.
+      timeout = min((unsigned long)keepalive * timeoutKeepalives + timeoutMargin, timeoutMax);
+
+      lastArrival = arrival;
+      setOutput(throttle);
+
+#ifndef UART_CONTROL
+      recordOutputLatency(arrival);
+#endif
+    } else if (protocolDecodeLink(frame, size, &rate, &channel)) {
+      // Already acked at the old rate and channel, switch from loop().
+      pendingDataRate = rate;
+      pendingChannel = channel;
+      linkChanged = true;
+    }
+  }
+
+  TIMING_RECORD(TIMING_RADIO, arrival);
+
+  // A packet that arrived meanwhile sets the flag, and is handled on return.
+  noInterrupts();
+#if defined(__AVR__)
+  EIMSK |= _BV(digitalPinToInterrupt(radioIrqPin));
+#endif
 }
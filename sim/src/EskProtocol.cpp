@@ -0,0 +1,7 @@
+/**
+ * @file   EskProtocol.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Shared protocol library built for the host.
+ */
+#include "../../lib/EskProtocol/EskProtocol.cpp"
@@ -0,0 +1,7 @@
+/**
+ * @file   LoopTiming.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Shared loop timing library built for the host.
+ */
+#include "../../lib/LoopTiming/LoopTiming.cpp"
@@ -0,0 +1,32 @@
+/**
+ * @file   Receiver.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Receiver firmware built for the host. The sketch goes in its own
+ *         namespace so both firmwares can be linked into one program.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <Arduino.h>
+#include <SPI.h>
+#include <nRF24L01.h>
+#include <RF24.h>
+#include "VescUart.h"
+#include "VescAsync.h"
+#include "ServoOutput.h"
+#include "TelemetryStream.h"
+#include <EskProtocol.h>
+#include <LoopTiming.h>
+#include <TaskScheduler.h>
+
+#include "../../receiver/src/VescAsync.cpp"
+#include "../../receiver/src/ServoOutput.cpp"
+#include "../../receiver/src/TelemetryStream.cpp"
+
+namespace receiver {
+#include "../../receiver/src/main.cpp"
+}
@@ -0,0 +1,350 @@
+/**
+ * @file   SimArduino.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Host stand-ins for the Arduino core, EEPROM, SPI and U8g2.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <stdio.h>
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <SPI.h>
+#include <U8g2lib.h>
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+// SSD1306 transfers: addressing commands before each run of tiles, 8 data
+// bytes per tile, and the init sequence; 9 bits per byte.
+#define DISPLAY_ADDRESS_BITS (8 * 9)
+#define DISPLAY_TILE_BITS    (8 * 9)
+#define DISPLAY_INIT_BITS    (28 * 9)
+#define DISPLAY_TILE_WIDTH   16
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE VARIABLES
+ * ****************************************************************************
+ */
+
+SimBoard *simBoard;
+HardwareSerial Serial;
+EEPROMClass EEPROM;
+SPIClass SPI;
+
+const uint8_t u8g2_font_profont12_tr[] = { 0 };
+const uint8_t u8g2_font_profont22_tn[] = { 0 };
+const uint8_t u8g2_font_10x20_tr[] = { 0 };
+const uint8_t u8g2_font_helvR10_tr[] = { 0 };
+const uint8_t u8g2_font_logisoso22_tn[] = { 0 };
+
+static volatile uint8_t portRegisters[SIM_NUM_PINS];
+
+
+/**
+ * ****************************************************************************
+ * BOARD
+ * ****************************************************************************
+ */
+
+void simBoardReset(SimBoard *board, const char *name) {
+  board->name = name;
+  board->timeUs = 0;
+  for (int i = 0; i < SIM_NUM_PINS; i++) {
+    board->pins[i] = HIGH;
+  }
+  for (int i = 0; i < SIM_NUM_INTERRUPTS; i++) {
+    board->interrupts[i] = NULL;
+  }
+  board->interruptEnables = 0;
+  board->serialRx.clear();
+  board->serialTx.clear();
+  board->serialBaud = 0;
+  board->serialTxBlocked = 0;
+  memset(board->eeprom, 0xFF, sizeof(board->eeprom));
+  board->eepromWrites = 0;
+  board->eepromPowerCut = -1;
+  board->eepromTornMask = 0;
+}
+
+void simAdvance(uint64_t us) {
+  simBoard->timeUs += us;
+}
+
+
+/**
+ * ****************************************************************************
+ * ARDUINO CORE
+ * ****************************************************************************
+ */
+
+unsigned long millis() {
+  return simBoard->timeUs / 1000;
+}
+
+unsigned long micros() {
+  return simBoard->timeUs;
+}
+
+void delay(unsigned long ms) {
+  simAdvance((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us) {
+  simAdvance(us);
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (mode == INPUT_PULLUP && pin < SIM_NUM_PINS && simBoard->pins[pin] > HIGH) {
+    simBoard->pins[pin] = HIGH;
+  }
+}
+
+int digitalRead(uint8_t pin) {
+  return (pin < SIM_NUM_PINS && simBoard->pins[pin] != LOW) ? HIGH : LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin < SIM_NUM_PINS) {
+    simBoard->pins[pin] = value;
+  }
+}
+
+int analogRead(uint8_t pin) {
+  return (pin < SIM_NUM_PINS) ? simBoard->pins[pin] & 0x3FF : 0;
+}
+
+void analogWrite(uint8_t pin, int value) {
+  digitalWrite(pin, value);
+}
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int mode) {
+  (void)mode;
+  if (interrupt < SIM_NUM_INTERRUPTS) {
+    simBoard->interrupts[interrupt] = handler;
+  }
+}
+
+void detachInterrupt(uint8_t interrupt) {
+  if (interrupt < SIM_NUM_INTERRUPTS) {
+    simBoard->interrupts[interrupt] = NULL;
+  }
+}
+
+// Interrupts are only delivered between loop() calls, nothing to mask.
+// Enabling them is counted, so the sim can tell which handlers let other
+// interrupts in.
+void noInterrupts() {}
+
+void interrupts() {
+  if (simBoard != NULL) {
+    simBoard->interruptEnables++;
+  }
+}
+
+long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+volatile uint8_t *simPortRegister(uint8_t pin) {
+  return &portRegisters[pin % SIM_NUM_PINS];
+}
+
+
+/**
+ * ****************************************************************************
+ * SERIAL
+ * ****************************************************************************
+ */
+
+void HardwareSerial::begin(unsigned long baud) {
+  simBoard->serialBaud = baud;
+}
+
+int HardwareSerial::available() {
+  int count = 0;
+  for (size_t i = 0; i < simBoard->serialRx.size(); i++) {
+    if (simBoard->serialRx[i].availableAt > simBoard->timeUs) {
+      break;
+    }
+    count++;
+  }
+  return count;
+}
+
+int HardwareSerial::read() {
+  if (available() == 0) {
+    return -1;
+  }
+  uint8_t value = simBoard->serialRx.front().value;
+  simBoard->serialRx.pop_front();
+  return value;
+}
+
+// Bytes not yet taken off serialTx fill the TX buffer.
+int HardwareSerial::availableForWrite() {
+  int used = simBoard->serialTx.size();
+  return (used < SIM_SERIAL_TX_BUFFER) ? SIM_SERIAL_TX_BUFFER - used : 0;
+}
+
+// A write to a full TX buffer would wait for the UART on the board.
+size_t HardwareSerial::write(uint8_t value) {
+  if (availableForWrite() == 0) {
+    simBoard->serialTxBlocked++;
+  }
+  simBoard->serialTx.push_back(value);
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    write(buffer[i]);
+  }
+  return size;
+}
+
+size_t HardwareSerial::print(const char *str) {
+  return write((const uint8_t *)str, strlen(str));
+}
+
+size_t HardwareSerial::print(long value) {
+  char buffer[12];
+  snprintf(buffer, sizeof(buffer), "%ld", value);
+  return print(buffer);
+}
+
+size_t HardwareSerial::println(const char *str) {
+  return print(str) + print("\r\n");
+}
+
+size_t HardwareSerial::println(long value) {
+  return print(value) + print("\r\n");
+}
+
+void HardwareSerial::flush() {}
+
+
+/**
+ * ****************************************************************************
+ * STRING
+ * ****************************************************************************
+ */
+
+String::String(const char *str) : text(NULL) {
+  assign(str, "");
+}
+
+String::String(const String &other) : text(NULL) {
+  assign(other.text, "");
+}
+
+String::String(int value) : text(NULL) {
+  char buffer[8];
+  snprintf(buffer, sizeof(buffer), "%d", value);
+  assign(buffer, "");
+}
+
+String::~String() {
+  free(text);
+}
+
+String &String::operator=(const String &other) {
+  if (this != &other) {
+    assign(other.text, "");
+  }
+  return *this;
+}
+
+String operator+(const String &left, const String &right) {
+  String sum;
+  sum.assign(left.text, right.text);
+  return sum;
+}
+
+unsigned int String::length() const {
+  return strlen(text);
+}
+
+void String::toCharArray(char *buffer, unsigned int size) const {
+  if (size == 0) {
+    return;
+  }
+  strncpy(buffer, text, size - 1);
+  buffer[size - 1] = '\0';
+}
+
+void String::assign(const char *left, const char *right) {
+  size_t leftLength = strlen(left);
+  size_t rightLength = strlen(right);
+  char *joined = (char *)malloc(leftLength + rightLength + 1);
+
+  memcpy(joined, left, leftLength);
+  memcpy(joined + leftLength, right, rightLength + 1);
+  free(text);
+  text = joined;
+}
+
+
+/**
+ * ****************************************************************************
+ * DISPLAY
+ * ****************************************************************************
+ */
+
+U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C::U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C(int rotation, int reset)
+  : pagesSent(0), maxTransferUs(0), busClock(100000), page(0) {
+  (void)rotation;
+  (void)reset;
+  u8x8.display = this;
+}
+
+void U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C::initDisplay() {
+  simAdvance((uint64_t)DISPLAY_INIT_BITS * 1000000 / busClock);
+}
+void U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C::setBusClock(uint32_t clock) { busClock = clock; }
+void U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C::setPowerSave(uint8_t enable) { (void)enable; }
+void U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C::setContrast(uint8_t value) { (void)value; }
+
+void U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C::clearBuffer() {
+  memset(buffer, 0, sizeof(buffer));
+}
+
+// Sending blocks for the I2C transfer.
+void u8x8_DrawTile(u8x8_t *u8x8, uint8_t x, uint8_t y, uint8_t cnt, uint8_t *tile_ptr) {
+  U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C *display = u8x8->display;
+  uint32_t us = (uint64_t)(DISPLAY_ADDRESS_BITS + cnt * DISPLAY_TILE_BITS) * 1000000 / display->busClock;
+
+  (void)y;
+  (void)tile_ptr;
+  simAdvance(us);
+  display->maxTransferUs = max(display->maxTransferUs, (uint16_t)us);
+  if (x + cnt >= DISPLAY_TILE_WIDTH) {
+    display->pagesSent++;
+  }
+}
+
+uint8_t *U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C::getBufferPtr() { return buffer; }
+uint8_t U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C::getBufferTileWidth() { return sizeof(buffer) / 8; }
+uint8_t U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C::getBufferCurrTileRow() { return page; }
+uint8_t U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C::getBufferTileHeight() { return 1; }
+
+void U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C::setFont(const uint8_t *font) { (void)font; }
+void U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C::drawStr(int x, int y, const char *str) { (void)x; (void)y; (void)str; }
+void U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C::drawXBM(int x, int y, int w, int h, const uint8_t *bitmap) { (void)x; (void)y; (void)w; (void)h; (void)bitmap; }
+void U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C::drawXBMP(int x, int y, int w, int h, const uint8_t *bitmap) { (void)x; (void)y; (void)w; (void)h; (void)bitmap; }
+void U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C::drawPixel(int x, int y) { (void)x; (void)y; }
+void U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C::drawHLine(int x, int y, int w) { (void)x; (void)y; (void)w; }
+void U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C::drawVLine(int x, int y, int h) { (void)x; (void)y; (void)h; }
+void U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C::drawFrame(int x, int y, int w, int h) { (void)x; (void)y; (void)w; (void)h; }
+void U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C::drawRFrame(int x, int y, int w, int h, int r) { (void)x; (void)y; (void)w; (void)h; (void)r; }
+void U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C::drawBox(int x, int y, int w, int h) { (void)x; (void)y; (void)w; (void)h; }
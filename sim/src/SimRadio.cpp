@@ -0,0 +1,301 @@
+/**
+ * @file   SimRadio.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Host stand-in for the RF24 library on a simulated radio channel.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <RF24.h>
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+// Packet overhead: preamble, 5 byte address, packet control field and CRC.
+#define RADIO_OVERHEAD_BITS (8 + 40 + 9 + 16)
+
+// TX settling time before each attempt.
+#define RADIO_SETTLE_US 130
+
+// Received power over 1 Mbps sensitivity (-85 dBm) that sets RPD (-64 dBm).
+#define RADIO_RPD_DB 21.0
+
+// Spread of the loss curve around zero margin, dB.
+#define RADIO_FADE_DB 2.0
+
+// Time the oscillator takes to start after power down (Tpd2stby), and the
+// give up time of the library for a write that never completes. The
+// library is built without its own wait for the oscillator
+// (RF24_POWERUP_DELAY=0), as the remote is. begin() waits for the radio to
+// settle after power on, then powers it up.
+#define RADIO_POWER_UP_US      1500
+#define RADIO_WRITE_TIMEOUT_US 95000
+#define RADIO_BEGIN_US         5000
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE VARIABLES
+ * ****************************************************************************
+ */
+
+SimLink simLink;
+
+// All radios, linked through RF24::next.
+static RF24 *radios;
+
+static uint64_t randomState = 0x2545F4914F6CDD1DULL;
+
+// Output power of RF24_PA_MIN - RF24_PA_MAX relative to PA_MAX.
+static const double paGainDb[] = { -18.0, -12.0, -6.0, 0.0 };
+
+// Sensitivity relative to 1 Mbps, for 1 Mbps, 2 Mbps and 250 kbps.
+static const double rateGainDb[] = { 0.0, -3.0, 9.0 };
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+static uint32_t airTimeUs(const RF24 *radio, uint8_t size);
+static RF24 *findListener(const RF24 *writer);
+
+
+/**
+ * ****************************************************************************
+ * INTERFACE FUNCTIONS
+ * ****************************************************************************
+ */
+
+RF24::RF24(uint8_t cePin, uint8_t csnPin)
+  : board(NULL), txAddress(0), rxAddress(0), channel(76), paLevel(RF24_PA_MAX),
+    dataRate(RF24_1MBPS), retryDelay(5), retryCount(15), lastArc(0),
+    lastPowerDb(0), ackPower(false), listening(false), powered(false), readyAt(0), rxMasked(false),
+    txBusy(false), txAcked(false), txDoneAt(0) {
+  (void)cePin;
+  (void)csnPin;
+  next = radios;
+  radios = this;
+}
+
+bool RF24::begin() {
+  // Bind to the board running setup(), with the library defaults.
+  board = simBoard;
+  channel = 76;
+  paLevel = RF24_PA_MAX;
+  dataRate = RF24_1MBPS;
+  retryDelay = 5;
+  retryCount = 15;
+  listening = false;
+  powered = false;
+  txBusy = false;
+  rxQueue.clear();
+  ackQueue.clear();
+  simAdvance(RADIO_BEGIN_US);
+  powerUp();
+  return true;
+}
+
+void RF24::powerUp() {
+  if (powered == false) {
+    readyAt = board->timeUs + RADIO_POWER_UP_US;
+  }
+  powered = true;
+}
+
+bool RF24::write(const void *buffer, uint8_t size) {
+  startWrite(buffer, size, false);
+
+  // A radio powered down, or not up yet, never sends; the library gives up.
+  if (txDoneAt == UINT64_MAX) {
+    simAdvance(RADIO_WRITE_TIMEOUT_US);
+    txBusy = false;
+    return false;
+  }
+
+  simAdvance(txDoneAt - board->timeUs);
+  txBusy = false;
+  return txAcked;
+}
+
+// The attempts are played out ahead on a clock of their own; packets, acks
+// and the outcome show up as the board's time reaches them.
+void RF24::startWrite(const void *buffer, uint8_t size, const bool multicast) {
+  (void)multicast;
+  uint64_t time = board->timeUs;
+
+  txBusy = true;
+  txAcked = false;
+  txDoneAt = UINT64_MAX;
+  lastArc = 0;
+  if (powered == false) {
+    return;
+  }
+  // Sent before the oscillator is up the packet never leaves.
+  if (time < readyAt) {
+    simLink.unready++;
+    return;
+  }
+
+  RF24 *listener = findListener(this);
+  uint32_t ackTime = airTimeUs(this, listener && !listener->ackQueue.empty() ? listener->ackQueue.front().size : 0);
+
+  size = min(size, (uint8_t)SIM_RADIO_MAX_PAYLOAD);
+  simLink.packets++;
+  ackPower = false;
+
+  // Attempt lost with a logistic curve over the margin at this PA level and rate.
+  lastPowerDb = simLink.marginDb + paGainDb[min(paLevel, (uint8_t)RF24_PA_MAX)];
+  double margin = lastPowerDb + rateGainDb[dataRate];
+  double fade = 1.0 / (1.0 + exp(margin / RADIO_FADE_DB));
+
+  for (lastArc = 0; lastArc <= retryCount; lastArc++) {
+    time += RADIO_SETTLE_US + airTimeUs(this, size);
+    simLink.attempts++;
+
+    double loss = simLink.loss + simLink.noise[channel] + fade;
+    if (listener == NULL || listener->rxQueue.size() >= SIM_RADIO_FIFO_SIZE || simRandom() < loss) {
+      // No ack, wait the auto retransmit delay.
+      time += (retryDelay + 1) * 250;
+      simLink.attemptsLost++;
+      continue;
+    }
+
+    SimPayload packet;
+    packet.availableAt = time + simLink.latencyUs;
+    packet.size = size;
+    memcpy(packet.data, buffer, size);
+    listener->rxQueue.push_back(packet);
+
+    time += RADIO_SETTLE_US + ackTime;
+    ackPower = true;
+
+    if (!listener->ackQueue.empty()) {
+      SimPayload ack = listener->ackQueue.front();
+      listener->ackQueue.pop_front();
+      ack.availableAt = time;
+      rxQueue.push_back(ack);
+    }
+
+    if (!listener->rxMasked) {
+      simScheduleInterrupt(listener->board, 0, packet.availableAt);
+    }
+    txAcked = true;
+    txDoneAt = time;
+    return;
+  }
+
+  lastArc = retryCount;
+  simLink.packetsLost++;
+  txDoneAt = time;
+}
+
+bool RF24::isAckPayloadAvailable() {
+  return available();
+}
+
+bool RF24::available() {
+  return !rxQueue.empty() && rxQueue.front().availableAt <= board->timeUs;
+}
+
+bool RF24::available(uint8_t *pipe) {
+  if (pipe != NULL) {
+    *pipe = 1;
+  }
+  return available();
+}
+
+uint8_t RF24::getDynamicPayloadSize() {
+  return rxQueue.empty() ? 0 : rxQueue.front().size;
+}
+
+void RF24::read(void *buffer, uint8_t size) {
+  if (rxQueue.empty()) {
+    return;
+  }
+  memcpy(buffer, rxQueue.front().data, min(size, rxQueue.front().size));
+  rxQueue.pop_front();
+}
+
+void RF24::writeAckPayload(uint8_t pipe, const void *buffer, uint8_t size) {
+  (void)pipe;
+  if (ackQueue.size() >= SIM_RADIO_FIFO_SIZE) {
+    return;
+  }
+
+  SimPayload ack;
+  ack.availableAt = 0;
+  ack.size = min(size, (uint8_t)SIM_RADIO_MAX_PAYLOAD);
+  memcpy(ack.data, buffer, ack.size);
+  ackQueue.push_back(ack);
+}
+
+void RF24::whatHappened(bool &txOk, bool &txFail, bool &rxReady) {
+  bool done = txBusy && board->timeUs >= txDoneAt;
+
+  txOk = done && txAcked;
+  txFail = done && !txAcked;
+  rxReady = available();
+  if (done) {
+    txBusy = false;
+  }
+}
+
+bool RF24::testRPD() {
+  return (ackPower && lastPowerDb > RADIO_RPD_DB) || simRandom() < simLink.noise[channel];
+}
+
+void simLinkReset(double loss, double marginDb, uint32_t latencyUs) {
+  memset(&simLink, 0, sizeof(simLink));
+  simLink.loss = loss;
+  simLink.marginDb = marginDb;
+  simLink.latencyUs = latencyUs;
+}
+
+double simRandom() {
+  // xorshift64*, repeatable between runs.
+  randomState ^= randomState >> 12;
+  randomState ^= randomState << 25;
+  randomState ^= randomState >> 27;
+  return ((randomState * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE FUNCTIONS
+ * ****************************************************************************
+ */
+
+// Time on air of a packet with a payload of size bytes.
+static uint32_t airTimeUs(const RF24 *radio, uint8_t size) {
+  uint32_t bits = RADIO_OVERHEAD_BITS + size * 8;
+
+  switch (radio->dataRate) {
+    case RF24_2MBPS:   return bits / 2;
+    case RF24_250KBPS: return bits * 4;
+    default:           return bits;
+  }
+}
+
+// Powered, listening radio on the writer's address, channel and data rate.
+static RF24 *findListener(const RF24 *writer) {
+  for (RF24 *radio = radios; radio != NULL; radio = radio->next) {
+    if (radio != writer && radio->board != NULL && radio->powered && radio->listening &&
+        radio->rxAddress == writer->txAddress && radio->channel == writer->channel &&
+        radio->dataRate == writer->dataRate) {
+      return radio;
+    }
+  }
+  return NULL;
+}
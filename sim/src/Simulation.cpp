@@ -0,0 +1,2904 @@
+/**
+ * @file   Simulation.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Runs the transmitter and receiver firmwares against each other
+ *         over a simulated radio link, and reports end-to-end latency.
+ *
+ * Each board has its own clock. The board furthest behind runs next, one
+ * loop() pass at a time, so blocking calls (display pages, channel scan
+ * readings, delays) hold up their own board as on hardware. A packet the
+ * radio sends on its own is played out ahead, its outcome showing up once
+ * the board's clock gets there. Loop passes cost a fixed time on top of
+ * that. Interrupts are delivered after the loop pass they
+ * fell in, stamped with their own time.
+ *
+ * Scenarios vary loss and link margin; the link level printed is the one
+ * the transmitter's link quality monitor settled on. Next to the oldest
+ * telemetry held, the share of the time the trip log would find its
+ * telemetry too old to log is listed.
+ *
+ * Latency is measured from a hall sensor step to the last change of the
+ * receiver's servo pulse during that step, i.e. until the pulse has
+ * settled on its final value. The ESC only sees the new value at the end
+ * of the next pulse: the output latency the receiver measures, from packet
+ * arrival to the end of the first pulse with the new width, is listed
+ * after it.
+ *
+ * The servo pulse on the pin is placed as Timer1 makes it, with each edge
+ * waiting for interrupt handlers that have interrupts off. Per scenario,
+ * the worst pulse width error and its standard deviation (jitter) are
+ * listed.
+ *
+ * Before the scenarios, modules are checked on their own:
+ *
+ *   - the ADC sampler against a plain average of its input
+ *   - the text formatters against expected texts and the String code
+ *     they replaced
+ *   - the radio protocol, round trips and damaged frames
+ *   - the VESC reply parser, fed in pieces, damaged and after noise
+ *   - the VESC command frames against frames built by hand
+ *   - the throttle curves against the formulas their tables are built from
+ *   - the 10-bit throttle position against its calibration and the 8-bit
+ *     code it replaced
+ *   - the settings table
+ *   - the settings store against power loss during every EEPROM byte write
+ *   - the bitmaps decoded from flash against the images they were
+ *     generated from
+ *   - the battery model over simulated rides, and over the rides recorded
+ *     in sim/fixtures
+ *
+ * After them, the statistics of the firmware tasks are listed, and the
+ * power modes of the remote checked. The run exits with status 1 if any
+ * check failed.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <stdio.h>
+#include <dirent.h>
+#include <chrono>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <Arduino.h>
+#include <RF24.h>
+#include <U8g2lib.h>
+#include <EskProtocol.h>
+#include <LoopTiming.h>
+#include "AdcSampler.h"
+#include "TextFormat.h"
+#include "ThrottleCurve.h"
+#include "ServoOutput.h"
+#include "VescAsync.h"
+#include "ChannelScan.h"
+#include "SettingsStore.h"
+#include "SettingsTable.h"
+#include "BitmapAssets.h"
+#include "Telemetry.h"
+#include "TripLog.h"
+#include "TelemetryStream.h"
+#include "BatteryModel.h"
+#include "PowerManager.h"
+#include <TaskScheduler.h>
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+// Fixed cost of a loop() pass, besides blocking calls.
+#define SIM_TX_LOOP_US 200
+#define SIM_RX_LOOP_US 50
+
+// Cost of the radio interrupt handler (SPI reads and writes), and how much
+// of it runs with interrupts off when the handler enables them early.
+#define SIM_RX_ISR_US        80
+#define SIM_RX_ISR_MASKED_US 6
+
+// Other interrupt handlers on the receiver: timer 0 overflow (millis) and
+// the serial receive handler for each VESC byte.
+#define SIM_TIMER0_ISR_US 5
+#define SIM_USART_ISR_US  3
+
+// ADC conversion period, and the board the ADC is on.
+#define SIM_ADC_PERIOD_US (1000000UL / ADC_SAMPLER_RATE_HZ)
+
+// Simulated VESC: reply delay and time per byte at 115200 baud.
+#define SIM_VESC_REPLY_US 500
+#define SIM_VESC_BYTE_US  87
+
+// Length of each throttle step, and of each scenario.
+#define SIM_STEP_US     400000ULL
+#define SIM_SCENARIO_US 20000000ULL
+
+// ADC sampler check: samples pushed per channel for each sequence.
+#define SIM_ADC_SAMPLES 2000
+
+// Text format check: page values compared with the old rendering, in
+// steps of 0.01, and rounds of the timing comparison.
+#define SIM_FORMAT_PAGE_VALUES 20000
+#define SIM_FORMAT_ROUNDS      20
+
+// Display size, and page height in rows of 8 pixels (U8g2 page mode 1).
+#define SIM_DISPLAY_WIDTH  128
+#define SIM_DISPLAY_PAGES  4
+
+// Battery model check: update period, and length of one acceleration,
+// cruise and braking cycle of the simulated rides.
+#define SIM_BATTERY_STEP_S  0.25
+#define SIM_BATTERY_CYCLE_S 20.0
+
+// Rides recorded with TELEMETRY_STREAM, relative to sim/ where the
+// simulation runs. See checkRecordedRides().
+#define SIM_FIXTURES_DIR "fixtures"
+
+// Transmitter pins driven by the harness.
+#define SIM_TRIGGER_PIN 2
+
+// Settings store check: fields used and number of changes made.
+#define SIM_STORE_FIELDS  13
+#define SIM_STORE_CHANGES 400
+
+// Trip log check: trips, samples per trip and samples with power cuts.
+#define SIM_TRIPS          3
+#define SIM_TRIP_SAMPLES   150
+#define SIM_TRIP_CUT_EVERY 7
+
+// Telemetry stream check: packet and VESC sample periods, and the UART
+// rate (bytes per ms) at 115200 and 9600 baud.
+#define SIM_STREAM_PACKET_MS 14
+#define SIM_STREAM_VESC_MS   250
+#define SIM_STREAM_FAST_BPMS 11.52
+#define SIM_STREAM_SLOW_BPMS 0.96
+
+// Timer 0 overflow period, wakes the MCU from idle sleep.
+#define SIM_TIMER0_US 1024
+
+// Power check: wakes, time parked before each (plus a step to vary the
+// phase against the keepalives), and time awake after.
+#define SIM_POWER_WAKES   5
+#define SIM_POWER_PARK_US 65000000ULL
+#define SIM_POWER_PHASE_US 37000ULL
+#define SIM_POWER_RIDE_US 1000000ULL
+
+// Boot check: longest time to wait for the remote to settle on a channel.
+#define SIM_BOOT_US 10000000ULL
+
+// Scheduler check: virtual time per case, and cost of a scheduler pass.
+#define SIM_SCHEDULER_US      10000000UL
+#define SIM_SCHEDULER_PASS_US 4
+
+// Scheduler check: runs of a 1 ms task, past where its run count stops.
+#define SIM_SCHEDULER_SATURATED_RUNS 70000UL
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+struct SimInterrupt {
+  SimBoard *board;
+  uint8_t interrupt;
+  uint64_t time;
+};
+
+struct SimEvent {
+  uint64_t time;
+  uint16_t pulse;
+};
+
+// Time an interrupt handler runs with interrupts off.
+struct SimWindow {
+  uint64_t start;
+  uint64_t end;
+};
+
+// Fills a per-channel noise map (probability of a carrier, and of losing
+// an attempt).
+typedef void (*SimNoiseMap)(double *noise);
+
+struct SimScenario {
+  const char *name;
+  double loss;
+  double marginDb;
+  uint32_t latencyUs;
+  bool trigger;
+  SimNoiseMap noise;
+};
+
+// The raw payloads sent before the protocol, with the AVR's 16 bit int
+// and 32 bit long.
+struct SimOldVescValues {
+  float ampHours;
+  float inpVoltage;
+  int32_t rpm;
+  int32_t tachometerAbs;
+};
+typedef int16_t SimOldThrottle;
+
+// Expected text of a formatter call.
+struct SimFormatCase {
+  uint32_t value;
+  uint8_t decimals;   // formatFixed() only
+  uint8_t minDigits;
+  const char *text;
+};
+
+// Expected text of a page value shown on the display.
+struct SimPageCase {
+  float value;
+  uint8_t decimals;
+  const char *text;
+};
+
+// A VESC command and the frame the VESC expects for it.
+struct SimVescFrame {
+  const char *name;
+  uint8_t command;
+  int32_t value;
+  uint8_t frame[VESC_COMMAND_PACKET_SIZE];
+};
+
+struct SimNoiseCase {
+  const char *name;
+  SimNoiseMap noise;
+};
+
+struct SimBitmap {
+  const struct bitmapAsset *asset;
+  int width;
+  int height;
+  const unsigned char *original; // XBM
+};
+
+// Battery pack discharged over a ride. The resistance per series cell
+// differs from the model's starting value on purpose.
+struct SimBattery {
+  const char *name;
+  uint8_t type;
+  uint8_t cells;
+  double capacityAh;
+  double resistance;  // Ohm per series cell
+  const double *curve; // Cell voltage (V) at 0, 10, ... 100 %
+};
+
+// Trip log sample, in the logged units.
+struct SimTripSample {
+  uint8_t speed;
+  uint16_t voltage;
+  uint16_t ampHours;
+
+  bool operator==(const SimTripSample &other) const {
+    return speed == other.speed && voltage == other.voltage && ampHours == other.ampHours;
+  }
+};
+
+struct SimTaskName {
+  taskFunction run;
+  const char *name;
+};
+
+// Task statistics of a firmware added up over the scenarios.
+struct SimTaskTotals {
+  const char *firmware;
+  uint8_t index;
+  const char *name;
+  unsigned long period; // µs
+  unsigned long runs;
+  unsigned long overruns;
+  unsigned long skipped;
+  uint64_t lateness;
+  uint16_t maxLateness;
+  uint16_t maxDuration;
+};
+
+struct SimReport {
+  std::vector<double> latencies; // ms
+  unsigned long failsafes;
+  unsigned long pages;
+  uint16_t maxAge[3]; // Oldest rpm, voltage and FET temperature seen (ms)
+  unsigned long ageChecks;
+  unsigned long tripStale; // Checks the trip log telemetry was too old
+  std::vector<double> pulseErrors; // Servo pulse width on the pin minus the one set (µs)
+  struct loopTimingStage output;   // Packet arrival to output, as the receiver measured it
+};
+
+
+/**
+ * ****************************************************************************
+ * FIRMWARES
+ * ****************************************************************************
+ */
+
+namespace transmitter {
+  void setup();
+  void loop();
+  extern U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C u8g2;
+  extern byte radioLinkLevel;
+  extern byte radioChannel;
+  extern struct telemetry telemetryState;
+  extern struct taskScheduler scheduler;
+  extern struct powerManager powerState;
+  extern byte poweredMode;
+  extern byte selectedChannel;
+  extern unsigned int backgroundScanLeft;
+  extern struct settings remoteSettings;
+  extern short throttle;
+  extern byte hallCenterMargin;
+  void calculateThrottlePosition();
+  void updateControl();
+  void flushTripLog();
+  void updateTripLog();
+  bool tripTelemetryFresh(unsigned long now);
+  void updateBoardBattery();
+  void updateDisplay();
+}
+
+namespace receiver {
+  void setup();
+  void loop();
+  extern volatile int motorSpeed;
+  extern volatile unsigned long firstPacketTime;
+  extern struct taskScheduler scheduler;
+  void checkFailsafe();
+  void readVescData();
+  void requestVescData();
+  void updateLink();
+  void getOutputLatency(struct loopTimingStage *stats);
+}
+
+
+/**
+ * ****************************************************************************
+ * BITMAP SOURCES
+ * ****************************************************************************
+ */
+
+namespace original {
+  #include "../../transmitter/assets/logo.xbm"
+  #include "../../transmitter/assets/signal_transmitting.xbm"
+  #include "../../transmitter/assets/signal_connected.xbm"
+  #include "../../transmitter/assets/signal_noconnection.xbm"
+}
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE VARIABLES
+ * ****************************************************************************
+ */
+
+static SimBoard txBoard;
+static SimBoard rxBoard;
+
+static std::vector<SimInterrupt> pendingInterrupts;
+static std::vector<SimEvent> pulseEvents;
+static std::vector<SimWindow> maskedWindows;
+static uint64_t servoStart; // Timer1 started, frames count from here
+
+// Hall sensor step sequence, ADC values 0-1023 (default calibration).
+static const uint16_t hallSteps[] = { 512, 1023, 700, 512, 0, 300, 512, 900, 600, 200 };
+static const uint8_t numOfHallSteps = sizeof(hallSteps) / sizeof(hallSteps[0]);
+
+static const SimFormatCase unsignedCases[] = {
+  { 0,          0, 1,  "0" },
+  { 0,          0, 3,  "000" },
+  { 7,          0, 2,  "07" },
+  { 65535,      0, 1,  "65535" },
+  { 65536,      0, 1,  "65536" },
+  { 4294967295, 0, 1,  "4294967295" },
+  { 42,         0, 12, "0000000042" } // Padding stops at the maximum width
+};
+
+static const SimFormatCase fixedCases[] = {
+  { 0,          1, 2, "00.0" },
+  { 5,          3, 1, "0.005" },
+  { 999,        2, 1, "9.99" },
+  { 1000,       2, 1, "10.00" },
+  { 1234,       0, 1, "1234" },
+  { 4294967295, 1, 1, "429496729.5" },
+  { 4294967295, 9, 1, "4.294967295" }
+};
+
+static const SimPageCase pageCases[] = {
+  { 0.0,     1, "00.0" },
+  { 0.04,    1, "00.0" },
+  { 0.06,    1, "00.1" },
+  { 9.94,    1, "09.9" },
+  { 9.96,    1, "10.0" },  // Carry into the integer part
+  { 99.996,  2, "100.00" },
+  { 5.05,    2, "05.05" },
+  { -12.34,  1, "12.3" },  // Magnitude, e.g. reversing
+  { -0.04,   1, "00.0" },
+  { 123.45,  1, "123.5" },
+  { 1e10,    1, "429496729.5" } // Saturated
+};
+
+// Input sequences of the ADC sampler check, see adcSequence().
+static const char *const adcSequences[] = { "filling", "steady noise", "ramp", "step" };
+
+static void noiseQuiet(double *noise);
+static void noiseWifi16(double *noise);
+static void noiseWifi1611(double *noise);
+static void noiseRendezvous(double *noise);
+static void noiseBusy(double *noise);
+static void noiseJammed(double *noise);
+
+// The remote boots with WiFi on channels 1 and 6.
+static const SimScenario scenarios[] = {
+  { "clean",          0.00, 40.0, 300, true,  noiseWifi16 },
+  { "loss 20%",       0.20, 40.0, 300, true,  noiseWifi16 },
+  { "loss 60%",       0.60, 40.0, 300, true,  noiseWifi16 },
+  { "far",            0.00,  6.0, 300, true,  noiseWifi16 },
+  { "edge of range",  0.00, -2.0, 300, true,  noiseWifi16 },
+  { "near again",     0.00, 40.0, 300, true,  noiseWifi16 },
+  { "channel jammed", 0.00, 40.0, 300, true,  noiseJammed },
+  { "idle, released", 0.00, 40.0, 300, false, noiseWifi16 }
+};
+
+static const SimNoiseCase noiseCases[] = {
+  { "quiet",                 noiseQuiet },
+  { "wifi 1, 6",             noiseWifi16 },
+  { "wifi 1, 6, 11",         noiseWifi1611 },
+  { "wifi 1, 6, 11 + 76",    noiseRendezvous },
+  { "busy, gap at 30-34",    noiseBusy }
+};
+
+static const SimBitmap bitmaps[] = {
+  { &bitmapLogo,               logo_width, logo_height,                original::logo_bits },
+  { &bitmapSignalTransmitting, signal_transmitting_width, signal_transmitting_height, original::signal_transmitting_bits },
+  { &bitmapSignalConnected,    signal_connected_width, signal_connected_height,    original::signal_connected_bits },
+  { &bitmapSignalNoconnection, signal_noconnection_width, signal_noconnection_height, original::signal_noconnection_bits }
+};
+
+// Where bitmaps are drawn: aligned, unaligned, and clipped on each side.
+static const int bitmapPlacements[][2] = {
+  { 0, 0 }, { 4, 4 }, { 114, 17 }, { 61, 9 }, { -5, -3 }, { 120, 26 }, { 50, -11 }
+};
+
+// Typical 0.2C discharge curves, the same the model's tables are based on.
+static const double liIonCurve[] = { 3.00, 3.45, 3.55, 3.62, 3.68, 3.75, 3.83, 3.92, 4.00, 4.08, 4.19 };
+static const double lipoCurve[] = { 3.27, 3.69, 3.73, 3.77, 3.79, 3.82, 3.87, 3.93, 4.00, 4.08, 4.20 };
+
+static const SimBattery batteries[] = {
+  { "li-ion 10S4P",  BATTERY_LI_ION, 10, 12.0, 0.020, liIonCurve },
+  { "li-ion 12S2P",  BATTERY_LI_ION, 12, 6.0,  0.035, liIonCurve },
+  { "lipo 12S 5Ah",  BATTERY_LIPO,   12, 5.0,  0.004, lipoCurve }
+};
+
+// A COMM_GET_VALUES reply as firmware 3.40 frames it: 59 byte payload with
+// the d/q currents, watt hours, PID position and controller id the receiver
+// skips or ignores.
+static const uint8_t vescReply[] = {
+  0x02, 0x3B, 0x04, 0x01, 0x3A, 0x01, 0x17, 0x00, 0x00, 0x04, 0xD3, 0x00,
+  0x00, 0x03, 0x22, 0xFF, 0xFF, 0xFF, 0xF1, 0x00, 0x00, 0x04, 0xD2, 0x01,
+  0x9C, 0x00, 0x00, 0x3B, 0x82, 0x01, 0xA0, 0x00, 0x00, 0x30, 0x39, 0x00,
+  0x00, 0x02, 0x00, 0x00, 0x07, 0xD0, 0x00, 0x00, 0x00, 0x52, 0x08, 0x00,
+  0x01, 0xE2, 0x40, 0x00, 0x01, 0xFB, 0xD0, 0x00, 0x07, 0x5B, 0xCA, 0x00,
+  0x00, 0x05, 0x42, 0x03
+};
+
+// What the reply above holds.
+static const struct vescMeasurement vescReplyValues = {
+  31.4, 27.9, 12.35, 8.02, 0.412, 15234, 41.6, 1.2345, 0.0512, 123456, 130000, 0
+};
+
+// Commands as UART_CONTROL sends them with the default 40 A / 30 A limits,
+// framed by hand: start, length, command, big-endian value, CRC-16/XMODEM,
+// end.
+static const SimVescFrame vescFrames[] = {
+  { "full throttle", VESC_COMM_SET_CURRENT,       40000,  { 0x02, 0x05, 0x06, 0x00, 0x00, 0x9C, 0x40, 0xD8, 0xC7, 0x03 } },
+  { "neutral",       VESC_COMM_SET_CURRENT,       0,      { 0x02, 0x05, 0x06, 0x00, 0x00, 0x00, 0x00, 0xCD, 0x85, 0x03 } },
+  { "full brake",    VESC_COMM_SET_CURRENT_BRAKE, 30000,  { 0x02, 0x05, 0x07, 0x00, 0x00, 0x75, 0x30, 0xA6, 0x2B, 0x03 } },
+  { "half brake",    VESC_COMM_SET_CURRENT_BRAKE, 15000,  { 0x02, 0x05, 0x07, 0x00, 0x00, 0x3A, 0x98, 0x8F, 0x3B, 0x03 } },
+  { "reverse 5 A",   VESC_COMM_SET_CURRENT,       -5000,  { 0x02, 0x05, 0x06, 0xFF, 0xFF, 0xEC, 0x78, 0xE3, 0x05, 0x03 } },
+  { "duty 50%",      VESC_COMM_SET_DUTY,          50000,  { 0x02, 0x05, 0x05, 0x00, 0x00, 0xC3, 0x50, 0x3A, 0xA5, 0x03 } }
+};
+
+// The COMM_GET_VALUES request.
+static const uint8_t vescValuesRequest[] = { 0x02, 0x01, 0x04, 0x40, 0x84, 0x03 };
+
+// Hall calibrations, min/center/max: the default, narrow, and off center
+// both ways.
+static const int16_t hallCalibrations[][3] = {
+  { 0, 512, 1023 }, { 200, 512, 800 }, { 100, 700, 950 }, { 350, 420, 1000 }
+};
+
+// The custom throttle curve points in ThrottleCurve.cpp, in permille.
+static const double customCurvePoints[][2] = {
+  { 0, 0 }, { 250, 100 }, { 500, 300 }, { 750, 600 }, { 1000, 1000 }
+};
+
+// Bits of a torn EEPROM write that land: none, some, all but one.
+static const uint8_t tornMasks[] = { 0x00, 0x0F, 0xA5, 0xFE };
+
+static const SimTaskName taskNames[] = {
+  { transmitter::updateControl,      "control" },
+  { transmitter::flushTripLog,       "trip flush" },
+  { transmitter::updateBoardBattery, "battery" },
+  { transmitter::updateTripLog,      "trip sample" },
+  { transmitter::updateDisplay,      "display" },
+  { receiver::checkFailsafe,         "failsafe" },
+  { receiver::readVescData,          "vesc read" },
+  { receiver::requestVescData,       "vesc request" },
+  { receiver::updateLink,            "link" }
+};
+
+static std::vector<SimTaskTotals> taskTotals;
+static unsigned long simFailures; // Failed cases over all checks
+static int hallOverride = -1; // Fixed hall value instead of the steps
+static unsigned long virtualClockUs;
+static unsigned long virtualTaskUs;
+static unsigned long virtualTaskLeftUs; // Work left of the stepped task
+static struct taskScheduler *virtualScheduler;
+static uint64_t scenarioStart;
+static uint64_t nextAdcSample;
+static uint8_t nextAdcChannel;
+static struct vescParser vescRequests;
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+static void checkAdcSampler();
+static uint16_t adcSequence(uint8_t sequence, uint8_t channel, int sample);
+static void checkTextFormat();
+static void oldPageText(char *buffer, float value, uint8_t decimals);
+static void checkProtocol();
+static void refreshCrc(uint8_t *frame, uint8_t size);
+static bool near(float value, float expected, float resolution);
+static void checkVescParser();
+static uint8_t feedVesc(struct vescParser *parser, const uint8_t *bytes, uint16_t size, unsigned long *errors);
+static bool vescReplyMatches(const struct vescMeasurement *values);
+static void checkVescCommands();
+static void countFrameErrors(const uint8_t *frame, const uint8_t *expected, uint8_t size, unsigned long *errors);
+static void checkThrottleCurves();
+static double throttleCurveSource(uint8_t curve, double x);
+static void checkThrottlePosition();
+static int oldThrottlePosition(int hall, const int16_t *calibration);
+static void checkChannelSelection();
+static void checkSettingsTable();
+static void checkSettingsStore();
+static void checkBitmaps();
+static void checkBatteryModel();
+static void checkRecordedRides();
+static bool replayRide(const std::string &name);
+static std::vector<std::string> splitCsv(const char *line);
+static void checkTripLog();
+static void checkTelemetryStream();
+static void checkTaskScheduler();
+static unsigned long virtualClock();
+static void virtualTaskFast();
+static void virtualTaskMedium();
+static void virtualTaskBlocking();
+static void virtualTaskVariable();
+static void virtualTaskStepped();
+static void resetTaskStats(struct taskScheduler *scheduler);
+static void addTaskStats(const char *firmware, const struct taskScheduler *scheduler);
+static void printTaskTotals();
+static void checkPowerModes();
+static void checkBoot();
+static void runUntil(uint64_t end, SimReport *report);
+static SimTripSample tripSample(double time, double ampHours);
+static unsigned long flushTripLog(struct tripLog *log, unsigned long *maxWrites);
+static std::vector<SimTripSample> decodeTripLog();
+static bool endsWith(const std::vector<SimTripSample> &expected, const std::vector<SimTripSample> &decoded);
+static double cellVoltage(const double *curve, double soc);
+static double rideCurrent(double time);
+static bool sameSettings(const struct settingsStore *a, const struct settingsStore *b);
+static void runScenario(const SimScenario *scenario, SimReport *report);
+static void recordAges(SimReport *report);
+static void stepTransmitter();
+static void stepReceiver(SimReport *report);
+static uint16_t hallValue(uint64_t time);
+static void recordPulse(uint64_t time);
+static void answerVesc();
+static void putVescInt(uint8_t *p, int32_t value, uint8_t bytes);
+static void measureLatencies(uint64_t end, SimReport *report);
+static void measurePulses(uint64_t end, SimReport *report);
+static void addMaskedWindow(uint64_t start, uint64_t length);
+static uint64_t edgeDelay(uint64_t time);
+static double percentile(const std::vector<double> &values, double fraction);
+
+
+/**
+ * ****************************************************************************
+ * INTERFACE FUNCTIONS
+ * ****************************************************************************
+ */
+
+void simScheduleInterrupt(SimBoard *board, uint8_t interrupt, uint64_t time) {
+  SimInterrupt pending = { board, interrupt, time };
+  pendingInterrupts.push_back(pending);
+}
+
+// Idle sleep: the timer 0 overflow wakes the MCU every 1024 µs, and so
+// does every ADC conversion while the sampler runs. The transmitter only
+// stops it when asleep.
+void simSleep() {
+  uint64_t wake = (simBoard->timeUs / SIM_TIMER0_US + 1) * SIM_TIMER0_US;
+
+  if (simBoard == &txBoard && transmitter::poweredMode != POWER_SLEEP) {
+    wake = min(wake, max(nextAdcSample, simBoard->timeUs));
+  }
+  simAdvance(wake - simBoard->timeUs);
+}
+
+int main() {
+  simBoardReset(&txBoard, "transmitter");
+  simBoardReset(&rxBoard, "receiver");
+  checkAdcSampler();
+  checkTextFormat();
+  checkProtocol();
+  checkVescParser();
+  checkVescCommands();
+  checkThrottleCurves();
+  checkThrottlePosition();
+  checkChannelSelection();
+  checkSettingsTable();
+  checkSettingsStore();
+  checkBitmaps();
+  checkBatteryModel();
+  checkTripLog();
+  checkTelemetryStream();
+  checkTaskScheduler();
+
+  simLinkReset(scenarios[0].loss, scenarios[0].marginDb, scenarios[0].latencyUs);
+  scenarios[0].noise(simLink.noise);
+  vescParserReset(&vescRequests);
+
+  // Hall centered, battery at about 4 V, trigger released while booting so
+  // the remote does not enter the settings menu.
+  txBoard.pins[A0] = hallSteps[0];
+  txBoard.pins[A1] = 820;
+  txBoard.pins[SIM_TRIGGER_PIN] = HIGH;
+
+  simBoard = &rxBoard;
+  receiver::setup();
+  // A frame starts when the pulse set now has been output, less the pulse.
+  servoStart = rxBoard.timeUs + servoOutputDelay() - servoOutputRead();
+  simBoard = &txBoard;
+  transmitter::setup();
+  checkBoot();
+
+  printf("%-16s %9s %9s %9s %8s %8s %8s %8s %10s %6s %6s %8s %8s %8s %8s %11s %9s %9s %8s %8s\n",
+         "scenario", "packets/s", "attempt%", "packet%",
+         "p50 ms", "p90 ms", "p99 ms", "max ms", "failsafes", "fps", "level", "channel",
+         "rpm age", "volt age", "temp age", "trip stale%", "pulse us", "jitter us", "out avg", "out max");
+
+  for (uint8_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+    SimReport report;
+    runScenario(&scenarios[i], &report);
+
+    double seconds = SIM_SCENARIO_US / 1e6;
+    printf("%-16s %9.1f %9.1f %9.2f", scenarios[i].name,
+           simLink.packets / seconds,
+           simLink.attempts ? 100.0 * simLink.attemptsLost / simLink.attempts : 0.0,
+           simLink.packets ? 100.0 * simLink.packetsLost / simLink.packets : 0.0);
+
+    if (report.latencies.empty()) {
+      printf(" %8s %8s %8s %8s", "-", "-", "-", "-");
+    } else {
+      printf(" %8.2f %8.2f %8.2f %8.2f",
+             percentile(report.latencies, 0.50), percentile(report.latencies, 0.90),
+             percentile(report.latencies, 0.99), report.latencies.back());
+    }
+
+    printf(" %10lu %6.1f %6d %8d", report.failsafes, report.pages / 4 / seconds,
+           transmitter::radioLinkLevel, transmitter::radioChannel);
+
+    for (uint8_t field = 0; field < 3; field++) {
+      if (report.maxAge[field] == TELEMETRY_AGE_UNKNOWN) {
+        printf(" %8s", "-");
+      } else {
+        printf(" %8u", report.maxAge[field]);
+      }
+    }
+    printf(" %11.1f", report.ageChecks ? 100.0 * report.tripStale / report.ageChecks : 0.0);
+
+    // Worst pulse width error on the pin, and its standard deviation.
+    double worst = 0;
+    double squares = 0;
+    for (size_t k = 0; k < report.pulseErrors.size(); k++) {
+      worst = max(worst, fabs(report.pulseErrors[k]));
+      squares += report.pulseErrors[k] * report.pulseErrors[k];
+    }
+    printf(" %9.0f %9.1f", worst, sqrt(squares / max(report.pulseErrors.size(), (size_t)1)));
+
+    if (report.output.count == 0) {
+      printf(" %8s %8s\n", "-", "-");
+    } else {
+      printf(" %8.2f %8.2f\n", loopTimingAverage(&report.output) / 1000.0, report.output.max / 1000.0);
+    }
+  }
+
+  printTaskTotals();
+  checkPowerModes();
+
+  printf("\n%lu failed\n", simFailures);
+  return (simFailures == 0) ? 0 : 1;
+}
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE FUNCTIONS
+ * ****************************************************************************
+ */
+
+// Feed the sampler a sequence on both channels, interleaved as the ISR
+// does, after a prefill with the first sample. After every sample the
+// reading must be the average of the last ADC_SAMPLER_FILTER_LENGTH
+// samples, the prefill counted while the ring buffer fills up. Also show
+// how far it is from the average of 10 analogRead() calls it replaced.
+static void checkAdcSampler() {
+  SimBoard board;
+  SimBoard *previous = simBoard;
+
+  simBoardReset(&board, "adc");
+  simBoard = &board;
+
+  printf("%-14s %8s %11s %14s\n", "adc sequence", "reads", "mismatched", "max from old");
+
+  for (uint8_t sequence = 0; sequence < sizeof(adcSequences) / sizeof(adcSequences[0]); sequence++) {
+    std::vector<uint16_t> history[ADC_SAMPLER_NUM_CHANNELS];
+    unsigned long reads = 0;
+    unsigned long mismatched = 0;
+    int maxFromOld = 0;
+
+    for (uint8_t channel = 0; channel < ADC_SAMPLER_NUM_CHANNELS; channel++) {
+      board.pins[A0 + channel] = adcSequence(sequence, channel, 0);
+      history[channel].assign(ADC_SAMPLER_FILTER_LENGTH, board.pins[A0 + channel]);
+    }
+    adcSamplerBegin();
+
+    for (int sample = 1; sample <= SIM_ADC_SAMPLES; sample++) {
+      for (uint8_t channel = 0; channel < ADC_SAMPLER_NUM_CHANNELS; channel++) {
+        std::vector<uint16_t> *samples = &history[channel];
+        uint16_t value = adcSequence(sequence, channel, sample);
+
+        adcSamplerPush(channel, value);
+        samples->push_back(value);
+
+        unsigned long sum = 0;
+        for (uint8_t i = 1; i <= ADC_SAMPLER_FILTER_LENGTH; i++) {
+          sum += (*samples)[samples->size() - i];
+        }
+        uint16_t reading = adcSamplerRead(channel);
+        mismatched += reading != sum / ADC_SAMPLER_FILTER_LENGTH;
+        reads++;
+
+        // The old reading, once there are 10 samples of the sequence.
+        if (sample >= 10) {
+          long total = 0;
+          for (uint8_t i = 1; i <= 10; i++) {
+            total += (*samples)[samples->size() - i];
+          }
+          maxFromOld = max(maxFromOld, abs((int)reading - (int)(total / 10)));
+        }
+      }
+    }
+
+    printf("%-14s %8lu %11lu %14d\n", adcSequences[sequence], reads, mismatched, maxFromOld);
+    simFailures += mismatched;
+  }
+  printf("\n");
+
+  simBoard = previous;
+}
+
+// Sample of an ADC sampler check sequence. The battery channel gets a
+// different signal than the hall sensor, mixing them up shows.
+static uint16_t adcSequence(uint8_t sequence, uint8_t channel, int sample) {
+  bool hall = (channel == ADC_SAMPLER_HALL);
+
+  switch (sequence) {
+    case 0:
+      // From an empty (zeroed) ring buffer.
+      if (sample == 0) {
+        return 0;
+      }
+      return hall ? 1023 : 600 + sample % 7;
+    case 1:
+      return hall ? 504 + simRandom() * 17 : 816 + simRandom() * 9;
+    case 2:
+      return hall ? (long)sample * 1023 / SIM_ADC_SAMPLES : 1023 - (long)sample * 1023 / SIM_ADC_SAMPLES;
+    default:
+      return (sample < SIM_ADC_SAMPLES / 2) == hall ? 100 : 900;
+  }
+}
+
+// Compare the formatters with expected texts, including the widest
+// values and padding past the maximum width. Then compare the settings
+// and page values on the display with the String code they replaced, and
+// time both.
+static void checkTextFormat() {
+  char buffer[TEXT_FORMAT_MAX_DIGITS * 2 + 2];
+  char old[TEXT_FORMAT_MAX_DIGITS * 2 + 2];
+  unsigned long cases = 0;
+  unsigned long failed = 0;
+
+  for (uint8_t i = 0; i < sizeof(unsignedCases) / sizeof(unsignedCases[0]); i++) {
+    char *end = formatUnsigned(buffer, unsignedCases[i].value, unsignedCases[i].minDigits);
+    failed += strcmp(buffer, unsignedCases[i].text) != 0 || end != buffer + strlen(buffer);
+    cases++;
+  }
+  for (uint8_t i = 0; i < sizeof(fixedCases) / sizeof(fixedCases[0]); i++) {
+    const SimFormatCase *test = &fixedCases[i];
+    char *end = formatFixed(buffer, test->value, test->decimals, test->minDigits);
+    failed += strcmp(buffer, test->text) != 0 || end != buffer + strlen(buffer);
+    cases++;
+  }
+  for (uint8_t i = 0; i < sizeof(pageCases) / sizeof(pageCases[0]); i++) {
+    const SimPageCase *test = &pageCases[i];
+    formatFixed(buffer, formatRound(test->value, test->decimals), test->decimals, 2);
+    failed += strcmp(buffer, test->text) != 0;
+    cases++;
+  }
+
+  // Chained, as the settings screen builds "<value><unit>".
+  formatString(formatString(formatUnsigned(buffer, 83, 1), ""), "mm");
+  failed += strcmp(buffer, "83mm") != 0;
+  failed += formatScale(0) != 1 || formatScale(9) != 1000000000UL || formatScale(12) != 1000000000UL;
+  cases += 2;
+
+  // Setting numbers and every value of every setting.
+  unsigned long settingTexts = 0;
+  unsigned long settingsDiffer = 0;
+
+  for (uint8_t i = 0; i < SETTINGS_COUNT; i++) {
+    struct settingDescriptor descriptor;
+    settingsTableDescriptor(i, &descriptor);
+
+    String number = (String)(i + 1);
+    number.toCharArray(old, sizeof(old));
+    formatUnsigned(buffer, i + 1, 1);
+    settingsDiffer += strcmp(buffer, old) != 0;
+    settingTexts++;
+
+    for (int value = descriptor.minValue; value <= descriptor.maxValue; value++) {
+      String text = (String)value + "" + descriptor.unit;
+      text.toCharArray(old, text.length() + 1);
+      formatString(formatUnsigned(buffer, value, 1), descriptor.unit);
+      settingsDiffer += strcmp(buffer, old) != 0;
+      settingTexts++;
+    }
+  }
+
+  // Page values, 0.01 apart, both signs, with one and two decimals. The
+  // old code split the value in float and lost zeros after the point.
+  unsigned long pageSame = 0;
+  unsigned long pageRounded = 0;
+  unsigned long pageWrong = 0;
+  unsigned long pageNegative = 0;
+
+  for (int step = -SIM_FORMAT_PAGE_VALUES; step <= SIM_FORMAT_PAGE_VALUES; step++) {
+    for (uint8_t decimals = 1; decimals <= 2; decimals++) {
+      float value = step / 100.0f;
+      char truncated[sizeof(buffer)];
+
+      formatFixed(buffer, formatRound(value, decimals), decimals, 2);
+      formatFixed(truncated, fabs(value) * formatScale(decimals), decimals, 2);
+      oldPageText(old, value, decimals);
+
+      if (strcmp(buffer, old) == 0) {
+        pageSame++;
+      } else if (value < 0.0f) {
+        pageNegative++;
+      } else if (strcmp(truncated, old) == 0) {
+        pageRounded++;
+      } else {
+        pageWrong++;
+      }
+    }
+  }
+
+  // Time the speed page both ways.
+  volatile char sink = 0;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int round = 0; round < SIM_FORMAT_ROUNDS; round++) {
+    for (int step = 0; step <= SIM_FORMAT_PAGE_VALUES; step++) {
+      oldPageText(old, step / 100.0f, 1);
+      sink = sink + old[0];
+    }
+  }
+  std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+  for (int round = 0; round < SIM_FORMAT_ROUNDS; round++) {
+    for (int step = 0; step <= SIM_FORMAT_PAGE_VALUES; step++) {
+      formatFixed(buffer, formatRound(step / 100.0f, 1), 1, 2);
+      sink = sink + buffer[0];
+    }
+  }
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+  double values = (double)SIM_FORMAT_ROUNDS * (SIM_FORMAT_PAGE_VALUES + 1);
+  double stringNs = std::chrono::duration<double, std::nano>(middle - start).count() / values;
+  double formatNs = std::chrono::duration<double, std::nano>(end - middle).count() / values;
+
+  printf("text format: %lu cases, %lu failed; %lu setting texts, %lu differ from String\n",
+         cases, failed, settingTexts, settingsDiffer);
+  simFailures += failed + settingsDiffer;
+  printf("  page values against the old String rendering: %lu same, %lu rounded where it truncated, "
+         "%lu it got wrong (zeros after the point dropped, last digit low), %lu negative it got wrong\n",
+         pageSame, pageRounded, pageWrong, pageNegative);
+  printf("  host time per page value: %.0f ns with String, %.0f ns formatted\n\n", stringNs, formatNs);
+}
+
+// The page value as the display drew it with String: integer part with a
+// leading zero, then the thousandths cut to the decimals shown.
+static void oldPageText(char *buffer, float value, uint8_t decimals) {
+  char point[10];
+  int first = fabs(floor(value));
+  int last = value * pow(10, 3) - first * pow(10, 3);
+
+  String number = (first <= 9) ? "0" + (String)first : (String)first;
+  String fraction = "." + (String)last;
+
+  number.toCharArray(buffer, 10);
+  fraction.toCharArray(point, decimals + 2);
+  strcat(buffer, point);
+}
+
+// Encode and decode every message type, at the limits of each field and
+// past them, where the fields saturate. Then damage valid frames: another
+// version, a bad CRC, a wrong size, another type, and values out of range
+// with the CRC made to fit. All must be rejected.
+static void checkProtocol() {
+  uint8_t frame[PROTOCOL_MAX_FRAME_SIZE + 1];
+  uint8_t size;
+  unsigned long checks = 0;
+  unsigned long failed = 0;
+
+  // Throttle, the keepalive rounded up to 10 ms and saturated at 2550 ms.
+  static const uint16_t throttles[] = { 0, PROTOCOL_THROTTLE_NEUTRAL, PROTOCOL_THROTTLE_MAX };
+  static const uint16_t keepalives[][2] = { { 0, 0 }, { 10, 10 }, { 15, 20 }, { 2550, 2550 }, { 5000, 2550 } };
+
+  for (uint8_t t = 0; t < sizeof(throttles) / sizeof(throttles[0]); t++) {
+    for (uint8_t k = 0; k < sizeof(keepalives) / sizeof(keepalives[0]); k++) {
+      uint16_t throttle;
+      uint16_t keepalive;
+
+      size = protocolEncodeThrottle(frame, throttles[t], keepalives[k][0]);
+      failed += size != PROTOCOL_THROTTLE_FRAME_SIZE || protocolMessageType(frame, size) != PROTOCOL_MSG_THROTTLE ||
+                !protocolDecodeThrottle(frame, size, &throttle, &keepalive) ||
+                throttle != throttles[t] || keepalive != keepalives[k][1];
+      checks++;
+    }
+  }
+
+  // Telemetry, every group, in range and saturated.
+  struct vescValues sent;
+  struct vescValues limits;
+
+  memset(&sent, 0, sizeof(sent));
+  sent.rpm = -123456;
+  sent.inputCurrent = 12.34;
+  sent.motorCurrent = -56.78;
+  sent.inpVoltage = 48.91;
+  sent.dutyCycle = -0.512;
+  sent.fault = 3;
+  sent.tachometerAbs = 0xFFFFFFFF;
+  sent.ampHours = 4.56;
+  sent.ampHoursCharged = 0.12;
+  sent.tempFet = 41.3;
+  sent.tempMotor = -12.5;
+
+  memset(&limits, 0, sizeof(limits));
+  limits.rpm = 0x7FFFFF + 1000;
+  limits.inputCurrent = 400.0;
+  limits.motorCurrent = -400.0;
+  limits.inpVoltage = 700.0;
+  limits.dutyCycle = 40.0;
+  limits.ampHours = -1.0;
+  limits.ampHoursCharged = 1000.0;
+  limits.tempFet = -4000.0;
+  limits.tempMotor = 4000.0;
+
+  for (uint8_t group = 0; group < PROTOCOL_TELEMETRY_GROUPS; group++) {
+    struct vescValues received;
+    uint8_t decodedGroup;
+    uint8_t measurement;
+
+    // Fields of other groups are left as they were.
+    memset(&received, 0, sizeof(received));
+    received.tachometerAbs = 7;
+    received.fault = 9;
+    size = protocolEncodeTelemetry(frame, &sent, group, 17);
+    bool valid = size == PROTOCOL_TELEMETRY_FRAME_SIZE &&
+                 protocolDecodeTelemetry(frame, size, &received, &decodedGroup, &measurement) &&
+                 decodedGroup == group && measurement == 1 &&
+                 received.rpm == sent.rpm && near(received.inputCurrent, sent.inputCurrent, 0.01) &&
+                 near(received.motorCurrent, sent.motorCurrent, 0.01);
+
+    switch (group) {
+      case PROTOCOL_GROUP_POWER:
+        valid = valid && near(received.inpVoltage, sent.inpVoltage, 0.01) &&
+                near(received.dutyCycle, sent.dutyCycle, 0.001) && received.fault == sent.fault &&
+                received.tachometerAbs == 7;
+        break;
+      case PROTOCOL_GROUP_DISTANCE:
+        valid = valid && received.tachometerAbs == sent.tachometerAbs && received.fault == 9;
+        break;
+      case PROTOCOL_GROUP_ENERGY:
+        valid = valid && near(received.ampHours, sent.ampHours, 0.01) &&
+                near(received.ampHoursCharged, sent.ampHoursCharged, 0.01) && received.tachometerAbs == 7;
+        break;
+      default:
+        valid = valid && near(received.tempFet, sent.tempFet, 0.1) &&
+                near(received.tempMotor, sent.tempMotor, 0.1) && received.tachometerAbs == 7;
+        break;
+    }
+    failed += !valid;
+    checks++;
+
+    size = protocolEncodeTelemetry(frame, &limits, group, 0);
+    valid = protocolDecodeTelemetry(frame, size, &received, &decodedGroup, &measurement) &&
+            received.rpm == 0x7FFFFF && near(received.inputCurrent, 327.67, 0.01) &&
+            near(received.motorCurrent, -327.68, 0.01);
+
+    switch (group) {
+      case PROTOCOL_GROUP_POWER:
+        valid = valid && near(received.inpVoltage, 655.35, 0.01) && near(received.dutyCycle, 32.767, 0.001);
+        break;
+      case PROTOCOL_GROUP_ENERGY:
+        valid = valid && received.ampHours == 0.0 && near(received.ampHoursCharged, 655.35, 0.01);
+        break;
+      case PROTOCOL_GROUP_THERMAL:
+        valid = valid && near(received.tempFet, -3276.8, 0.1) && near(received.tempMotor, 3276.7, 0.1);
+        break;
+    }
+    failed += !valid;
+    checks++;
+  }
+
+  limits.rpm = -0x800000 - 1000;
+  size = protocolEncodeTelemetry(frame, &limits, PROTOCOL_GROUP_POWER, 0);
+  {
+    struct vescValues received;
+    uint8_t group;
+    uint8_t measurement;
+    failed += !protocolDecodeTelemetry(frame, size, &received, &group, &measurement) || received.rpm != -0x800000;
+    checks++;
+  }
+
+  // Link, every data rate at the ends of the channel range.
+  static const uint8_t channels[] = { 0, PROTOCOL_RENDEZVOUS_CHANNEL, PROTOCOL_MAX_CHANNEL };
+
+  for (uint8_t rate = PROTOCOL_RATE_1MBPS; rate <= PROTOCOL_RATE_250KBPS; rate++) {
+    for (uint8_t c = 0; c < sizeof(channels); c++) {
+      uint8_t decodedRate;
+      uint8_t channel;
+
+      size = protocolEncodeLink(frame, rate, channels[c]);
+      failed += size != PROTOCOL_LINK_FRAME_SIZE || protocolMessageType(frame, size) != PROTOCOL_MSG_LINK ||
+                !protocolDecodeLink(frame, size, &decodedRate, &channel) ||
+                decodedRate != rate || channel != channels[c];
+      checks++;
+    }
+  }
+
+  // Rejected frames.
+  unsigned long rejects = 0;
+  unsigned long accepted = 0;
+  uint16_t throttle;
+  uint16_t keepalive;
+  uint8_t rate;
+  uint8_t channel;
+  struct vescValues received;
+  uint8_t group;
+  uint8_t measurement;
+
+  for (uint8_t damage = 0; damage < 4; damage++) {
+    // Another version, a flipped CRC bit, one byte short and one too many.
+    uint8_t frames[3][PROTOCOL_MAX_FRAME_SIZE + 1];
+    uint8_t sizes[3];
+
+    sizes[0] = protocolEncodeThrottle(frames[0], PROTOCOL_THROTTLE_NEUTRAL, 100);
+    sizes[1] = protocolEncodeTelemetry(frames[1], &sent, PROTOCOL_GROUP_POWER, 0);
+    sizes[2] = protocolEncodeLink(frames[2], PROTOCOL_RATE_2MBPS, 40);
+
+    for (uint8_t type = 0; type < 3; type++) {
+      uint8_t *f = frames[type];
+
+      switch (damage) {
+        case 0:
+          f[0] = ((PROTOCOL_VERSION - 1) << 4) | (f[0] & 0x0F);
+          refreshCrc(f, sizes[type]);
+          break;
+        case 1:
+          f[sizes[type] - 1] ^= 0x01;
+          break;
+        case 2:
+          sizes[type]--;
+          refreshCrc(f, sizes[type]);
+          break;
+        default:
+          f[sizes[type] - 1] = 0;
+          sizes[type]++;
+          refreshCrc(f, sizes[type]);
+          break;
+      }
+    }
+
+    accepted += protocolDecodeThrottle(frames[0], sizes[0], &throttle, &keepalive);
+    accepted += protocolDecodeTelemetry(frames[1], sizes[1], &received, &group, &measurement);
+    accepted += protocolDecodeLink(frames[2], sizes[2], &rate, &channel);
+    rejects += 3;
+  }
+
+  // Another type of frame in the right size, and values out of range.
+  size = protocolEncodeLink(frame, PROTOCOL_RATE_1MBPS, 40);
+  accepted += protocolDecodeThrottle(frame, size, &throttle, &keepalive);
+  size = protocolEncodeThrottle(frame, PROTOCOL_THROTTLE_MAX + 1, 100);
+  accepted += protocolDecodeThrottle(frame, size, &throttle, &keepalive);
+  size = protocolEncodeTelemetry(frame, &sent, PROTOCOL_GROUP_POWER, 0);
+  frame[1] = (PROTOCOL_TELEMETRY_GROUPS << 4);
+  refreshCrc(frame, size);
+  accepted += protocolDecodeTelemetry(frame, size, &received, &group, &measurement);
+  size = protocolEncodeLink(frame, PROTOCOL_RATE_250KBPS + 1, 40);
+  accepted += protocolDecodeLink(frame, size, &rate, &channel);
+  size = protocolEncodeLink(frame, PROTOCOL_RATE_1MBPS, PROTOCOL_MAX_CHANNEL + 1);
+  accepted += protocolDecodeLink(frame, size, &rate, &channel);
+  rejects += 5;
+
+  printf("protocol: %lu round trips, %lu failed; %lu damaged frames, %lu accepted\n",
+         checks, failed, rejects, accepted);
+  simFailures += failed + accepted;
+  printf("  frame sizes: throttle %d (was %d), telemetry %d (was %d, 4 fields), link %d\n\n",
+         PROTOCOL_THROTTLE_FRAME_SIZE, (int)sizeof(SimOldThrottle),
+         PROTOCOL_TELEMETRY_FRAME_SIZE, (int)sizeof(SimOldVescValues), PROTOCOL_LINK_FRAME_SIZE);
+}
+
+// Make the CRC fit a frame that was changed.
+static void refreshCrc(uint8_t *frame, uint8_t size) {
+  frame[size - 1] = protocolCrc8(frame, size - 1);
+}
+
+static bool near(float value, float expected, float resolution) {
+  return fabs(value - expected) <= resolution / 2;
+}
+
+// Feed the recorded VESC reply to the parser one byte at a time, and to
+// vescAsyncUpdate() in random chunks. Then damage it, and put noise and cut
+// off replies in front of it, to see that the parser finds the next one.
+static void checkVescParser() {
+  SimBoard board;
+  SimBoard *previous = simBoard;
+  struct vescParser parser;
+  struct vescMeasurement values;
+  uint8_t packet[sizeof(vescReply) + 1];
+  unsigned long decoded = 0;
+  unsigned long failed = 0;
+  unsigned long damaged = 0;
+  unsigned long accepted = 0;
+  unsigned long errors = 0;
+  unsigned long resynced[4] = { 0, 0, 0, 0 };
+  unsigned long lost = 0;
+
+  simBoardReset(&board, "vesc");
+  simBoard = &board;
+
+  // One byte at a time: complete on the end byte and nowhere before it.
+  vescParserReset(&parser);
+  for (uint8_t i = 0; i < sizeof(vescReply); i++) {
+    uint8_t result = vescParserFeed(&parser, vescReply[i]);
+    bool last = (i == sizeof(vescReply) - 1);
+
+    if (result != (last ? VESC_PARSER_COMPLETE : VESC_PARSER_BUSY)) {
+      failed++;
+    }
+  }
+  decoded++;
+  if (!vescDecodeValues(parser.payload, parser.length, &values) || !vescReplyMatches(&values)) {
+    failed++;
+  }
+
+  // The same payload framed with a two byte length.
+  packet[0] = 3;
+  packet[1] = 0;
+  memcpy(&packet[2], &vescReply[1], sizeof(vescReply) - 1);
+  vescParserReset(&parser);
+  decoded++;
+  if (feedVesc(&parser, packet, sizeof(packet), &errors) != 1 || errors != 0) {
+    failed++;
+  }
+
+  // Random chunks off the serial port, as many calls as it takes.
+  for (int trial = 0; trial < 200; trial++) {
+    bool done = false;
+    uint8_t sent = 0;
+
+    board.serialRx.clear();
+    vescAsyncRequest();
+    board.serialTx.clear();
+
+    while (sent < sizeof(vescReply) || !board.serialRx.empty()) {
+      uint8_t chunk = std::min<int>(1 + simRandom() * 24, sizeof(vescReply) - sent);
+
+      for (uint8_t i = 0; i < chunk; i++) {
+        SimSerialByte byte = { 0, vescReply[sent++] };
+        board.serialRx.push_back(byte);
+      }
+      if (vescAsyncUpdate(&values)) {
+        if (done || sent < sizeof(vescReply) || !board.serialRx.empty() || !vescReplyMatches(&values)) {
+          failed++;
+        }
+        done = true;
+      }
+    }
+    decoded++;
+    failed += !done || vescAsyncPending();
+  }
+
+  // Each payload and CRC byte flipped, the end byte wrong, and lengths that
+  // are zero, too long, or one off. The intact reply must decode right after.
+  for (uint8_t i = 0; i < sizeof(vescReply) + 3; i++) {
+    uint8_t size = sizeof(vescReply);
+
+    memcpy(packet, vescReply, size);
+    switch ((int)i - (size - 3)) {
+      case 0: packet[size - 1] = 0x00; break;
+      case 1: packet[1] = 0; break;
+      case 2: packet[0] = 3; packet[1] = 1; break; // 256 + 59 bytes
+      case 3: packet[1]--; break;
+      case 4: packet[1]++; break;
+      case 5: packet[1] = VESC_PARSER_MAX_PAYLOAD + 1; break;
+      default: packet[2 + i] ^= 0x10; break;
+    }
+
+    vescParserReset(&parser);
+    damaged++;
+    accepted += feedVesc(&parser, packet, size, &errors);
+
+    // A length one too long eats the first byte of the next reply.
+    decoded++;
+    if (feedVesc(&parser, vescReply, sizeof(vescReply), &errors) +
+        feedVesc(&parser, vescReply, sizeof(vescReply), &errors) == 0) {
+      failed++;
+    }
+  }
+
+  // A reply one byte short of the values frames fine, but does not decode.
+  vescEncodePacket(packet, &vescReply[2], 53);
+  vescParserReset(&parser);
+  damaged++;
+  accepted += feedVesc(&parser, packet, 53 + 5, &errors);
+
+  // Noise, or the tail of a reply cut off mid way, then the reply over and
+  // over. Count which copy is the first to decode.
+  for (int trial = 0; trial < 1000; trial++) {
+    uint8_t noise = 1 + simRandom() * 40;
+    uint8_t copy;
+
+    vescParserReset(&parser);
+    for (uint8_t i = 0; i < noise; i++) {
+      uint8_t byte = (trial & 1) ? vescReply[sizeof(vescReply) - noise + i] : simRandom() * 256;
+      vescParserFeed(&parser, byte);
+    }
+    for (copy = 0; copy < 4; copy++) {
+      if (feedVesc(&parser, vescReply, sizeof(vescReply), &errors) > 0) {
+        break;
+      }
+    }
+    if (copy < 4) {
+      resynced[copy]++;
+    } else {
+      lost++;
+    }
+  }
+  failed += lost;
+
+  simBoard = previous;
+
+  printf("vesc parser: %lu replies decoded, %lu failed; %lu damaged, %lu accepted\n",
+         decoded, failed, damaged, accepted);
+  simFailures += failed + accepted;
+  printf("  after noise or a cut off reply, decoded the 1st reply %lu, 2nd %lu, 3rd %lu, 4th %lu, none %lu times\n\n",
+         resynced[0], resynced[1], resynced[2], resynced[3], lost);
+}
+
+// Feed bytes to a parser. Returns how many replies in them decoded to the
+// recorded values, and counts parser errors.
+static uint8_t feedVesc(struct vescParser *parser, const uint8_t *bytes, uint16_t size, unsigned long *errors) {
+  struct vescMeasurement values;
+  uint8_t matches = 0;
+
+  for (uint16_t i = 0; i < size; i++) {
+    switch (vescParserFeed(parser, bytes[i])) {
+      case VESC_PARSER_COMPLETE:
+        if (vescDecodeValues(parser->payload, parser->length, &values) && vescReplyMatches(&values)) {
+          matches++;
+        }
+        break;
+      case VESC_PARSER_ERROR:
+        (*errors)++;
+        break;
+      default:
+        break;
+    }
+  }
+
+  return matches;
+}
+
+static bool vescReplyMatches(const struct vescMeasurement *values) {
+  const struct vescMeasurement *expected = &vescReplyValues;
+
+  return near(values->tempFet, expected->tempFet, 0.1) &&
+         near(values->tempMotor, expected->tempMotor, 0.1) &&
+         near(values->motorCurrent, expected->motorCurrent, 0.01) &&
+         near(values->inputCurrent, expected->inputCurrent, 0.01) &&
+         near(values->dutyCycle, expected->dutyCycle, 0.001) &&
+         values->rpm == expected->rpm &&
+         near(values->inpVoltage, expected->inpVoltage, 0.1) &&
+         near(values->ampHours, expected->ampHours, 0.0001) &&
+         near(values->ampHoursCharged, expected->ampHoursCharged, 0.0001) &&
+         values->tachometer == expected->tachometer &&
+         values->tachometerAbs == expected->tachometerAbs &&
+         values->fault == expected->fault;
+}
+
+// Compare the command frames the receiver sends against the VESC format
+// byte for byte, both as encoded and as written to the serial port, and
+// parse them back.
+static void checkVescCommands() {
+  static const char *fields[] = { "start", "length", "payload", "crc", "end" };
+  SimBoard board;
+  SimBoard *previous = simBoard;
+  struct vescParser parser;
+  uint8_t packet[VESC_COMMAND_PACKET_SIZE];
+  unsigned long errors[5] = { 0, 0, 0, 0, 0 };
+  unsigned long failed = 0;
+  const uint8_t count = sizeof(vescFrames) / sizeof(vescFrames[0]);
+
+  simBoardReset(&board, "vesc");
+  simBoard = &board;
+
+  for (uint8_t i = 0; i < count; i++) {
+    const SimVescFrame *expected = &vescFrames[i];
+    uint8_t size = vescEncodeCommand(packet, expected->command, expected->value);
+    unsigned long before = errors[0] + errors[1] + errors[2] + errors[3] + errors[4];
+
+    failed += (size != VESC_COMMAND_PACKET_SIZE);
+    countFrameErrors(packet, expected->frame, VESC_COMMAND_PACKET_SIZE, errors);
+
+    board.serialTx.clear();
+    failed += !vescAsyncCommand(expected->command, expected->value);
+    failed += (board.serialTx.size() != VESC_COMMAND_PACKET_SIZE);
+    for (uint8_t b = 0; b < board.serialTx.size() && b < VESC_COMMAND_PACKET_SIZE; b++) {
+      packet[b] = board.serialTx[b];
+    }
+    countFrameErrors(packet, expected->frame, VESC_COMMAND_PACKET_SIZE, errors);
+
+    uint8_t result = VESC_PARSER_BUSY;
+    vescParserReset(&parser);
+    for (uint8_t b = 0; b < VESC_COMMAND_PACKET_SIZE; b++) {
+      result = vescParserFeed(&parser, expected->frame[b]);
+    }
+    failed += (result != VESC_PARSER_COMPLETE || memcmp(parser.payload, &expected->frame[2], 5) != 0);
+
+    if (errors[0] + errors[1] + errors[2] + errors[3] + errors[4] != before) {
+      printf("  %s: frame differs\n", expected->name);
+    }
+  }
+
+  board.serialTx.clear();
+  vescAsyncRequest();
+  failed += (board.serialTx.size() != sizeof(vescValuesRequest));
+  for (uint8_t b = 0; b < board.serialTx.size() && b < sizeof(vescValuesRequest); b++) {
+    packet[b] = board.serialTx[b];
+  }
+  countFrameErrors(packet, vescValuesRequest, sizeof(vescValuesRequest), errors);
+
+  // Answer it, leaving no request pending for the scenarios.
+  struct vescMeasurement values;
+  for (uint8_t b = 0; b < sizeof(vescReply); b++) {
+    SimSerialByte byte = { 0, vescReply[b] };
+    board.serialRx.push_back(byte);
+  }
+  while (!board.serialRx.empty()) {
+    vescAsyncUpdate(&values);
+  }
+  failed += vescAsyncPending();
+  simBoard = previous;
+
+  printf("vesc commands: %d frames and the values request, %lu failed; wrong bytes:", count, failed);
+  for (uint8_t f = 0; f < 5; f++) {
+    printf(" %s %lu%s", fields[f], errors[f], f < 4 ? "," : "\n\n");
+  }
+  simFailures += failed;
+}
+
+// Count bytes that differ from the expected frame, by the field they are in.
+static void countFrameErrors(const uint8_t *frame, const uint8_t *expected, uint8_t size, unsigned long *errors) {
+  for (uint8_t i = 0; i < size; i++) {
+    uint8_t field = (i == 0) ? 0 : (i == 1) ? 1 : (i < size - 3) ? 2 : (i < size - 1) ? 3 : 4;
+
+    errors[field] += (frame[i] != expected[i]);
+  }
+}
+
+// Apply each throttle curve to every travel value. It must rise, run from
+// 0 to full range, and stay within a unit of the formula it was built from
+// between the table points (half a unit for rounding the entries, less
+// than one for truncating the interpolation).
+static void checkThrottleCurves() {
+  static const char *names[THROTTLE_CURVE_COUNT] = { "linear", "exponential", "custom" };
+  unsigned long failed = 0;
+
+  printf("throttle curves: %d travel values, %d table points\n",
+         THROTTLE_CURVE_RANGE + 1, THROTTLE_CURVE_TABLE_SIZE);
+
+  for (uint8_t curve = 0; curve < THROTTLE_CURVE_COUNT; curve++) {
+    unsigned long falling = 0;
+    double maxError = 0;
+    double sumError = 0;
+    uint16_t previous = 0;
+    uint16_t first = throttleCurveApply(curve, 0);
+    uint16_t last = throttleCurveApply(curve, THROTTLE_CURVE_RANGE);
+
+    for (uint16_t travel = 0; travel <= THROTTLE_CURVE_RANGE; travel++) {
+      uint16_t output = throttleCurveApply(curve, travel);
+      double error = fabs(output - throttleCurveSource(curve, (double)travel / THROTTLE_CURVE_RANGE) * THROTTLE_CURVE_RANGE);
+
+      falling += (output < previous);
+      maxError = max(maxError, error);
+      sumError += error;
+      previous = output;
+    }
+
+    // Travel past the end stays at full range.
+    bool clamped = (throttleCurveApply(curve, THROTTLE_CURVE_RANGE + 100) == THROTTLE_CURVE_RANGE);
+    bool ok = (falling == 0 && first == 0 && last == THROTTLE_CURVE_RANGE && clamped && maxError < 1.5);
+
+    failed += !ok;
+    printf("  %-12s %s: ends %u-%u, %lu falling steps, formula error mean %.2f max %.2f\n",
+           names[curve], ok ? "ok" : "FAILED", first, last, falling,
+           sumError / (THROTTLE_CURVE_RANGE + 1), maxError);
+  }
+
+  // Curve numbers out of range fall back to linear.
+  failed += (throttleCurveApply(THROTTLE_CURVE_COUNT, 100) != throttleCurveApply(THROTTLE_CURVE_LINEAR, 100));
+
+  printf("  %lu failed\n\n", failed);
+  simFailures += failed;
+}
+
+// A curve at travel x (0.0 - 1.0), computed as in ThrottleCurve.cpp.
+static double throttleCurveSource(uint8_t curve, double x) {
+  const uint8_t points = sizeof(customCurvePoints) / sizeof(customCurvePoints[0]);
+
+  switch (curve) {
+    case THROTTLE_CURVE_EXPONENTIAL:
+      return (1.0 - THROTTLE_CURVE_EXPO / 100.0) * x + (THROTTLE_CURVE_EXPO / 100.0) * x * x * x;
+
+    case THROTTLE_CURVE_CUSTOM:
+      for (uint8_t n = 0; n + 1 < points; n++) {
+        const double *a = customCurvePoints[n];
+        const double *b = customCurvePoints[n + 1];
+
+        if (x * 1000 <= b[0] || n + 2 == points) {
+          return (a[1] + (x * 1000 - a[0]) * (b[1] - a[1]) / (b[0] - a[0])) / 1000;
+        }
+      }
+      return x;
+
+    default:
+      return x;
+  }
+}
+
+// Put every hall reading through calculateThrottlePosition() on a few
+// calibrations, with linear curves. The throttle must run from 0 at the
+// min calibration through neutral at the center to full at the max, never
+// fall, stay there outside the calibrated range, and be neutral exactly
+// while the travel is inside the deadband. Also compare with the 8-bit
+// code, scaled up: outputs and deadband width in hall counts.
+static void checkThrottlePosition() {
+  struct settings saved = transmitter::remoteSettings;
+  const int deadband = transmitter::hallCenterMargin;
+  unsigned long failed = 0;
+
+  transmitter::remoteSettings.throttleCurve = THROTTLE_CURVE_LINEAR;
+  transmitter::remoteSettings.brakeCurve = THROTTLE_CURVE_LINEAR;
+
+  printf("%-16s %8s %8s %10s %10s %13s %13s\n",
+         "hall calibration", "ends", "falling", "max error", "deadband", "old deadband", "max from old");
+
+  for (uint8_t c = 0; c < sizeof(hallCalibrations) / sizeof(hallCalibrations[0]); c++) {
+    const int16_t *calibration = hallCalibrations[c];
+    const int low = calibration[0];
+    const int center = calibration[1];
+    const int high = calibration[2];
+    int previous = 0;
+    unsigned long falling = 0;
+    unsigned long wrong = 0;
+    int neutral = 0;
+    int oldNeutral = 0;
+    double maxError = 0;
+    int maxFromOld = 0;
+    int ends[3] = { -1, -1, -1 };
+
+    transmitter::remoteSettings.minHallValue = low;
+    transmitter::remoteSettings.centerHallValue = center;
+    transmitter::remoteSettings.maxHallValue = high;
+
+    for (int hall = 0; hall <= 1023; hall++) {
+      for (uint8_t i = 0; i < ADC_SAMPLER_FILTER_LENGTH; i++) {
+        adcSamplerPush(ADC_SAMPLER_HALL, hall);
+      }
+      transmitter::calculateThrottlePosition();
+      int throttle = transmitter::throttle;
+
+      // Travel as a fraction of the side, clamped at the calibration.
+      double travel = (hall >= center) ? (double)(hall - center) / (high - center)
+                                       : (double)(center - hall) / (center - low);
+      travel = min(travel, 1.0);
+
+      double expected;
+      if (travel * THROTTLE_CURVE_RANGE < deadband) {
+        expected = PROTOCOL_THROTTLE_NEUTRAL;
+        wrong += (throttle != PROTOCOL_THROTTLE_NEUTRAL);
+        neutral++;
+      } else if (hall >= center) {
+        expected = PROTOCOL_THROTTLE_NEUTRAL + travel * (PROTOCOL_THROTTLE_MAX - PROTOCOL_THROTTLE_NEUTRAL);
+      } else {
+        expected = PROTOCOL_THROTTLE_NEUTRAL - travel * PROTOCOL_THROTTLE_NEUTRAL;
+      }
+      // Truncated twice: mapping to travel, and scaling to the throttle.
+      maxError = max(maxError, fabs(throttle - expected));
+
+      int old = oldThrottlePosition(hall, calibration);
+      oldNeutral += (old == 127);
+      maxFromOld = max(maxFromOld, abs(throttle - old * PROTOCOL_THROTTLE_MAX / 255));
+
+      falling += (throttle < previous);
+      previous = throttle;
+
+      if (hall == low) {
+        ends[0] = throttle;
+      } else if (hall == center) {
+        ends[1] = throttle;
+      } else if (hall == high) {
+        ends[2] = throttle;
+      }
+      if ((hall < low && throttle != 0) || (hall > high && throttle != PROTOCOL_THROTTLE_MAX)) {
+        wrong++;
+      }
+    }
+
+    bool ok = (ends[0] == 0 && ends[1] == PROTOCOL_THROTTLE_NEUTRAL && ends[2] == PROTOCOL_THROTTLE_MAX &&
+               falling == 0 && wrong == 0 && maxError < 2);
+    char name[24];
+
+    failed += !ok;
+    snprintf(name, sizeof(name), "%d/%d/%d", low, center, high);
+    printf("%-16s %3d-%-4d %7lu %10.2f %10d %13d %13d%s\n",
+           name, ends[0], ends[2], falling, maxError, neutral, oldNeutral, maxFromOld, ok ? "" : "  FAILED");
+  }
+
+  transmitter::remoteSettings = saved;
+  printf("  %lu failed; deadband %d of %d travel, widths in hall counts\n\n", failed, deadband, THROTTLE_CURVE_RANGE);
+  simFailures += failed;
+}
+
+// calculateThrottlePosition() before the 10-bit throttle, 0-255 with 127
+// as neutral and a deadband of 4.
+static int oldThrottlePosition(int hall, const int16_t *calibration) {
+  int throttle;
+
+  if (hall >= calibration[1]) {
+    throttle = constrain(map(hall, calibration[1], calibration[2], 127, 255), 127, 255);
+  } else {
+    throttle = constrain(map(hall, calibration[0], calibration[1], 0, 127), 0, 127);
+  }
+  if (abs(throttle - 127) < 4) {
+    throttle = 127;
+  }
+  return throttle;
+}
+
+// Run the channel selection on synthetic noise maps, and show how quiet
+// the picked channel and its neighbours are.
+static void checkChannelSelection() {
+  printf("%-22s %8s %8s %12s\n", "noise map", "channel", "score", "max noise");
+
+  for (uint8_t i = 0; i < sizeof(noiseCases) / sizeof(noiseCases[0]); i++) {
+    double noise[SIM_RADIO_CHANNELS] = { 0 };
+    struct channelScan scan;
+
+    noiseCases[i].noise(noise);
+    channelScanBegin(&scan);
+    for (uint8_t sweep = 0; sweep < CHANNEL_SCAN_SWEEPS; sweep++) {
+      for (uint8_t channel = CHANNEL_SCAN_FIRST; channel <= CHANNEL_SCAN_LAST; channel++) {
+        channelScanRecord(&scan, channel, simRandom() < noise[channel]);
+      }
+    }
+
+    uint8_t channel = channelScanSelect(&scan);
+    double worst = 0.0;
+    for (int c = channel - CHANNEL_SCAN_SPREAD; c <= channel + CHANNEL_SCAN_SPREAD; c++) {
+      worst = max(worst, noise[c]);
+    }
+
+    printf("%-22s %8d %8d %12.2f\n", noiseCases[i].name, channel, channelScanScore(&scan, channel), worst);
+  }
+  printf("\n");
+}
+
+// Read and write every setting through its descriptor: limits and
+// defaults must round trip, and writing one setting must leave the other
+// fields of struct settings alone.
+static void checkSettingsTable() {
+  struct settings settings;
+  unsigned long checks = 0;
+  unsigned long failed = 0;
+
+  settingsTableReset(&settings);
+  failed += !settingsTableValidate(&settings);
+  checks++;
+
+  for (uint8_t i = 0; i < SETTINGS_COUNT; i++) {
+    struct settingDescriptor descriptor;
+    settingsTableDescriptor(i, &descriptor);
+
+    failed += descriptor.label[0] == '\0' || descriptor.minValue > descriptor.maxValue ||
+              !settingsTableInRange(i, descriptor.defaultValue) ||
+              settingsTableGet(&settings, i) != descriptor.defaultValue;
+    checks++;
+
+    const int16_t values[] = { descriptor.minValue, descriptor.maxValue, descriptor.defaultValue };
+    for (uint8_t v = 0; v < sizeof(values) / sizeof(values[0]); v++) {
+      struct settings written = settings;
+      settingsTableSet(&written, i, values[v]);
+
+      for (uint8_t other = 0; other < SETTINGS_COUNT; other++) {
+        int16_t expected = (other == i) ? values[v] : settingsTableGet(&settings, other);
+        failed += settingsTableGet(&written, other) != expected;
+        checks++;
+      }
+    }
+
+    // An erased field is out of range and set back to its default.
+    struct settings damaged = settings;
+    memset((uint8_t *)&damaged + descriptor.offset, 0xFF, descriptor.width);
+    failed += settingsTableValidate(&damaged) || memcmp(&damaged, &settings, sizeof(settings)) != 0;
+    checks++;
+  }
+
+  printf("settings table: %d settings, %lu checks, %lu failed\n", SETTINGS_COUNT, checks, failed);
+  simFailures += failed;
+}
+
+// Make random settings changes. For each, cut power during every byte it
+// writes, with the byte torn in different ways, and load the store again:
+// it must hold either the old or the new values, and take changes after.
+static void checkSettingsStore() {
+  SimBoard board;
+  SimBoard *previous = simBoard;
+  struct settingsStore store;
+  unsigned long cuts = 0;
+  unsigned long inconsistent = 0;
+  unsigned long compactions = 0;
+  unsigned long bytesWritten = 0;
+
+  simBoardReset(&board, "eeprom");
+  simBoard = &board;
+  settingsStoreBegin(&store);
+
+  for (int change = 0; change < SIM_STORE_CHANGES; change++) {
+    uint8_t id = simRandom() * SIM_STORE_FIELDS;
+    uint16_t value = simRandom() * 65536;
+    struct settingsStore before = store;
+    uint8_t saved[SIM_EEPROM_SIZE];
+
+    memcpy(saved, board.eeprom, sizeof(saved));
+    board.eepromWrites = 0;
+    settingsStoreSet(&store, id, value);
+
+    unsigned long written = board.eepromWrites;
+    uint8_t done[SIM_EEPROM_SIZE];
+    memcpy(done, board.eeprom, sizeof(done));
+    bytesWritten += written;
+    compactions += (store.generation != before.generation);
+
+    for (unsigned long cut = 0; cut < written; cut++) {
+      for (uint8_t mask = 0; mask < sizeof(tornMasks); mask++) {
+        struct settingsStore interrupted = before;
+        struct settingsStore loaded;
+
+        memcpy(board.eeprom, saved, sizeof(saved));
+        board.eepromWrites = 0;
+        board.eepromPowerCut = cut;
+        board.eepromTornMask = tornMasks[mask];
+        settingsStoreSet(&interrupted, id, value);
+        board.eepromPowerCut = -1;
+
+        settingsStoreBegin(&loaded);
+        bool consistent = sameSettings(&loaded, &before) || sameSettings(&loaded, &store);
+
+        uint16_t next = value + 1;
+        settingsStoreSet(&loaded, id, next);
+        settingsStoreBegin(&loaded);
+        consistent = consistent && settingsStoreGet(&loaded, id, &next) && next == (uint16_t)(value + 1);
+
+        inconsistent += !consistent;
+        cuts++;
+      }
+    }
+
+    memcpy(board.eeprom, done, sizeof(done));
+  }
+
+  printf("settings store: %d changes, %.1f bytes/change, %lu compactions, %lu power cuts, %lu inconsistent\n",
+         SIM_STORE_CHANGES, (double)bytesWritten / SIM_STORE_CHANGES, compactions, cuts, inconsistent);
+  simFailures += inconsistent;
+
+  simBoard = previous;
+}
+
+static bool sameSettings(const struct settingsStore *a, const struct settingsStore *b) {
+  if (a->stored != b->stored) {
+    return false;
+  }
+  for (uint8_t id = 0; id < SETTINGS_STORE_MAX_FIELDS; id++) {
+    if ((a->stored & (1 << id)) && a->values[id] != b->values[id]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Log a few trips, restarting the remote between them, and decode the
+// EEPROM as tools/trip_log.py does: the samples kept must be the newest
+// ones logged. Power is also cut at each write of some samples, and the
+// log must then hold the samples before or including the one cut, and
+// carry on after it.
+static void checkTripLog() {
+  SimBoard board;
+  SimBoard *previous = simBoard;
+  struct tripLog log;
+  std::vector<SimTripSample> logged;
+  unsigned long maxWrites = 0;
+  unsigned long flushes = 0;
+  unsigned long cuts = 0;
+  unsigned long inconsistent = 0;
+  double ampHours = 0.0;
+
+  simBoardReset(&board, "trip log");
+  simBoard = &board;
+
+  for (int trip = 0; trip < SIM_TRIPS; trip++) {
+    tripLogBegin(&log);
+
+    for (int i = 0; i < SIM_TRIP_SAMPLES; i++) {
+      double time = i * TRIP_LOG_PERIOD_MS / 1000.0;
+      SimTripSample sample = tripSample(time, ampHours);
+      struct tripLog before = log;
+      uint8_t saved[SIM_EEPROM_SIZE];
+
+      ampHours += sample.speed * 0.00035;
+      memcpy(saved, board.eeprom, sizeof(saved));
+      board.eepromWrites = 0;
+
+      if (!tripLogRecord(&log, sample.speed, sample.voltage, sample.ampHours)) {
+        continue;
+      }
+      flushes += flushTripLog(&log, &maxWrites);
+      unsigned long written = board.eepromWrites;
+
+      if (i % SIM_TRIP_CUT_EVERY == 0) {
+        uint8_t done[SIM_EEPROM_SIZE];
+        std::vector<SimTripSample> withSample = logged;
+        withSample.push_back(sample);
+        memcpy(done, board.eeprom, sizeof(done));
+
+        for (unsigned long cut = 0; cut < written; cut++) {
+          for (uint8_t mask = 0; mask < sizeof(tornMasks); mask++) {
+            struct tripLog interrupted = before;
+            SimTripSample next = { 7, 400, sample.ampHours };
+
+            memcpy(board.eeprom, saved, sizeof(saved));
+            board.eepromWrites = 0;
+            board.eepromPowerCut = cut;
+            board.eepromTornMask = tornMasks[mask];
+            tripLogRecord(&interrupted, sample.speed, sample.voltage, sample.ampHours);
+            flushTripLog(&interrupted, &maxWrites);
+            board.eepromPowerCut = -1;
+
+            // Restart and log one more sample.
+            tripLogBegin(&interrupted);
+            tripLogRecord(&interrupted, next.speed, next.voltage, next.ampHours);
+            flushTripLog(&interrupted, &maxWrites);
+
+            std::vector<SimTripSample> decoded = decodeTripLog();
+            std::vector<SimTripSample> without = logged;
+            std::vector<SimTripSample> with = withSample;
+            without.push_back(next);
+            with.push_back(next);
+
+            inconsistent += !endsWith(without, decoded) && !endsWith(with, decoded);
+            cuts++;
+          }
+        }
+        memcpy(board.eeprom, done, sizeof(done));
+      }
+
+      logged.push_back(sample);
+    }
+  }
+
+  std::vector<SimTripSample> decoded = decodeTripLog();
+
+  printf("trip log: %lu samples logged, %lu kept (%.1f min), %s, %.1f flush calls/sample, "
+         "%lu writes/call max, %lu power cuts, %lu inconsistent\n",
+         (unsigned long)logged.size(), (unsigned long)decoded.size(),
+         decoded.size() * TRIP_LOG_PERIOD_MS / 60000.0,
+         endsWith(logged, decoded) ? "newest match" : "MISMATCH",
+         (double)flushes / logged.size(), maxWrites, cuts, inconsistent);
+  simFailures += inconsistent + !endsWith(logged, decoded);
+
+  simBoard = previous;
+}
+
+// Feed the stream a ride's worth of throttle packets, VESC samples and
+// link events, with the loop stalling now and then, and take bytes off the
+// line at 115200 baud, then at 9600 so the buffer overflows. Decode the
+// capture as tools/telemetry_stream.py does: every record must pass its
+// CRC and carry the values fed in, the sequence gaps must add up to the
+// records dropped, and no write may find the TX buffer full.
+static void checkTelemetryStream() {
+  SimBoard board;
+  SimBoard *previous = simBoard;
+  struct telemetryStream stream;
+  std::vector<uint8_t> line;
+  double sendable = 0.0;
+  unsigned long made = 0;
+
+  simBoardReset(&board, "stream");
+  simBoard = &board;
+  telemetryStreamBegin(&stream);
+
+  for (uint32_t time = 0; time < 15000; time++) {
+    double rate = (time < 10000) ? SIM_STREAM_FAST_BPMS : SIM_STREAM_SLOW_BPMS;
+
+    if (time % SIM_STREAM_PACKET_MS == 0) {
+      telemetryStreamThrottle(&stream, time, (time / SIM_STREAM_PACKET_MS) & 1023, 100);
+      made++;
+    }
+
+    // The loop stalls for 100 ms every 3 s.
+    if (time % 3000 >= 100) {
+      if (time % SIM_STREAM_VESC_MS == 0) {
+        struct vescMeasurement values;
+        memset(&values, 0, sizeof(values));
+        values.rpm = time;
+        values.inpVoltage = 36.5;
+        values.tempFet = 31.2;
+        telemetryStreamVesc(&stream, time, &values);
+        made++;
+      }
+      if (time % 1000 == 500) {
+        telemetryStreamLink(&stream, time, TELEMETRY_STREAM_LINK_CHANGED, time / 1000, 76);
+        made++;
+      }
+      telemetryStreamUpdate(&stream);
+    }
+
+    // The UART takes bytes off at the baud rate.
+    for (sendable += rate; sendable >= 1.0 && !board.serialTx.empty(); sendable -= 1.0) {
+      line.push_back(board.serialTx.front());
+      board.serialTx.pop_front();
+    }
+    if (board.serialTx.empty()) {
+      sendable = 0.0;
+    }
+  }
+
+  unsigned long records = 0;
+  unsigned long gaps = 0;
+  unsigned long invalid = 0;
+  unsigned long wrong = 0;
+  int lastSeq = -1;
+  std::vector<uint8_t> frame;
+
+  for (size_t i = 0; i < line.size(); i++) {
+    if (line[i] != 0) {
+      frame.push_back(line[i]);
+      continue;
+    }
+
+    // COBS decode.
+    std::vector<uint8_t> record;
+    size_t pos = 0;
+    while (pos < frame.size()) {
+      uint8_t code = frame[pos++];
+      for (uint8_t k = 1; k < code && pos < frame.size(); k++) {
+        record.push_back(frame[pos++]);
+      }
+      if (code < 0xFF && pos < frame.size()) {
+        record.push_back(0);
+      }
+    }
+    frame.clear();
+
+    if (record.size() < 7 || protocolCrc8(&record[0], record.size() - 1) != record.back()) {
+      invalid++;
+      continue;
+    }
+    records++;
+
+    uint8_t seq = record[1];
+    if (lastSeq >= 0) {
+      gaps += (uint8_t)(seq - lastSeq - 1);
+    }
+    lastSeq = seq;
+
+    uint32_t time = record[2] | (record[3] << 8) | (record[4] << 16) | ((uint32_t)record[5] << 24);
+    uint32_t first = record[6] | (record[7] << 8) | (record[8] << 16) | ((uint32_t)record[9] << 24);
+    switch (record[0]) {
+      case TELEMETRY_STREAM_THROTTLE:
+        wrong += (first & 0xFFFF) != ((time / SIM_STREAM_PACKET_MS) & 1023) || (first >> 16) != 100;
+        break;
+      case TELEMETRY_STREAM_VESC:
+        wrong += first != time || (record[10] | (record[11] << 8)) != 3650 || (record[18] | (record[19] << 8)) != 312;
+        break;
+      case TELEMETRY_STREAM_LINK:
+        wrong += record[7] != time / 1000 || record[8] != 76;
+        break;
+      default:
+        wrong++;
+    }
+  }
+
+  printf("telemetry stream: %lu records made, %lu decoded, %lu invalid, %lu wrong, %lu gaps, "
+         "%u dropped, %lu blocked writes, %.0f bytes/s\n",
+         made, records, invalid, wrong, gaps, stream.dropped, board.serialTxBlocked, line.size() / 15.0);
+  simFailures += invalid + wrong + (gaps != stream.dropped) + board.serialTxBlocked;
+
+  simBoard = previous;
+}
+
+// Run three tasks on a virtual clock: 1 ms taking 50 µs, 5 ms taking
+// 400 µs, and 100 ms blocking for 3 ms, first without the blocking task and
+// last with its work done in steps, returning when preempted. When nothing
+// is due the clock jumps to the next release, as a sleeping loop would. Every release must be run or counted as skipped, with the
+// next one still on the grid from the start, and the idle time must never
+// be zero after a pass that found nothing to run. Then run a 1 ms task
+// past the 65535 runs its count stops at, the last run late: it must still
+// be counted as an overrun.
+static void checkTaskScheduler() {
+  unsigned long offGrid = 0;
+  unsigned long idleErrors = 0;
+
+  printf("task scheduler:");
+
+  for (uint8_t run = 0; run < 3; run++) {
+    const struct task tasks[] = {
+      { virtualTaskFast,     1000,   500 },
+      { virtualTaskMedium,   5000,   5000 },
+      { (run == 2) ? virtualTaskStepped : virtualTaskBlocking, 100000, 50000 }
+    };
+    struct taskState states[3];
+    struct taskScheduler scheduler;
+    uint8_t count = (run == 0) ? 2 : 3;
+
+    virtualClockUs = 0;
+    virtualTaskLeftUs = 0;
+    virtualScheduler = &scheduler;
+    taskSchedulerBegin(&scheduler, tasks, states, count, virtualClock);
+
+    while (virtualClockUs < SIM_SCHEDULER_US) {
+      virtualClockUs += SIM_SCHEDULER_PASS_US;
+
+      if (taskSchedulerRun(&scheduler) == false) {
+        unsigned long idle = taskSchedulerIdle(&scheduler);
+        idleErrors += (idle == 0);
+        virtualClockUs += idle;
+      }
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+      const struct taskStats *stats = &states[i].stats;
+      offGrid += states[i].release != (stats->runs + stats->skipped) * tasks[i].period;
+    }
+
+    const struct taskStats *fast = &states[0].stats;
+    static const char *const cases[] = { "", ";\n  with 3 ms blocks,", ";\n  with them in steps," };
+    printf("%s 1 ms task %u runs, late %u-%u us, %u overruns, %u skipped", cases[run], fast->runs,
+           fast->minLateness, fast->maxLateness, fast->overruns, fast->skipped);
+    // Only whole 3 ms blocks may make it skip.
+    simFailures += (run != 1 && fast->skipped != 0);
+  }
+
+  const struct task longTask[] = { { virtualTaskVariable, 1000, 500 } };
+  struct taskState longState[1];
+  struct taskScheduler scheduler;
+
+  virtualClockUs = 0;
+  virtualTaskUs = 50;
+  taskSchedulerBegin(&scheduler, longTask, longState, 1, virtualClock);
+  for (unsigned long run = 1; run <= SIM_SCHEDULER_SATURATED_RUNS; run++) {
+    virtualTaskUs = (run == SIM_SCHEDULER_SATURATED_RUNS) ? 1500 : 50;
+    virtualClockUs += taskSchedulerIdle(&scheduler);
+    taskSchedulerRun(&scheduler);
+  }
+
+  const struct taskStats *saturated = &longState[0].stats;
+  printf(";\n  after %lu runs, %u counted, %u overruns, max run %u us", SIM_SCHEDULER_SATURATED_RUNS,
+         saturated->runs, saturated->overruns, saturated->maxDuration);
+
+  printf("; %lu off grid, %lu idle errors\n", offGrid, idleErrors);
+  simFailures += offGrid + idleErrors + (saturated->runs != 0xFFFF || saturated->overruns != 1);
+}
+
+// Park the remote, trigger released and hall centered, until it sleeps.
+// Then pull the trigger with the throttle open, at a different point of
+// the keepalive cycle each time. Report when the modes changed, the
+// current the firmware estimates for each, and the wake time: the
+// firmware's own (activity to first packet through), and at the receiver
+// (trigger to output change).
+static void checkPowerModes() {
+  SimReport report;
+  double idleAfter = 0.0;
+  double sleepAfter = 0.0;
+  double minOutput = 1e9;
+  double maxOutput = 0.0;
+  unsigned long missed = 0;
+  unsigned long unready = simLink.unready;
+
+  report.failsafes = 0;
+
+  for (uint8_t wake = 0; wake < SIM_POWER_WAKES; wake++) {
+    uint64_t parked = max(txBoard.timeUs, rxBoard.timeUs);
+    uint64_t end = parked + SIM_POWER_PARK_US + wake * SIM_POWER_PHASE_US;
+
+    hallOverride = hallSteps[0];
+    txBoard.pins[SIM_TRIGGER_PIN] = HIGH;
+
+    for (uint64_t time = parked; time < end; time += 100000) {
+      runUntil(min(time + 100000, end), &report);
+      if (idleAfter == 0.0 && transmitter::poweredMode != POWER_ACTIVE) {
+        idleAfter = (txBoard.timeUs - parked) / 1e6;
+      }
+      if (sleepAfter == 0.0 && transmitter::poweredMode == POWER_SLEEP) {
+        sleepAfter = (txBoard.timeUs - parked) / 1e6;
+      }
+    }
+
+    uint64_t press = max(txBoard.timeUs, rxBoard.timeUs);
+    hallOverride = 1023;
+    txBoard.pins[SIM_TRIGGER_PIN] = LOW;
+    pulseEvents.clear();
+    recordPulse(rxBoard.timeUs);
+
+    runUntil(press + SIM_POWER_RIDE_US, &report);
+
+    if (pulseEvents.size() < 2) {
+      missed++;
+      continue;
+    }
+    double output = (pulseEvents[1].time - press) / 1000.0;
+    minOutput = min(minOutput, output);
+    maxOutput = max(maxOutput, output);
+  }
+
+  hallOverride = -1;
+
+  const struct powerManager *power = &transmitter::powerState;
+  printf("\npower: idle after %.1f s, asleep after %.1f s; estimated %.1f mA active, %.1f mA idle, %.1f mA asleep\n",
+         idleAfter, sleepAfter, powerManagerCurrent(power, POWER_ACTIVE) / 1000.0,
+         powerManagerCurrent(power, POWER_IDLE) / 1000.0, powerManagerCurrent(power, POWER_SLEEP) / 1000.0);
+  printf("  %u wakes, first packet %.1f ms last, %.1f ms max, %u over %.0f ms; "
+         "receiver output after %.1f-%.1f ms, %lu missed; %lu packets started before the radio was up\n",
+         power->wakes, power->lastWake / 1000.0, power->maxWake / 1000.0, power->lateWakes,
+         POWER_WAKE_BOUND_US / 1000.0, minOutput, maxOutput, missed, simLink.unready - unready);
+  simFailures += power->lateWakes + missed + (simLink.unready - unready);
+}
+
+// Power both boards on together and run until the remote has settled on
+// the channel its background scan found. Report the time from power on to
+// the first packet on each side, to the start screen and to the channel.
+static void checkBoot() {
+  SimReport report;
+  double drawn = 0.0;
+  double settled = 0.0;
+
+  report.failsafes = 0;
+
+  for (uint64_t time = 0; time < SIM_BOOT_US && settled == 0.0; time += 1000) {
+    runUntil(time + 1000, &report);
+    if (drawn == 0.0 && transmitter::u8g2.pagesSent >= SIM_DISPLAY_PAGES) {
+      drawn = txBoard.timeUs / 1000.0;
+    }
+    if (transmitter::backgroundScanLeft == 0 && transmitter::radioChannel == transmitter::selectedChannel) {
+      settled = txBoard.timeUs / 1e6;
+    }
+  }
+
+  printf("boot: first packet sent after %.1f ms, received after %.1f ms; start screen after %.1f ms, "
+         "on channel %d after %.2f s\n\n",
+         transmitter::powerState.firstPacket / 1000.0, receiver::firstPacketTime / 1000.0, drawn,
+         transmitter::radioChannel, settled);
+}
+
+static unsigned long virtualClock() {
+  return virtualClockUs;
+}
+
+static void virtualTaskFast() {
+  virtualClockUs += 50;
+}
+
+static void virtualTaskMedium() {
+  virtualClockUs += 400;
+}
+
+static void virtualTaskBlocking() {
+  virtualClockUs += 3000;
+}
+
+static void virtualTaskVariable() {
+  virtualClockUs += virtualTaskUs;
+}
+
+// The 3 ms of the blocking task in 500 µs steps, carried on by the next
+// run whenever a higher priority task is due.
+static void virtualTaskStepped() {
+  if (virtualTaskLeftUs == 0) {
+    virtualTaskLeftUs = 3000;
+  }
+  do {
+    virtualClockUs += 500;
+    virtualTaskLeftUs -= 500;
+  } while (virtualTaskLeftUs > 0 && taskSchedulerPreempted(virtualScheduler) == false);
+}
+
+// Sample of a ride: speed varying around 25 km/h with a stop every few
+// minutes, voltage sagging with speed and dropping with the charge used.
+static SimTripSample tripSample(double time, double ampHours) {
+  double speed = 25.0 + 12.0 * sin(time / 40.0) + 4.0 * simRandom();
+  if (fmod(time, 180.0) < 15.0) {
+    speed = 0.0;
+  }
+  double voltage = 50.4 - 0.6 * ampHours - 0.04 * speed;
+
+  SimTripSample sample = {
+    (uint8_t)(speed * 2 + 0.5), (uint16_t)(voltage * 10 + 0.5), (uint16_t)(ampHours * 100 + 0.5)
+  };
+  return sample;
+}
+
+// Flush a staged sample completely, tracking the most EEPROM writes made
+// by one call. Returns the number of calls.
+static unsigned long flushTripLog(struct tripLog *log, unsigned long *maxWrites) {
+  unsigned long calls = 0;
+  bool more;
+
+  do {
+    long writes = simBoard->eepromWrites;
+    more = tripLogFlush(log);
+    *maxWrites = max(*maxWrites, (unsigned long)(simBoard->eepromWrites - writes));
+    calls++;
+  } while (more);
+
+  return calls;
+}
+
+// Decode the samples in the EEPROM, oldest first.
+static std::vector<SimTripSample> decodeTripLog() {
+  std::vector<SimTripSample> samples;
+  std::vector<std::pair<uint16_t, uint8_t> > blocks; // Sequence, block
+  int newest = -1;
+
+  for (uint8_t block = 0; block < TRIP_LOG_BLOCKS; block++) {
+    const uint8_t *p = &simBoard->eeprom[TRIP_LOG_START + block * TRIP_LOG_BLOCK_SIZE];
+    if (protocolCrc8(p, TRIP_LOG_HEADER_SIZE - 1) != p[TRIP_LOG_HEADER_SIZE - 1]) {
+      continue;
+    }
+    uint16_t seq = (p[0] | (p[1] << 8)) & 0x7FFF;
+    blocks.push_back(std::make_pair(seq, block));
+    if (newest < 0 || (((seq - newest) & 0x7FFF) != 0 && ((seq - newest) & 0x7FFF) < 0x4000)) {
+      newest = seq;
+    }
+  }
+
+  // Oldest first, by distance back from the newest.
+  for (size_t i = 0; i < blocks.size(); i++) {
+    blocks[i].first = 0x7FFF - ((newest - blocks[i].first) & 0x7FFF);
+  }
+  std::sort(blocks.begin(), blocks.end());
+
+  for (size_t i = 0; i < blocks.size(); i++) {
+    const uint8_t *p = &simBoard->eeprom[TRIP_LOG_START + blocks[i].second * TRIP_LOG_BLOCK_SIZE];
+    SimTripSample sample = { p[2], (uint16_t)(p[3] | (p[4] << 8)), (uint16_t)(p[5] | (p[6] << 8)) };
+    samples.push_back(sample);
+
+    for (uint8_t offset = TRIP_LOG_HEADER_SIZE; offset < TRIP_LOG_BLOCK_SIZE; offset += 2) {
+      uint16_t delta = p[offset] | (p[offset + 1] << 8);
+      if (delta & 0x8000) {
+        break;
+      }
+      sample.speed += (int8_t)((delta >> 9) << 2) >> 2;
+      sample.voltage += (int8_t)((delta >> 4) << 3) >> 3;
+      sample.ampHours += delta & 0x0F;
+      samples.push_back(sample);
+    }
+  }
+
+  return samples;
+}
+
+// Return true if decoded is a non-empty tail of expected.
+static bool endsWith(const std::vector<SimTripSample> &expected, const std::vector<SimTripSample> &decoded) {
+  if (decoded.empty() || decoded.size() > expected.size()) {
+    return false;
+  }
+  return std::equal(decoded.begin(), decoded.end(), expected.end() - decoded.size());
+}
+
+// Draw each bitmap page by page, as the display does, at several
+// placements over a patterned screen, and compare with drawing the
+// original XBM pixel by pixel.
+static void checkBitmaps() {
+  unsigned long mismatched = 0;
+  int placements = sizeof(bitmapPlacements) / sizeof(bitmapPlacements[0]);
+
+  for (uint8_t i = 0; i < sizeof(bitmaps) / sizeof(bitmaps[0]); i++) {
+    const SimBitmap *bitmap = &bitmaps[i];
+    int rowBytes = (bitmap->width + 7) / 8;
+
+    for (int p = 0; p < placements; p++) {
+      int x = bitmapPlacements[p][0];
+      int y = bitmapPlacements[p][1];
+      uint8_t decoded[SIM_DISPLAY_PAGES][SIM_DISPLAY_WIDTH];
+      uint8_t expected[SIM_DISPLAY_PAGES][SIM_DISPLAY_WIDTH];
+
+      memset(decoded, 0xA5, sizeof(decoded));
+      memset(expected, 0xA5, sizeof(expected));
+
+      for (uint8_t row = 0; row < SIM_DISPLAY_PAGES; row++) {
+        struct bitmapPage page = { decoded[row], SIM_DISPLAY_WIDTH / 8, row, 1 };
+        bitmapDraw(&page, x, y, bitmap->asset);
+      }
+
+      for (int by = 0; by < bitmap->height; by++) {
+        for (int bx = 0; bx < bitmap->width; bx++) {
+          int px = x + bx;
+          int py = y + by;
+
+          if (px < 0 || px >= SIM_DISPLAY_WIDTH || py < 0 || py >= SIM_DISPLAY_PAGES * 8) {
+            continue;
+          }
+          if (bitmap->original[by * rowBytes + bx / 8] & (1 << (bx % 8))) {
+            expected[py / 8][px] |= 1 << (py % 8);
+          } else {
+            expected[py / 8][px] &= ~(1 << (py % 8));
+          }
+        }
+      }
+
+      mismatched += memcmp(decoded, expected, sizeof(decoded)) != 0;
+    }
+  }
+
+  printf("bitmaps: %d drawn at %d placements, %lu mismatched\n\n",
+         (int)(sizeof(bitmaps) / sizeof(bitmaps[0])), placements, mismatched);
+}
+
+// For each battery: the rest voltage lookup against its discharge curve,
+// then a ride from full to 5 %, with the pack voltage sagging under load
+// and reported at the VESC's 0.1 V resolution. Errors are against the true
+// state of charge; steps are the largest change between two updates. The
+// same without sag compensation and smoothing is shown for comparison.
+static void checkBatteryModel() {
+  printf("%-14s %9s %9s %9s %9s %11s %11s\n", "battery", "rest err", "ride err", "max step",
+         "mOhm", "uncomp err", "uncomp step");
+
+  for (uint8_t i = 0; i < sizeof(batteries) / sizeof(batteries[0]); i++) {
+    const SimBattery *battery = &batteries[i];
+    double restError = 0.0;
+
+    for (int percent = 0; percent <= 100; percent++) {
+      uint16_t millivolts = cellVoltage(battery->curve, percent / 100.0) * 1000 + 0.5;
+      restError = max(restError, fabs(batteryModelLookup(battery->type, millivolts) / 10.0 - percent));
+    }
+
+    struct batteryModel model;
+    double soc = 1.0;
+    double rideError = 0.0, maxStep = 0.0, uncompError = 0.0, uncompStep = 0.0;
+    double lastSoc = -1.0, lastUncomp = -1.0;
+
+    batteryModelBegin(&model, battery->type, battery->cells);
+
+    for (double time = 0.0; soc > 0.05; time += SIM_BATTERY_STEP_S) {
+      double current = rideCurrent(time);
+      double voltage = battery->cells * (cellVoltage(battery->curve, soc) - current * battery->resistance);
+      uint16_t packMillivolts = floor(voltage * 10 + 0.5) * 100;
+
+      batteryModelUpdate(&model, packMillivolts, current * 100);
+      double estimate = batteryModelSoc(&model) / 10.0;
+      double uncomp = batteryModelLookup(battery->type, packMillivolts / battery->cells) / 10.0;
+
+      rideError = max(rideError, fabs(estimate - soc * 100));
+      uncompError = max(uncompError, fabs(uncomp - soc * 100));
+      if (lastSoc >= 0.0) {
+        maxStep = max(maxStep, fabs(estimate - lastSoc));
+        uncompStep = max(uncompStep, fabs(uncomp - lastUncomp));
+      }
+      lastSoc = estimate;
+      lastUncomp = uncomp;
+
+      soc -= current * SIM_BATTERY_STEP_S / 3600.0 / battery->capacityAh;
+    }
+
+    printf("%-14s %8.1f%% %8.1f%% %8.1f%% %9.1f %10.1f%% %10.1f%%\n", battery->name, restError, rideError, maxStep,
+           batteryModelResistance(&model) / 10.0, uncompError, uncompStep);
+  }
+
+  checkRecordedRides();
+  printf("\n");
+}
+
+// Replay the rides in SIM_FIXTURES_DIR, as written by
+// tools/telemetry_stream.py, with a line on top describing the battery:
+//
+//   # battery li-ion 10S 12.0Ah 100%
+//
+// giving the type, series cells, capacity and charge at the start. The
+// VESC samples are fed to the model every BATTERY_MODEL_UPDATE_MS, the
+// latest one each time as the remote does. Errors are against the charge
+// counted from the amp hours drawn and charged.
+static void checkRecordedRides() {
+  std::vector<std::string> names;
+  DIR *dir = opendir(SIM_FIXTURES_DIR);
+
+  if (dir != NULL) {
+    for (struct dirent *entry = readdir(dir); entry != NULL; entry = readdir(dir)) {
+      std::string name = entry->d_name;
+      if (name.size() > 4 && name.compare(name.size() - 4, 4, ".csv") == 0) {
+        names.push_back(name);
+      }
+    }
+    closedir(dir);
+  }
+  std::sort(names.begin(), names.end());
+
+  int replayed = 0;
+  for (size_t i = 0; i < names.size(); i++) {
+    replayed += replayRide(names[i]);
+  }
+
+  if (replayed == 0) {
+    printf("  no recorded rides in sim/%s\n", SIM_FIXTURES_DIR);
+  }
+}
+
+static bool replayRide(const std::string &name) {
+  std::string path = std::string(SIM_FIXTURES_DIR "/") + name;
+  FILE *file = fopen(path.c_str(), "r");
+  char line[256];
+  char type[16];
+  int cells;
+  double capacityAh, startSoc;
+
+  if (file == NULL) {
+    return false;
+  }
+  if (fgets(line, sizeof(line), file) == NULL
+      || sscanf(line, "# battery %15s %dS %lfAh %lf%%", type, &cells, &capacityAh, &startSoc) != 4
+      || fgets(line, sizeof(line), file) == NULL) {
+    printf("  %s: no battery line and header\n", name.c_str());
+    fclose(file);
+    return false;
+  }
+
+  // Columns by name, from the header.
+  static const char *const names[] = { "time_ms", "type", "voltage_v", "input_current_a", "amp_hours", "amp_hours_charged" };
+  int columns[6];
+  std::vector<std::string> header = splitCsv(line);
+
+  for (uint8_t i = 0; i < 6; i++) {
+    columns[i] = std::find(header.begin(), header.end(), names[i]) - header.begin();
+    if (columns[i] == (int)header.size()) {
+      printf("  %s: no %s column\n", name.c_str(), names[i]);
+      fclose(file);
+      return false;
+    }
+  }
+
+  struct batteryModel model;
+  uint8_t batteryType = (strcmp(type, "lipo") == 0) ? BATTERY_LIPO : BATTERY_LI_ION;
+  double rideError = 0.0, maxStep = 0.0, uncompError = 0.0, uncompStep = 0.0;
+  double lastSoc = -1.0, lastUncomp = -1.0;
+  double firstDrawn = 0.0, soc = 0.0;
+  double voltage = 0.0, current = 0.0;
+  unsigned long nextUpdate = 0;
+  unsigned long samples = 0;
+
+  batteryModelBegin(&model, batteryType, cells);
+
+  while (fgets(line, sizeof(line), file) != NULL) {
+    std::vector<std::string> row = splitCsv(line);
+
+    if (row.size() < header.size() || row[columns[1]] != "vesc") {
+      continue;
+    }
+
+    unsigned long time = strtoul(row[columns[0]].c_str(), NULL, 10);
+    double drawn = atof(row[columns[4]].c_str()) - atof(row[columns[5]].c_str());
+
+    if (samples++ == 0) {
+      firstDrawn = drawn;
+      nextUpdate = time;
+    }
+
+    // Updates that fell before this sample see the one before it.
+    for (; nextUpdate < time && samples > 1; nextUpdate += BATTERY_MODEL_UPDATE_MS) {
+      uint16_t packMillivolts = voltage * 1000;
+
+      batteryModelUpdate(&model, packMillivolts, current * 100);
+      double estimate = batteryModelSoc(&model) / 10.0;
+      double uncomp = batteryModelLookup(batteryType, packMillivolts / cells) / 10.0;
+
+      rideError = max(rideError, fabs(estimate - soc));
+      uncompError = max(uncompError, fabs(uncomp - soc));
+      if (lastSoc >= 0.0) {
+        maxStep = max(maxStep, fabs(estimate - lastSoc));
+        uncompStep = max(uncompStep, fabs(uncomp - lastUncomp));
+      }
+      lastSoc = estimate;
+      lastUncomp = uncomp;
+    }
+
+    voltage = atof(row[columns[2]].c_str());
+    current = atof(row[columns[3]].c_str());
+    soc = startSoc - (drawn - firstDrawn) / capacityAh * 100.0;
+  }
+  fclose(file);
+
+  if (lastSoc < 0.0) {
+    printf("  %s: no VESC samples\n", name.c_str());
+    return false;
+  }
+
+  printf("%-14.14s %9s %8.1f%% %8.1f%% %9.1f %10.1f%% %10.1f%%\n", name.c_str(), "-", rideError, maxStep,
+         batteryModelResistance(&model) / 10.0, uncompError, uncompStep);
+  return true;
+}
+
+// Fields of a CSV line, without the line end.
+static std::vector<std::string> splitCsv(const char *line) {
+  std::vector<std::string> fields(1);
+
+  for (const char *p = line; *p != '\0' && *p != '\n' && *p != '\r'; p++) {
+    if (*p == ',') {
+      fields.push_back("");
+    } else {
+      fields.back() += *p;
+    }
+  }
+
+  return fields;
+}
+
+// Cell voltage at rest for a state of charge (0-1), between curve points.
+static double cellVoltage(const double *curve, double soc) {
+  double position = constrain(soc, 0.0, 1.0) * 10;
+  int index = min((int)position, 9);
+
+  return curve[index] + (curve[index + 1] - curve[index]) * (position - index);
+}
+
+// Pack current (A) during a ride: stand still, accelerate, cruise, brake.
+static double rideCurrent(double time) {
+  double phase = fmod(time, SIM_BATTERY_CYCLE_S);
+
+  if (phase < 4.0) {
+    return 0.0;
+  } else if (phase < 7.0) {
+    return 40.0;
+  } else if (phase < 18.0) {
+    return 12.0;
+  }
+  return -15.0;
+}
+
+static void runScenario(const SimScenario *scenario, SimReport *report) {
+  simLinkReset(scenario->loss, scenario->marginDb, scenario->latencyUs);
+  scenario->noise(simLink.noise);
+  report->failsafes = 0;
+  report->pages = transmitter::u8g2.pagesSent;
+  memset(report->maxAge, 0, sizeof(report->maxAge));
+  report->ageChecks = 0;
+  report->tripStale = 0;
+
+  scenarioStart = max(txBoard.timeUs, rxBoard.timeUs);
+  resetTaskStats(&transmitter::scheduler);
+  resetTaskStats(&receiver::scheduler);
+  uint64_t end = scenarioStart + SIM_SCENARIO_US;
+
+  txBoard.pins[SIM_TRIGGER_PIN] = scenario->trigger ? LOW : HIGH;
+  pulseEvents.clear();
+  maskedWindows.clear();
+  recordPulse(rxBoard.timeUs);
+  receiver::getOutputLatency(&report->output);
+
+  runUntil(end, report);
+
+  receiver::getOutputLatency(&report->output);
+  report->pages = transmitter::u8g2.pagesSent - report->pages;
+  measureLatencies(end, report);
+  measurePulses(end, report);
+  addTaskStats("transmitter", &transmitter::scheduler);
+  addTaskStats("receiver", &receiver::scheduler);
+}
+
+static void resetTaskStats(struct taskScheduler *scheduler) {
+  for (uint8_t i = 0; i < scheduler->count; i++) {
+    taskStatsReset(&scheduler->states[i].stats);
+  }
+}
+
+// Add the statistics of a scenario to the totals of the tasks.
+static void addTaskStats(const char *firmware, const struct taskScheduler *scheduler) {
+  for (uint8_t i = 0; i < scheduler->count; i++) {
+    const struct task *task = &scheduler->tasks[i];
+    const struct taskStats *stats = &scheduler->states[i].stats;
+    SimTaskTotals *totals = NULL;
+
+    for (size_t k = 0; k < taskTotals.size(); k++) {
+      if (taskTotals[k].firmware == firmware && taskTotals[k].index == i) {
+        totals = &taskTotals[k];
+      }
+    }
+
+    if (totals == NULL) {
+      SimTaskTotals first;
+      memset(&first, 0, sizeof(first));
+      first.firmware = firmware;
+      first.index = i;
+      first.name = "?";
+      first.period = task->period;
+      for (size_t k = 0; k < sizeof(taskNames) / sizeof(taskNames[0]); k++) {
+        if (taskNames[k].run == task->run) {
+          first.name = taskNames[k].name;
+        }
+      }
+      taskTotals.push_back(first);
+      totals = &taskTotals.back();
+    }
+
+    totals->runs += stats->runs;
+    totals->overruns += stats->overruns;
+    totals->skipped += stats->skipped;
+    totals->lateness += stats->totalLateness;
+    totals->maxLateness = max(totals->maxLateness, stats->maxLateness);
+    totals->maxDuration = max(totals->maxDuration, stats->maxDuration);
+  }
+}
+
+// List the tasks of both firmwares over all scenarios. The spread of the
+// lateness is the jitter of a task. The first task of each, the control
+// task on the remote, must never skip a release, so the display only ever
+// holds it up for one transfer.
+static void printTaskTotals() {
+  unsigned long firstSkipped = 0;
+
+  printf("\n%-12s %-13s %9s %8s %9s %9s %8s %9s %8s\n",
+         "firmware", "task", "period ms", "runs", "late avg", "late max", "max run", "overruns", "skipped");
+
+  for (size_t i = 0; i < taskTotals.size(); i++) {
+    const SimTaskTotals *totals = &taskTotals[i];
+
+    printf("%-12s %-13s %9.1f %8lu %9.0f %9u %8u %9lu %8lu\n",
+           totals->firmware, totals->name, totals->period / 1000.0, totals->runs,
+           totals->runs ? (double)totals->lateness / totals->runs : 0.0,
+           totals->maxLateness, totals->maxDuration, totals->overruns, totals->skipped);
+    if (totals->index == 0) {
+      firstSkipped += totals->skipped;
+    }
+  }
+
+  printf("  first tasks: %lu skipped releases; longest display transfer %u us\n",
+         firstSkipped, transmitter::u8g2.maxTransferUs);
+  simFailures += firstSkipped;
+}
+// Run both boards up to a time.
+static void runUntil(uint64_t end, SimReport *report) {
+  while (txBoard.timeUs < end || rxBoard.timeUs < end) {
+    if (txBoard.timeUs <= rxBoard.timeUs) {
+      stepTransmitter();
+      recordAges(report);
+    } else {
+      stepReceiver(report);
+    }
+  }
+}
+
+// Track the oldest telemetry the remote holds, after a second to settle.
+static void recordAges(SimReport *report) {
+  static const uint8_t fields[] = { TELEMETRY_RPM, TELEMETRY_VOLTAGE, TELEMETRY_TEMP_FET };
+
+  if (txBoard.timeUs < scenarioStart + 1000000) {
+    return;
+  }
+
+  for (uint8_t i = 0; i < sizeof(fields); i++) {
+    uint16_t age = telemetryAge(&transmitter::telemetryState, fields[i], txBoard.timeUs / 1000);
+    report->maxAge[i] = max(report->maxAge[i], age);
+  }
+
+  report->ageChecks++;
+  report->tripStale += !transmitter::tripTelemetryFresh(txBoard.timeUs / 1000);
+}
+
+// One loop() pass of the transmitter, with the ADC samples taken up to now.
+static void stepTransmitter() {
+  simBoard = &txBoard;
+
+  while (nextAdcSample <= txBoard.timeUs) {
+    uint16_t sample = (nextAdcChannel == ADC_SAMPLER_HALL) ? hallValue(nextAdcSample) : txBoard.pins[A1];
+    adcSamplerPush(nextAdcChannel, sample);
+    nextAdcChannel = (nextAdcChannel + 1) % ADC_SAMPLER_NUM_CHANNELS;
+    nextAdcSample += SIM_ADC_PERIOD_US;
+  }
+  txBoard.pins[A0] = hallValue(txBoard.timeUs);
+
+  transmitter::loop();
+  simAdvance(SIM_TX_LOOP_US);
+}
+
+// One loop() pass of the receiver, then the interrupts that fell in it.
+static void stepReceiver(SimReport *report) {
+  simBoard = &rxBoard;
+
+  uint64_t start = rxBoard.timeUs;
+  int speed = receiver::motorSpeed;
+
+  receiver::loop();
+  simAdvance(SIM_RX_LOOP_US);
+
+  // Only the failsafe changes the speed outside the interrupt handler.
+  if (receiver::motorSpeed != speed) {
+    report->failsafes++;
+  }
+  recordPulse(rxBoard.timeUs);
+
+  uint64_t end = rxBoard.timeUs;
+  for (size_t i = 0; i < pendingInterrupts.size(); ) {
+    SimInterrupt pending = pendingInterrupts[i];
+    if (pending.board != &rxBoard || pending.time > end) {
+      i++;
+      continue;
+    }
+    pendingInterrupts.erase(pendingInterrupts.begin() + i);
+
+    rxBoard.timeUs = max(pending.time, start);
+    unsigned long enables = rxBoard.interruptEnables;
+    if (rxBoard.interrupts[pending.interrupt] != NULL) {
+      rxBoard.interrupts[pending.interrupt]();
+    }
+    recordPulse(rxBoard.timeUs);
+
+    // Other interrupts wait until the handler enables them, or returns.
+    bool early = (rxBoard.interruptEnables != enables);
+    addMaskedWindow(rxBoard.timeUs, early ? SIM_RX_ISR_MASKED_US : SIM_RX_ISR_US);
+
+    // The handler took time from the loop.
+    end += SIM_RX_ISR_US;
+    rxBoard.timeUs = end;
+  }
+
+  answerVesc();
+}
+
+// WiFi channel n is 22 MHz wide around 2407 + 5n MHz.
+static void addWifi(double *noise, int wifiChannel, double level) {
+  int center = 7 + 5 * wifiChannel;
+  for (int channel = center - 11; channel <= center + 11; channel++) {
+    if (channel >= 0 && channel < SIM_RADIO_CHANNELS) {
+      noise[channel] = max(noise[channel], level);
+    }
+  }
+}
+
+static void noiseQuiet(double *noise) {
+  memset(noise, 0, sizeof(double) * SIM_RADIO_CHANNELS);
+}
+
+static void noiseWifi16(double *noise) {
+  noiseQuiet(noise);
+  addWifi(noise, 1, 0.3);
+  addWifi(noise, 6, 0.3);
+}
+
+static void noiseWifi1611(double *noise) {
+  noiseWifi16(noise);
+  addWifi(noise, 11, 0.3);
+}
+
+// Another link busy on the rendezvous channel.
+static void noiseRendezvous(double *noise) {
+  noiseWifi1611(noise);
+  noise[PROTOCOL_RENDEZVOUS_CHANNEL] = 0.5;
+}
+
+static void noiseBusy(double *noise) {
+  for (int channel = 0; channel < SIM_RADIO_CHANNELS; channel++) {
+    noise[channel] = (channel >= 30 && channel <= 34) ? 0.0 : 0.1;
+  }
+}
+
+// A strong interferer on and around the channel in use.
+static void noiseJammed(double *noise) {
+  noiseWifi16(noise);
+  for (int channel = transmitter::radioChannel - 3; channel <= transmitter::radioChannel + 3; channel++) {
+    if (channel >= 0 && channel < SIM_RADIO_CHANNELS) {
+      noise[channel] = 0.95;
+    }
+  }
+}
+
+static uint16_t hallValue(uint64_t time) {
+  if (hallOverride >= 0) {
+    return hallOverride;
+  }
+  if (time < scenarioStart) {
+    return hallSteps[0];
+  }
+  return hallSteps[((time - scenarioStart) / SIM_STEP_US) % numOfHallSteps];
+}
+
+static void recordPulse(uint64_t time) {
+  uint16_t pulse = servoOutputRead();
+
+  if (pulseEvents.empty() || pulseEvents.back().pulse != pulse) {
+    SimEvent event = { time, pulse };
+    pulseEvents.push_back(event);
+  }
+}
+
+// Write the low bytes of value big endian, as in VESC replies.
+static void putVescInt(uint8_t *p, int32_t value, uint8_t bytes) {
+  for (uint8_t i = 0; i < bytes; i++) {
+    p[i] = value >> (8 * (bytes - 1 - i));
+  }
+}
+
+// Answer COMM_GET_VALUES requests from the receiver, like a VESC would.
+static void answerVesc() {
+  while (!rxBoard.serialTx.empty()) {
+    uint8_t byte = rxBoard.serialTx.front();
+    rxBoard.serialTx.pop_front();
+
+    if (vescParserFeed(&vescRequests, byte) != VESC_PARSER_COMPLETE ||
+        vescRequests.payload[0] != VESC_COMM_GET_VALUES) {
+      continue;
+    }
+
+    uint8_t payload[54] = { VESC_COMM_GET_VALUES };
+    int32_t throttle = receiver::motorSpeed - PROTOCOL_THROTTLE_NEUTRAL;
+    int32_t rpm = throttle * 20;
+    int16_t voltage = 365;                            // 36.5 V
+    int32_t current = throttle * 6;                   // 0.01 A, 30 A at full throttle
+    int32_t tachometer = rxBoard.timeUs / 1000;
+    int16_t tempFet = 250 + rxBoard.timeUs / 100000;  // 0.1 C, warming 1 C per 10 s
+    int16_t duty = throttle * 2;                      // 0.001
+
+    // Fields at their offsets in the reply, big endian.
+    putVescInt(&payload[1], tempFet, 2);
+    putVescInt(&payload[3], tempFet + 50, 2);         // Motor temperature
+    putVescInt(&payload[5], current * 2, 4);          // Motor current
+    putVescInt(&payload[9], current, 4);              // Input current
+    putVescInt(&payload[21], duty, 2);
+    putVescInt(&payload[23], rpm, 4);
+    putVescInt(&payload[27], voltage, 2);
+    putVescInt(&payload[29], tachometer * 3, 4);      // Amp hours, 0.1 mAh
+    putVescInt(&payload[45], tachometer, 4);
+    putVescInt(&payload[49], tachometer, 4);          // Absolute tachometer
+
+    uint8_t packet[64];
+    uint8_t size = vescEncodePacket(packet, payload, sizeof(payload));
+    uint64_t time = rxBoard.timeUs + SIM_VESC_REPLY_US;
+
+    for (uint8_t i = 0; i < size; i++) {
+      SimSerialByte reply = { time + i * SIM_VESC_BYTE_US, packet[i] };
+      rxBoard.serialRx.push_back(reply);
+      addMaskedWindow(reply.availableAt, SIM_USART_ISR_US);
+    }
+  }
+}
+
+// Time from each hall step to the last pulse change within that step.
+static void measureLatencies(uint64_t end, SimReport *report) {
+  for (uint64_t step = scenarioStart + SIM_STEP_US; step + SIM_STEP_US <= end; step += SIM_STEP_US) {
+    uint64_t lastChange = 0;
+
+    for (size_t i = 0; i < pulseEvents.size(); i++) {
+      if (pulseEvents[i].time >= step && pulseEvents[i].time < step + SIM_STEP_US) {
+        lastChange = pulseEvents[i].time;
+      }
+    }
+
+    // No change, e.g. when released or the step stayed on the same pulse.
+    if (lastChange != 0) {
+      report->latencies.push_back((lastChange - step) / 1000.0);
+    }
+  }
+
+  std::sort(report->latencies.begin(), report->latencies.end());
+}
+
+// Place the servo pulse edges as Timer1 makes them: raised at the start of
+// each frame, lowered once the width latched at that start has passed. The
+// pin changes when the edge's interrupt handler gets to run, which waits
+// while another handler has interrupts off.
+static void measurePulses(uint64_t end, SimReport *report) {
+  uint64_t frame = servoOutputFrame();
+  uint64_t start = servoStart + ((scenarioStart - servoStart) / frame + 1) * frame;
+  size_t event = 0;
+
+  std::sort(maskedWindows.begin(), maskedWindows.end(),
+            [](const SimWindow &a, const SimWindow &b) { return a.start < b.start; });
+
+  for (; start + frame <= end; start += frame) {
+    while (event + 1 < pulseEvents.size() && pulseEvents[event + 1].time <= start) {
+      event++;
+    }
+    uint16_t pulse = pulseEvents[event].pulse;
+
+    report->pulseErrors.push_back((double)edgeDelay(start + pulse) - (double)edgeDelay(start));
+  }
+}
+
+static void addMaskedWindow(uint64_t start, uint64_t length) {
+  SimWindow window = { start, start + length };
+  maskedWindows.push_back(window);
+}
+
+// How long an interrupt raised at a time waits for handlers that have
+// interrupts off: the timer 0 overflow, and the recorded windows.
+static uint64_t edgeDelay(uint64_t time) {
+  uint64_t ready = time;
+  bool waited = true;
+
+  while (waited) {
+    uint64_t sinceOverflow = ready % SIM_TIMER0_US;
+    waited = false;
+
+    if (sinceOverflow < SIM_TIMER0_ISR_US) {
+      ready += SIM_TIMER0_ISR_US - sinceOverflow;
+      waited = true;
+    }
+
+    // Windows starting at most one radio handler back may still be open.
+    SimWindow key = { ready, ready };
+    size_t i = std::upper_bound(maskedWindows.begin(), maskedWindows.end(), key,
+                                [](const SimWindow &a, const SimWindow &b) { return a.start < b.start; }) - maskedWindows.begin();
+    while (i > 0 && maskedWindows[i - 1].start + SIM_RX_ISR_US >= ready) {
+      i--;
+      if (maskedWindows[i].end > ready) {
+        ready = maskedWindows[i].end;
+        waited = true;
+      }
+    }
+  }
+
+  return ready - time;
+}
+
+static double percentile(const std::vector<double> &values, double fraction) {
+  size_t index = fraction * (values.size() - 1) + 0.5;
+  return values[index];
+}
@@ -0,0 +1,7 @@
+/**
+ * @file   TaskScheduler.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Shared task scheduler library built for the host.
+ */
+#include "../../lib/TaskScheduler/TaskScheduler.cpp"
@@ -0,0 +1,57 @@
+/**
+ * @file   Transmitter.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Transmitter firmware built for the host. The sketch goes in its
+ *         own namespace so both firmwares can be linked into one program.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <Arduino.h>
+#include <U8g2lib.h>
+#include <Wire.h>
+#include <SPI.h>
+#include <EEPROM.h>
+#include <RF24.h>
+#include <printf.h>
+#include "VescUart.h"
+#include <EskProtocol.h>
+#include <LoopTiming.h>
+#include <TaskScheduler.h>
+#include "AdcSampler.h"
+#include "TextFormat.h"
+#include "TransmitScheduler.h"
+#include "ThrottleCurve.h"
+#include "LinkQuality.h"
+#include "ChannelScan.h"
+#include "SettingsStore.h"
+#include "SettingsTable.h"
+#include "Bitmap.h"
+#include "BitmapAssets.h"
+#include "BatteryModel.h"
+#include "Telemetry.h"
+#include "TripLog.h"
+#include "PowerManager.h"
+
+#include "../../transmitter/src/AdcSampler.cpp"
+#include "../../transmitter/src/TextFormat.cpp"
+#include "../../transmitter/src/TransmitScheduler.cpp"
+#include "../../transmitter/src/ThrottleCurve.cpp"
+#include "../../transmitter/src/LinkQuality.cpp"
+#include "../../transmitter/src/ChannelScan.cpp"
+#include "../../transmitter/src/SettingsStore.cpp"
+#include "../../transmitter/src/SettingsTable.cpp"
+#include "../../transmitter/src/Bitmap.cpp"
+#include "../../transmitter/src/BitmapAssets.cpp"
+#include "../../transmitter/src/BatteryModel.cpp"
+#include "../../transmitter/src/Telemetry.cpp"
+#include "../../transmitter/src/TripLog.cpp"
+#include "../../transmitter/src/PowerManager.cpp"
+
+namespace transmitter {
+#include "../../transmitter/src/main.cpp"
+}
@@ -0,0 +1,155 @@
+/**
+ * @file   Arduino.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Host stand-in for the Arduino core, running on the simulated board.
+ */
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "SimBoard.h"
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+#define F_CPU 16000000UL
+
+#define LOW  0
+#define HIGH 1
+
+#define INPUT        0
+#define OUTPUT       1
+#define INPUT_PULLUP 2
+
+#define CHANGE  1
+#define FALLING 2
+#define RISING  3
+
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define pgm_read_byte(addr)  (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)  (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define memcpy_P memcpy
+#define strlen_P strlen
+
+#define _BV(bit) (1 << (bit))
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : -1))
+#define digitalPinToPort(p)      (p)
+#define digitalPinToBitMask(p)   ((uint8_t)1)
+#define portOutputRegister(port) (simPortRegister(port))
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t value);
+int analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+
+void attachInterrupt(uint8_t interrupt, void (*handler)(), int mode);
+void detachInterrupt(uint8_t interrupt);
+void noInterrupts();
+void interrupts();
+
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+
+volatile uint8_t *simPortRegister(uint8_t pin);
+
+
+/**
+ * ****************************************************************************
+ * SERIAL
+ * ****************************************************************************
+ */
+
+class HardwareSerial {
+public:
+  void begin(unsigned long baud);
+  int available();
+  int read();
+  int availableForWrite();
+  size_t write(uint8_t value);
+  size_t write(const uint8_t *buffer, size_t size);
+  size_t print(const char *str);
+  size_t print(long value);
+  size_t println(const char *str);
+  size_t println(long value);
+  void flush();
+};
+
+extern HardwareSerial Serial;
+
+
+/**
+ * ****************************************************************************
+ * STRING
+ * ****************************************************************************
+ */
+
+// The part of the Arduino String the firmware used before TextFormat, on
+// the heap as in the core. Only the checks use it now, as the reference.
+class String {
+public:
+  String(const char *str = "");
+  String(const String &other);
+  explicit String(int value);
+  ~String();
+
+  String &operator=(const String &other);
+  friend String operator+(const String &left, const String &right);
+
+  unsigned int length() const;
+  void toCharArray(char *buffer, unsigned int size) const;
+
+private:
+  void assign(const char *left, const char *right);
+
+  char *text;
+};
+
+#endif /* ARDUINO_H */
@@ -0,0 +1,47 @@
+/**
+ * @file   EEPROM.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Host stand-in for the EEPROM library, backed by the board.
+ */
+#ifndef EEPROM_H
+#define EEPROM_H
+
+#include <Arduino.h>
+
+class EEPROMClass {
+public:
+  uint8_t read(int address) { return simBoard->eeprom[address % SIM_EEPROM_SIZE]; }
+  void update(int address, uint8_t value) {
+    if (read(address) != value) {
+      write(address, value);
+    }
+  }
+
+  // Writes after a power cut are lost; the one it happens during is torn.
+  void write(int address, uint8_t value) {
+    uint8_t *cell = &simBoard->eeprom[address % SIM_EEPROM_SIZE];
+    long n = simBoard->eepromWrites++;
+
+    if (simBoard->eepromPowerCut < 0 || n < simBoard->eepromPowerCut) {
+      *cell = value;
+    } else if (n == simBoard->eepromPowerCut) {
+      *cell = (*cell & ~simBoard->eepromTornMask) | (value & simBoard->eepromTornMask);
+    }
+  }
+  uint16_t length() { return SIM_EEPROM_SIZE; }
+
+  template<typename T> T &get(int address, T &t) {
+    memcpy(&t, &simBoard->eeprom[address], sizeof(T));
+    return t;
+  }
+
+  template<typename T> const T &put(int address, const T &t) {
+    memcpy(&simBoard->eeprom[address], &t, sizeof(T));
+    return t;
+  }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif /* EEPROM_H */
@@ -0,0 +1,155 @@
+/**
+ * @file   RF24.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Host stand-in for the RF24 library on a simulated radio channel.
+ *
+ * A write() is delivered to the listening radio with the same address and
+ * channel, attempt by attempt, each attempt lost with the probability set
+ * in simLink. Loss grows as the link margin (received power over
+ * sensitivity) shrinks: lower PA levels and faster data rates cost margin.
+ * Every attempt costs air time and retry delay on the writing
+ * board's clock, as the blocking write on real hardware does. Delivered
+ * packets raise the receiver's IRQ (wired to interrupt 0) after the link
+ * latency, and carry back the receiver's queued ack payload. powerUp()
+ * returns at once, as with the remote's build of the library; a packet
+ * started before the oscillator is up is never sent.
+ */
+#ifndef RF24_H
+#define RF24_H
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <Arduino.h>
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+#define SIM_RADIO_CHANNELS   126
+#define SIM_RADIO_FIFO_SIZE  3
+#define SIM_RADIO_MAX_PAYLOAD 32
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+typedef enum { RF24_PA_MIN = 0, RF24_PA_LOW, RF24_PA_HIGH, RF24_PA_MAX, RF24_PA_ERROR } rf24_pa_dbm_e;
+typedef enum { RF24_1MBPS = 0, RF24_2MBPS, RF24_250KBPS } rf24_datarate_e;
+
+// Simulated channel conditions.
+struct SimLink {
+  double loss;                          // Probability an attempt is lost, besides margin
+  double marginDb;                      // Link margin at PA_MAX and 1 Mbps
+  uint32_t latencyUs;                   // Delivery to receiver IRQ
+  double noise[SIM_RADIO_CHANNELS];     // Extra loss and carrier probability per channel
+
+  // Statistics
+  unsigned long attempts;
+  unsigned long attemptsLost;
+  unsigned long packets;
+  unsigned long packetsLost;
+  unsigned long unready;                // Writes before the oscillator was up
+};
+
+struct SimPayload {
+  uint64_t availableAt;
+  uint8_t size;
+  uint8_t data[SIM_RADIO_MAX_PAYLOAD];
+};
+
+class RF24 {
+public:
+  RF24(uint8_t cePin, uint8_t csnPin);
+
+  bool begin();
+  void printDetails() {}
+
+  void setPALevel(uint8_t level) { paLevel = level; }
+  uint8_t getPALevel() { return paLevel; }
+  bool setDataRate(rf24_datarate_e rate) { dataRate = rate; return true; }
+  rf24_datarate_e getDataRate() { return dataRate; }
+  void setRetries(uint8_t delay, uint8_t count) { retryDelay = delay & 0x0F; retryCount = count & 0x0F; }
+  void setChannel(uint8_t value) { channel = min(value, (uint8_t)(SIM_RADIO_CHANNELS - 1)); }
+  uint8_t getChannel() { return channel; }
+  void setAutoAck(bool enable) { (void)enable; }
+  void enableAckPayload() {}
+  void enableDynamicPayloads() {}
+  void maskIRQ(bool txOk, bool txFail, bool rxReady) { (void)txOk; (void)txFail; rxMasked = rxReady; }
+
+  void openWritingPipe(uint64_t address) { txAddress = address; }
+  void openReadingPipe(uint8_t pipe, uint64_t address) { if (pipe == 1) rxAddress = address; }
+  void startListening() { powerUp(); listening = true; ackPower = false; }
+  void stopListening() { listening = false; }
+  void powerDown() { powered = false; }
+  void powerUp();
+
+  bool write(const void *buffer, uint8_t size);
+  void startWrite(const void *buffer, uint8_t size, const bool multicast);
+  bool txStandBy() { return true; }
+  bool isAckPayloadAvailable();
+  bool available();
+  bool available(uint8_t *pipe);
+  uint8_t getDynamicPayloadSize();
+  void read(void *buffer, uint8_t size);
+  void writeAckPayload(uint8_t pipe, const void *buffer, uint8_t size);
+  void whatHappened(bool &txOk, bool &txFail, bool &rxReady);
+  void flush_tx() { ackQueue.clear(); txBusy = false; }
+  void flush_rx() { rxQueue.clear(); }
+  uint8_t getARC() { return lastArc; }
+  bool testRPD();
+  bool testCarrier() { return testRPD(); }
+
+  // Simulation state
+  SimBoard *board;
+  uint64_t txAddress;
+  uint64_t rxAddress;
+  uint8_t channel;
+  uint8_t paLevel;
+  rf24_datarate_e dataRate;
+  uint8_t retryDelay;
+  uint8_t retryCount;
+  uint8_t lastArc;
+  double lastPowerDb;                   // Received power of the last ack over -85 dBm
+  bool ackPower;                        // RPD holds the power of an ack
+  bool listening;
+  bool powered;
+  uint64_t readyAt;                     // Oscillator up after powerUp()
+  bool rxMasked;
+  bool txBusy;                          // Sending, the outcome known ahead
+  bool txAcked;
+  uint64_t txDoneAt;                    // Ack or last retry over
+  std::deque<SimPayload> rxQueue;   // Received, or acks received when writing
+  std::deque<SimPayload> ackQueue;  // Ack payloads to send back
+
+  RF24 *next;
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+extern SimLink simLink;
+
+// Reset channel conditions and statistics.
+void simLinkReset(double loss, double marginDb, uint32_t latencyUs);
+
+// Deliver an interrupt to a board at a point in time (implemented by the harness).
+void simScheduleInterrupt(SimBoard *board, uint8_t interrupt, uint64_t time);
+
+// Uniform random number in [0, 1).
+double simRandom();
+
+#endif /* RF24_H */
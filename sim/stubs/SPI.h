@@ -0,0 +1,18 @@
+/**
+ * @file   SPI.h
+ * @brief  Host stand-in, the radio stand-in does not use SPI.
+ */
+#ifndef SPI_H
+#define SPI_H
+
+#include <Arduino.h>
+
+class SPIClass {
+public:
+  void begin() {}
+  void usingInterrupt(uint8_t interrupt) { (void)interrupt; }
+};
+
+extern SPIClass SPI;
+
+#endif /* SPI_H */
@@ -0,0 +1,88 @@
+/**
+ * @file   SimBoard.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Simulated board state shared by the Arduino stand-in layers.
+ *
+ * Each firmware runs on its own SimBoard with its own clock, pins, EEPROM
+ * and serial port. The stand-in functions (millis(), analogRead(), ...)
+ * act on the board in simBoard, which the harness sets before calling into
+ * a firmware.
+ */
+#ifndef SIM_BOARD_H
+#define SIM_BOARD_H
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <stdint.h>
+#include <deque>
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+#define SIM_NUM_PINS       22
+#define SIM_NUM_INTERRUPTS 2
+#define SIM_EEPROM_SIZE    1024
+
+// Serial TX buffer of the Arduino core, one byte kept free.
+#define SIM_SERIAL_TX_BUFFER 63
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+// Byte on a serial line, readable from a point in time.
+struct SimSerialByte {
+  uint64_t availableAt;
+  uint8_t value;
+};
+
+struct SimBoard {
+  const char *name;
+  uint64_t timeUs;                  // Local clock
+
+  int pins[SIM_NUM_PINS];           // Digital level or analog value (0-1023)
+  void (*interrupts[SIM_NUM_INTERRUPTS])();
+  unsigned long interruptEnables;   // Calls to interrupts(), shows handlers that let others in
+
+  std::deque<SimSerialByte> serialRx;
+  std::deque<uint8_t> serialTx;     // Written, until taken off the line
+  unsigned long serialBaud;
+  unsigned long serialTxBlocked;    // Bytes written with the TX buffer full
+
+  uint8_t eeprom[SIM_EEPROM_SIZE];
+  unsigned long eepromWrites;       // Bytes written
+  long eepromPowerCut;              // Write that power is cut during, -1 for none
+  uint8_t eepromTornMask;           // Bits of the cut write that land
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+// Board that stand-in calls act on.
+extern SimBoard *simBoard;
+
+// Reset a board to power-on state.
+void simBoardReset(SimBoard *board, const char *name);
+
+// Advance the clock of the current board, e.g. for blocking calls.
+void simAdvance(uint64_t us);
+
+// Sleep the current board until its next interrupt (in the harness).
+void simSleep();
+
+#endif /* SIM_BOARD_H */
@@ -0,0 +1,74 @@
+/**
+ * @file   U8g2lib.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Host stand-in for U8g2. Drawing is discarded; each transfer of
+ *         tiles costs the I2C time of a real 128x32 SSD1306.
+ */
+#ifndef U8G2LIB_H
+#define U8G2LIB_H
+
+#include <Arduino.h>
+
+#define U8G2_R0       0
+#define U8X8_PIN_NONE 255
+
+extern const uint8_t u8g2_font_profont12_tr[];
+extern const uint8_t u8g2_font_profont22_tn[];
+extern const uint8_t u8g2_font_10x20_tr[];
+extern const uint8_t u8g2_font_helvR10_tr[];
+extern const uint8_t u8g2_font_logisoso22_tn[];
+
+class U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C;
+
+struct u8x8_struct {
+  U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C *display;
+};
+typedef struct u8x8_struct u8x8_t;
+
+// Send cnt tiles (8x8 pixels, 8 bytes each) to tile column x of page y.
+void u8x8_DrawTile(u8x8_t *u8x8, uint8_t x, uint8_t y, uint8_t cnt, uint8_t *tile_ptr);
+
+class U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C {
+public:
+  U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C(int rotation, int reset);
+
+  void initDisplay();
+  void setBusClock(uint32_t clock);
+  void setPowerSave(uint8_t enable);
+  void setContrast(uint8_t value);
+
+  u8x8_t *getU8x8() { return &u8x8; }
+  uint8_t getDisplayHeight() { return 32; }
+  void setBufferCurrTileRow(uint8_t row) { page = row; }
+  void clearBuffer();
+  uint8_t *getBufferPtr();
+  uint8_t getBufferTileWidth();
+  uint8_t getBufferCurrTileRow();
+  uint8_t getBufferTileHeight();
+
+  void setFont(const uint8_t *font);
+  void drawStr(int x, int y, const char *str);
+  void drawXBM(int x, int y, int w, int h, const uint8_t *bitmap);
+  void drawXBMP(int x, int y, int w, int h, const uint8_t *bitmap);
+  void drawPixel(int x, int y);
+  void drawHLine(int x, int y, int w);
+  void drawVLine(int x, int y, int h);
+  void drawFrame(int x, int y, int w, int h);
+  void drawRFrame(int x, int y, int w, int h, int r);
+  void drawBox(int x, int y, int w, int h);
+
+  // Simulation statistics
+  unsigned long pagesSent;                // Pages sent up to their last tile
+  uint16_t maxTransferUs;                 // Longest u8x8_DrawTile()
+
+private:
+  friend void u8x8_DrawTile(u8x8_t *u8x8, uint8_t x, uint8_t y, uint8_t cnt, uint8_t *tile_ptr);
+
+  u8x8_t u8x8;
+  uint32_t busClock;
+  uint8_t page;
+  uint8_t buffer[128];
+};
+
+#endif /* U8G2LIB_H */
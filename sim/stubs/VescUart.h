@@ -0,0 +1,27 @@
+/**
+ * @file   VescUart.h
+ * @brief  Host stand-in for VescUartControl. The simulated VESC answers on
+ *         the board's serial port.
+ */
+#ifndef VESC_UART_H
+#define VESC_UART_H
+
+#include <Arduino.h>
+
+#define SERIALIO Serial
+
+struct bldcMeasure {
+  float tempFetFiltered;
+  float tempMotorFiltered;
+  float avgMotorCurrent;
+  float avgInputCurrent;
+  float dutyCycleNow;
+  long rpm;
+  float inpVoltage;
+  float ampHours;
+  float ampHoursCharged;
+  long tachometer;
+  long tachometerAbs;
+};
+
+#endif /* VESC_UART_H */
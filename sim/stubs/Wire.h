@@ -0,0 +1,8 @@
+/**
+ * @file   Wire.h
+ * @brief  Host stand-in, the display stand-in does not use I2C.
+ */
+#ifndef WIRE_H
+#define WIRE_H
+#include <Arduino.h>
+#endif /* WIRE_H */
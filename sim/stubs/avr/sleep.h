@@ -0,0 +1,19 @@
+/**
+ * @file   sleep.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Host stand-in for the AVR sleep modes. Sleeping hands the board
+ *         to the harness, which advances its clock to the next interrupt.
+ */
+#ifndef AVR_SLEEP_H
+#define AVR_SLEEP_H
+
+#include "SimBoard.h"
+
+#define SLEEP_MODE_IDLE     0
+#define SLEEP_MODE_PWR_DOWN 2
+
+inline void set_sleep_mode(uint8_t mode) { (void)mode; }
+inline void sleep_mode() { simSleep(); }
+
+#endif /* AVR_SLEEP_H */
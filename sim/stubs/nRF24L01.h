@@ -0,0 +1,8 @@
+/**
+ * @file   nRF24L01.h
+ * @brief  Host stand-in, register names are not used by the simulation.
+ */
+#ifndef NRF24L01_H
+#define NRF24L01_H
+#include <RF24.h>
+#endif /* NRF24L01_H */
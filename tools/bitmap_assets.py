@@ -0,0 +1,280 @@
+#!/usr/bin/env python3
+"""
+Generate flash-resident bitmap tables for the transmitter display (see
+transmitter/src/Bitmap.h for the formats).
+
+  bitmap_assets.py [--invert] [--threshold N] -o OUTPUT IMAGE...
+
+Writes OUTPUT.h and OUTPUT.cpp with one struct bitmapAsset per image,
+named after the file: signal_connected.xbm becomes bitmapSignalConnected.
+Each image is stored PackBits compressed, or raw if that is not smaller.
+
+Images can be XBM, PBM (P1/P4) or PNG (non-interlaced). For PBM and XBM
+set bits are lit pixels; for PNG pixels brighter than the threshold are,
+or darker ones with --invert.
+
+  bitmap_assets.py -o transmitter/src/BitmapAssets transmitter/assets/*.xbm
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+import zlib
+
+FORMAT_RAW = 0
+FORMAT_PACKBITS = 1
+MAX_SIZE = 255
+
+
+class Image:
+    """Bitmap as rows of XBM bytes: LSB is the leftmost pixel."""
+
+    def __init__(self, width, height, pixels):
+        self.width = width
+        self.height = height
+        row_bytes = (width + 7) // 8
+        self.data = bytearray(row_bytes * height)
+        for y in range(height):
+            for x in range(width):
+                if pixels(x, y):
+                    self.data[y * row_bytes + x // 8] |= 1 << (x % 8)
+
+
+def read_xbm(path):
+    text = open(path).read()
+    width = int(re.search(r"#define\s+\w*width\s+(\d+)", text).group(1))
+    height = int(re.search(r"#define\s+\w*height\s+(\d+)", text).group(1))
+    body = text[text.index("{") + 1:text.index("}")]
+    data = [int(v, 16) for v in re.findall(r"0[xX][0-9a-fA-F]+", body)]
+    row_bytes = (width + 7) // 8
+    if len(data) != row_bytes * height:
+        raise ValueError("%s: expected %d bytes, found %d" % (path, row_bytes * height, len(data)))
+    return Image(width, height, lambda x, y: data[y * row_bytes + x // 8] & (1 << (x % 8)))
+
+
+def read_pbm(path):
+    raw = open(path, "rb").read()
+    tokens = re.sub(rb"#[^\n]*", b"", raw).split()
+    magic, width, height = tokens[0], int(tokens[1]), int(tokens[2])
+    if magic == b"P1":
+        bits = b"".join(tokens[3:])
+        return Image(width, height, lambda x, y: bits[y * width + x] == ord("1"))
+    if magic == b"P4":
+        # Binary data starts after the single whitespace following the height.
+        header = re.match(rb"P4(\s|#[^\n]*\n)+\d+(\s|#[^\n]*\n)+\d+\s", raw)
+        data = raw[header.end():]
+        row_bytes = (width + 7) // 8
+        return Image(width, height, lambda x, y: data[y * row_bytes + x // 8] & (0x80 >> (x % 8)))
+    raise ValueError("%s: unsupported PBM type %r" % (path, magic))
+
+
+def read_png(path, threshold, invert):
+    raw = open(path, "rb").read()
+    if raw[:8] != b"\x89PNG\r\n\x1a\n":
+        raise ValueError("%s: not a PNG" % path)
+
+    pos = 8
+    idat = b""
+    palette = None
+    while pos < len(raw):
+        length, kind = struct.unpack(">I4s", raw[pos:pos + 8])
+        chunk = raw[pos + 8:pos + 8 + length]
+        pos += 12 + length
+        if kind == b"IHDR":
+            width, height, depth, color, _, _, interlace = struct.unpack(">IIBBBBB", chunk)
+        elif kind == b"PLTE":
+            palette = [chunk[i:i + 3] for i in range(0, len(chunk), 3)]
+        elif kind == b"IDAT":
+            idat += chunk
+    if interlace:
+        raise ValueError("%s: interlaced PNG not supported" % path)
+
+    channels = {0: 1, 2: 3, 3: 1, 4: 2, 6: 4}[color]
+    bits_per_pixel = depth * channels
+    stride = (width * bits_per_pixel + 7) // 8
+    step = max(1, bits_per_pixel // 8)
+    data = zlib.decompress(idat)
+
+    # Undo the per-row filters.
+    rows = []
+    prev = bytearray(stride)
+    for y in range(height):
+        kind = data[y * (stride + 1)]
+        row = bytearray(data[y * (stride + 1) + 1:(y + 1) * (stride + 1)])
+        for i in range(stride):
+            a = row[i - step] if i >= step else 0
+            b = prev[i]
+            c = prev[i - step] if i >= step else 0
+            if kind == 1:
+                row[i] = (row[i] + a) & 0xFF
+            elif kind == 2:
+                row[i] = (row[i] + b) & 0xFF
+            elif kind == 3:
+                row[i] = (row[i] + (a + b) // 2) & 0xFF
+            elif kind == 4:
+                p = a + b - c
+                pa, pb, pc = abs(p - a), abs(p - b), abs(p - c)
+                row[i] = (row[i] + (a if pa <= pb and pa <= pc else b if pb <= pc else c)) & 0xFF
+        rows.append(row)
+        prev = row
+
+    def sample(x, y):
+        # Return (gray, alpha) scaled to 0-255.
+        row = rows[y]
+        if depth < 8:
+            bit = x * depth
+            value = (row[bit // 8] >> (8 - depth - bit % 8)) & ((1 << depth) - 1)
+            if color == 3:
+                r, g, b = palette[value]
+                return (r * 299 + g * 587 + b * 114) // 1000, 255
+            return value * 255 // ((1 << depth) - 1), 255
+        i = x * step
+        if color == 0:
+            return row[i], 255
+        if color == 4:
+            return row[i], row[i + 1]
+        if color == 3:
+            r, g, b = palette[row[i]]
+            return (r * 299 + g * 587 + b * 114) // 1000, 255
+        r, g, b = row[i], row[i + 1], row[i + 2]
+        alpha = row[i + 3] if color == 6 else 255
+        return (r * 299 + g * 587 + b * 114) // 1000, alpha
+
+    def lit(x, y):
+        gray, alpha = sample(x, y)
+        if alpha < 128:
+            return False
+        return (gray < threshold) if invert else (gray >= threshold)
+
+    return Image(width, height, lit)
+
+
+def packbits(data):
+    """Control byte c: c < 0x80 copies c + 1 literal bytes, otherwise the
+    next byte repeats (c & 0x7F) + 2 times."""
+    out = bytearray()
+    literal = bytearray()
+    i = 0
+    while i < len(data):
+        run = 1
+        while i + run < len(data) and data[i + run] == data[i] and run < 129:
+            run += 1
+        if run >= 2:
+            if literal:
+                out += bytes([len(literal) - 1]) + literal
+                literal = bytearray()
+            out += bytes([0x80 | (run - 2), data[i]])
+            i += run
+        else:
+            literal.append(data[i])
+            if len(literal) == 128:
+                out += bytes([len(literal) - 1]) + literal
+                literal = bytearray()
+            i += 1
+    if literal:
+        out += bytes([len(literal) - 1]) + literal
+    return bytes(out)
+
+
+def unpackbits(data, size):
+    out = bytearray()
+    i = 0
+    while len(out) < size:
+        control = data[i]
+        if control & 0x80:
+            out += bytes([data[i + 1]]) * ((control & 0x7F) + 2)
+            i += 2
+        else:
+            out += data[i + 1:i + 2 + control]
+            i += control + 2
+    return bytes(out[:size])
+
+
+def asset_name(path):
+    base = os.path.splitext(os.path.basename(path))[0]
+    return "bitmap" + "".join(part.capitalize() for part in re.split(r"[^0-9A-Za-z]+", base) if part)
+
+
+def format_bytes(data, indent="  "):
+    lines = []
+    for i in range(0, len(data), 12):
+        lines.append(indent + ", ".join("0x%02x" % b for b in data[i:i + 12]))
+    return ",\n".join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("-o", "--output", required=True, help="output path without extension")
+    parser.add_argument("--invert", action="store_true", help="PNG: light dark pixels")
+    parser.add_argument("--threshold", type=int, default=128, help="PNG: gray level 0-255 (default 128)")
+    parser.add_argument("images", nargs="+")
+    args = parser.parse_args()
+
+    assets = []
+    for path in args.images:
+        ext = os.path.splitext(path)[1].lower()
+        if ext == ".xbm":
+            image = read_xbm(path)
+        elif ext == ".pbm":
+            image = read_pbm(path)
+        elif ext == ".png":
+            image = read_png(path, args.threshold, args.invert)
+        else:
+            sys.exit("%s: unknown image type" % path)
+        if image.width > MAX_SIZE or image.height > MAX_SIZE:
+            sys.exit("%s: larger than %dx%d" % (path, MAX_SIZE, MAX_SIZE))
+
+        raw = bytes(image.data)
+        packed = packbits(raw)
+        assert unpackbits(packed, len(raw)) == raw
+        if len(packed) < len(raw):
+            assets.append((asset_name(path), path, image, FORMAT_PACKBITS, packed, len(raw)))
+        else:
+            assets.append((asset_name(path), path, image, FORMAT_RAW, raw, len(raw)))
+
+    guard = re.sub(r"([a-z])([A-Z])", r"\1_\2", os.path.basename(args.output)).upper() + "_H"
+    header = os.path.basename(args.output) + ".h"
+
+    with open(args.output + ".h", "w") as out:
+        out.write("/**\n")
+        out.write(" * @file   %s\n" % header)
+        out.write(" * @author Simon Lövgren, 2018\n")
+        out.write(" *\n")
+        out.write(" * @brief  Display bitmaps in flash.\n")
+        out.write(" *\n")
+        out.write(" * Generated by tools/bitmap_assets.py, do not edit.\n")
+        out.write(" */\n")
+        out.write("#ifndef %s\n#define %s\n\n" % (guard, guard))
+        out.write("#include \"Bitmap.h\"\n\n")
+        for name, path, image, fmt, data, size in assets:
+            out.write("extern const struct bitmapAsset %s; // %dx%d, %d of %d bytes\n"
+                      % (name, image.width, image.height, len(data), size))
+        out.write("\n#endif /* %s */\n" % guard)
+
+    with open(args.output + ".cpp", "w") as out:
+        out.write("/**\n")
+        out.write(" * @file   %s\n" % (os.path.basename(args.output) + ".cpp"))
+        out.write(" * @author Simon Lövgren, 2018\n")
+        out.write(" *\n")
+        out.write(" * @brief  Display bitmaps in flash.\n")
+        out.write(" *\n")
+        out.write(" * Generated by tools/bitmap_assets.py, do not edit.\n")
+        out.write(" */\n")
+        out.write("#include <Arduino.h>\n")
+        out.write("#include \"%s\"\n" % header)
+        for name, path, image, fmt, data, size in assets:
+            out.write("\n// %s\n" % os.path.basename(path))
+            out.write("static const uint8_t %sData[] PROGMEM = {\n%s\n};\n" % (name, format_bytes(data)))
+            out.write("const struct bitmapAsset %s PROGMEM = { %d, %d, %s, %sData };\n"
+                      % (name, image.width, image.height,
+                         "BITMAP_PACKBITS" if fmt == FORMAT_PACKBITS else "BITMAP_RAW", name))
+
+    for name, path, image, fmt, data, size in assets:
+        print("%-28s %3dx%-3d %-8s %4d bytes (raw %d)"
+              % (name, image.width, image.height, "packbits" if fmt == FORMAT_PACKBITS else "raw", len(data), size))
+
+
+if __name__ == "__main__":
+    main()
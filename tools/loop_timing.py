@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+"""
+Print loop timing frames sent by the transmitter or receiver when built
+with LOOP_TIMING (see lib/LoopTiming/LoopTiming.h for the frame layout).
+
+  loop_timing.py /dev/ttyUSB0      read a serial port (needs pyserial)
+  loop_timing.py capture.bin       read a file
+  loop_timing.py -                 read stdin
+"""
+
+import struct
+import sys
+
+SYNC = 0xA5
+BUCKETS = 8
+BUCKET_BASE_US = 128
+STAGE_SIZE = 8 + 2 * BUCKETS
+MAX_STAGES = 4
+
+SOURCES = {
+    1: ("Transmitter", ["Loop", "Throttle", "Transmit", "Display"]),
+    2: ("Receiver", ["Loop", "VESC", "Radio IRQ", "Output"]),
+}
+
+
+def crc8(data):
+    """CRC-8, polynomial 0x07, as protocolCrc8()."""
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def bucket_label(index):
+    if index == 0:
+        return "<%d" % BUCKET_BASE_US
+    if index == BUCKETS - 1:
+        return ">=%d" % (BUCKET_BASE_US << (index - 1))
+    return "<%d" % (BUCKET_BASE_US << index)
+
+
+def decode(frame):
+    """Return (source, stages) of a complete frame, or None if invalid."""
+    source, count = frame[1], frame[2]
+    if crc8(frame[1:-1]) != frame[-1]:
+        return None
+
+    stages = []
+    for i in range(count):
+        fields = struct.unpack_from("<%dH" % (4 + BUCKETS), frame, 3 + i * STAGE_SIZE)
+        stages.append({
+            "count": fields[0],
+            "min": fields[1],
+            "max": fields[2],
+            "avg": fields[3],
+            "histogram": fields[4:],
+        })
+    return source, stages
+
+
+def frames(stream, follow=False):
+    """Yield complete frames found in a byte stream.
+
+    With follow set, an empty read is a read timeout on a serial port and
+    reading goes on; otherwise it is the end of the file.
+    """
+    buffer = bytearray()
+    while True:
+        data = stream.read(64)
+        if not data:
+            if follow:
+                continue
+            return
+        buffer.extend(data)
+
+        while True:
+            start = buffer.find(bytes([SYNC]))
+            if start < 0:
+                buffer.clear()
+                break
+            del buffer[:start]
+            if len(buffer) < 3:
+                break
+
+            count = buffer[2]
+            if count == 0 or count > MAX_STAGES:
+                del buffer[0]
+                continue
+
+            size = 4 + count * STAGE_SIZE
+            if len(buffer) < size:
+                break
+
+            frame = bytes(buffer[:size])
+            if decode(frame) is None:
+                # Sync byte inside other data, look for the next one.
+                del buffer[0]
+                continue
+
+            del buffer[:size]
+            yield frame
+
+
+def print_frame(source, stages):
+    name, stage_names = SOURCES.get(source, ("Source %d" % source, []))
+    print(name)
+    print("  %-10s %6s %7s %7s %7s  %s" % ("stage", "count", "min us", "avg us", "max us",
+                                          " ".join("%6s" % bucket_label(i) for i in range(BUCKETS))))
+    for i, stage in enumerate(stages):
+        label = stage_names[i] if i < len(stage_names) else "Stage %d" % i
+        print("  %-10s %6d %7d %7d %7d  %s" % (label, stage["count"], stage["min"], stage["avg"],
+                                              stage["max"], " ".join("%6d" % n for n in stage["histogram"])))
+    sys.stdout.flush()
+
+
+def is_port(path):
+    return path.startswith("/dev/") or path.upper().startswith("COM")
+
+
+def open_input(path):
+    if path == "-":
+        return sys.stdin.buffer
+    if is_port(path):
+        import serial
+        return serial.Serial(path, 115200, timeout=1)
+    return open(path, "rb")
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(__doc__.strip())
+        return 1
+
+    path = sys.argv[1]
+    for frame in frames(open_input(path), is_port(path)):
+        print_frame(*decode(frame))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,189 @@
+#!/usr/bin/env python3
+"""
+Decode the record stream sent by the receiver when built with
+TELEMETRY_STREAM (see receiver/src/TelemetryStream.h for the layout).
+
+  telemetry_stream.py /dev/ttyUSB0      read a serial port (needs pyserial)
+  telemetry_stream.py capture.bin       read a file
+  telemetry_stream.py -                 read stdin
+
+Prints one CSV line per record, and a summary with the records dropped
+(sequence gaps) and corrupt frames when the input ends or on Ctrl-C.
+"""
+
+import struct
+import sys
+
+THROTTLE, VESC, LINK = 1, 2, 3
+EVENTS = {0: "link_changed", 1: "failsafe", 2: "vesc_timeout", 3: "first_packet"}
+
+COLUMNS = ["time_ms", "seq", "type",
+           "throttle", "keepalive_ms",
+           "rpm", "voltage_v", "input_current_a", "motor_current_a", "duty",
+           "temp_fet_c", "temp_motor_c", "amp_hours", "amp_hours_charged", "tachometer_abs", "fault",
+           "event", "data_rate", "channel"]
+
+
+def crc8(data):
+    """CRC-8, polynomial 0x07, as protocolCrc8()."""
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def cobs_decode(frame):
+    out = bytearray()
+    i = 0
+    while i < len(frame):
+        code = frame[i]
+        if code == 0 or i + code > len(frame) + 1:
+            return None
+        out += frame[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(frame):
+            out.append(0)
+    return bytes(out)
+
+
+def decode(record):
+    """Return a dict of the record's columns, or None if invalid."""
+    if len(record) < 7 or crc8(record[:-1]) != record[-1]:
+        return None
+
+    kind, seq, time = struct.unpack_from("<BBI", record)
+    body = record[6:-1]
+    row = {"time_ms": time, "seq": seq}
+
+    if kind == THROTTLE and len(body) == 4:
+        row["type"] = "throttle"
+        row["throttle"], row["keepalive_ms"] = struct.unpack("<HH", body)
+    elif kind == VESC and len(body) == 25:
+        fields = struct.unpack("<iHhhhhhHHIB", body)
+        row["type"] = "vesc"
+        row["rpm"] = fields[0]
+        row["voltage_v"] = fields[1] / 100.0
+        row["input_current_a"] = fields[2] / 100.0
+        row["motor_current_a"] = fields[3] / 100.0
+        row["duty"] = fields[4] / 1000.0
+        row["temp_fet_c"] = fields[5] / 10.0
+        row["temp_motor_c"] = fields[6] / 10.0
+        row["amp_hours"] = fields[7] / 100.0
+        row["amp_hours_charged"] = fields[8] / 100.0
+        row["tachometer_abs"] = fields[9]
+        row["fault"] = fields[10]
+    elif kind == LINK and len(body) == 3:
+        row["type"] = "link"
+        row["event"] = EVENTS.get(body[0], body[0])
+        row["data_rate"], row["channel"] = body[1], body[2]
+    else:
+        return None
+    return row
+
+
+def records(stream, stats, follow=False):
+    """Yield decoded records found in a byte stream.
+
+    With follow set, an empty read is a read timeout on a serial port and
+    reading goes on; otherwise it is the end of the file.
+    """
+    frame = bytearray()
+    synced = False
+    while True:
+        data = stream.read(64)
+        if not data:
+            if follow:
+                continue
+            return
+        for byte in data:
+            if byte != 0:
+                frame.append(byte)
+                continue
+            # The first frame is likely cut, skip it.
+            if synced and frame:
+                record = cobs_decode(bytes(frame))
+                row = decode(record) if record else None
+                if row is None:
+                    stats["corrupt"] += 1
+                else:
+                    yield row
+            synced = True
+            frame.clear()
+
+
+def percentile(values, fraction):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(fraction * len(values)))]
+
+
+def summary(stats, counts, intervals, vesc):
+    out = sys.stderr
+    total = sum(counts.values())
+    print(file=out)
+    print("records: %d (%s)" % (total, ", ".join("%s %d" % kv for kv in sorted(counts.items()))), file=out)
+    print("dropped: %d (%.1f%%), corrupt frames: %d"
+          % (stats["dropped"], 100.0 * stats["dropped"] / max(1, total + stats["dropped"]), stats["corrupt"]), file=out)
+    if intervals:
+        print("throttle interval ms: p50 %d, p99 %d, max %d"
+              % (percentile(intervals, 0.5), percentile(intervals, 0.99), max(intervals)), file=out)
+    if vesc:
+        print("voltage %.2f-%.2f V, max input current %.1f A, max motor current %.1f A, max FET %.1f C, max motor %.1f C"
+              % (min(r["voltage_v"] for r in vesc), max(r["voltage_v"] for r in vesc),
+                 max(r["input_current_a"] for r in vesc), max(r["motor_current_a"] for r in vesc),
+                 max(r["temp_fet_c"] for r in vesc), max(r["temp_motor_c"] for r in vesc)), file=out)
+
+
+def is_port(path):
+    return path.startswith("/dev/") or path.upper().startswith("COM")
+
+
+def open_input(path):
+    if path == "-":
+        return sys.stdin.buffer
+    if is_port(path):
+        import serial
+        return serial.Serial(path, 115200, timeout=1)
+    return open(path, "rb")
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(__doc__.strip())
+        return 1
+
+    stats = {"dropped": 0, "corrupt": 0}
+    counts = {}
+    intervals = []
+    vesc = []
+    last_seq = None
+    last_throttle = None
+
+    print(",".join(COLUMNS))
+    try:
+        path = sys.argv[1]
+        for row in records(open_input(path), stats, is_port(path)):
+            if last_seq is not None:
+                stats["dropped"] += (row["seq"] - last_seq - 1) & 0xFF
+            last_seq = row["seq"]
+            counts[row["type"]] = counts.get(row["type"], 0) + 1
+
+            if row["type"] == "throttle":
+                if last_throttle is not None:
+                    intervals.append(row["time_ms"] - last_throttle)
+                last_throttle = row["time_ms"]
+            elif row["type"] == "vesc":
+                vesc.append(row)
+
+            print(",".join(str(row.get(column, "")) for column in COLUMNS))
+            sys.stdout.flush()
+    except KeyboardInterrupt:
+        pass
+
+    summary(stats, counts, intervals, vesc)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
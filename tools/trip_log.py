@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""
+Decode the trip log sent by the transmitter when built with
+TRIP_LOG_SERIAL (see transmitter/src/TripLog.h for the layout).
+
+  trip_log.py /dev/ttyUSB0      request the log from a serial port (needs pyserial)
+  trip_log.py capture.txt       read a saved dump
+  trip_log.py -                 read stdin
+
+Prints the samples as CSV, oldest first, followed by a summary per trip.
+Samples standing still are not logged, so the time is riding time.
+"""
+
+import struct
+import sys
+
+BLOCKS = 16
+BLOCK_SIZE = 32
+HEADER_SIZE = 8
+PERIOD_S = 5.0
+SEQ_MASK = 0x7FFF
+SEQ_TRIP_FLAG = 0x8000
+
+
+def crc8(data):
+    """CRC-8, polynomial 0x07, as protocolCrc8()."""
+    crc = 0
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x07) & 0xFF if crc & 0x80 else (crc << 1) & 0xFF
+    return crc
+
+
+def signed(value, bits):
+    return value - (1 << bits) if value & (1 << (bits - 1)) else value
+
+
+def read_lines(path):
+    """Return the dump lines, asking the remote for them on a serial port."""
+    if path == "-":
+        return sys.stdin.read().splitlines()
+    if path.startswith("/dev/") or path.upper().startswith("COM"):
+        import serial
+        port = serial.Serial(path, 115200, timeout=2)
+        port.reset_input_buffer()
+        port.write(b"L")
+        lines = []
+        while True:
+            line = port.readline().decode("ascii", "replace").strip()
+            if not line:
+                break
+            lines.append(line)
+            if line.startswith("S "):
+                break
+        return lines
+    return open(path).read().splitlines()
+
+
+def parse(lines):
+    """Return ({block: bytes}, stats or None) from the dump lines."""
+    blocks = {}
+    stats = None
+    for line in lines:
+        line = line.strip()
+        if line.startswith("L") and " " in line:
+            index, data = line[1:].split(" ", 1)
+            data = bytes.fromhex(data)
+            if len(data) == BLOCK_SIZE:
+                blocks[int(index, 16)] = data
+        elif line.startswith("S "):
+            values = [int(v) for v in line.split()[1:5]]
+            stats = {
+                "max_speed": values[0] / 10.0,
+                "max_erpm": values[1],
+                "min_voltage": values[2] / 100.0,
+                "max_voltage": values[3] / 100.0,
+            }
+    return blocks, stats
+
+
+def decode_block(data):
+    """Return (seq, trip_start, samples) of a block, or None if invalid."""
+    if crc8(data[:HEADER_SIZE - 1]) != data[HEADER_SIZE - 1]:
+        return None
+
+    seq, speed, voltage, amp_hours = struct.unpack_from("<HBHH", data)
+    samples = [(speed, voltage, amp_hours)]
+    for offset in range(HEADER_SIZE, BLOCK_SIZE, 2):
+        delta, = struct.unpack_from("<H", data, offset)
+        if delta & 0x8000:
+            break
+        speed += signed((delta >> 9) & 0x3F, 6)
+        voltage += signed((delta >> 4) & 0x1F, 5)
+        amp_hours = (amp_hours + (delta & 0x0F)) & 0xFFFF
+        samples.append((speed, voltage, amp_hours))
+    return seq & SEQ_MASK, bool(seq & SEQ_TRIP_FLAG), samples
+
+
+def trips(blocks):
+    """Return a list of trips, each a list of (speed, voltage, amp hours)."""
+    decoded = [b for b in (decode_block(data) for data in blocks.values()) if b]
+    if not decoded:
+        return []
+
+    # Oldest first: order by distance back from the newest sequence number.
+    newest = decoded[0][0]
+    for seq, _, _ in decoded:
+        if ((seq - newest) & SEQ_MASK) < SEQ_MASK // 2 and seq != newest:
+            newest = seq
+    decoded.sort(key=lambda b: -((newest - b[0]) & SEQ_MASK))
+
+    result = []
+    previous = None
+    for seq, trip_start, samples in decoded:
+        # A missing block means the start of that trip was overwritten.
+        if trip_start or not result or previous is None or ((seq - previous) & SEQ_MASK) != 1:
+            result.append([])
+        result[-1].extend(samples)
+        previous = seq
+    return result
+
+
+def main():
+    if len(sys.argv) != 2:
+        print(__doc__.strip())
+        return 1
+
+    blocks, stats = parse(read_lines(sys.argv[1]))
+    logged = trips(blocks)
+
+    print("trip,ride_time_s,speed_kmh,voltage_v,amp_hours")
+    for number, samples in enumerate(logged, 1):
+        for i, (speed, voltage, amp_hours) in enumerate(samples):
+            print("%d,%.0f,%.1f,%.1f,%.2f" % (number, i * PERIOD_S, speed / 2.0, voltage / 10.0, amp_hours / 100.0))
+
+    print(file=sys.stderr)
+    for number, samples in enumerate(logged, 1):
+        speeds = [s[0] / 2.0 for s in samples]
+        voltages = [s[1] / 10.0 for s in samples]
+        used = (samples[-1][2] - samples[0][2]) / 100.0
+        print("trip %d: %.0f s riding, max %.1f km/h, avg %.1f km/h, %.1f-%.1f V, %.2f Ah"
+              % (number, (len(samples) - 1) * PERIOD_S, max(speeds), sum(speeds) / len(speeds),
+                 min(voltages), max(voltages), used), file=sys.stderr)
+    if stats:
+        print("since power on: max %.1f km/h, max %d erpm, %.2f-%.2f V"
+              % (stats["max_speed"], stats["max_erpm"], stats["min_voltage"], stats["max_voltage"]),
+              file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
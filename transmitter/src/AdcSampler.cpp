@@ -0,0 +1,143 @@
+/**
+ * @file   AdcSampler.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Interrupt-driven, free-running ADC sampler.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <Arduino.h>
+#include "AdcSampler.h"
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+// Ring buffer with running sum for one channel.
+struct adcFilter {
+  uint16_t samples[ADC_SAMPLER_FILTER_LENGTH];
+  uint16_t sum;
+  uint8_t index;
+};
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE VARIABLES
+ * ****************************************************************************
+ */
+
+static volatile struct adcFilter filters[ADC_SAMPLER_NUM_CHANNELS];
+static volatile uint16_t sampleCount;
+
+// In free-running mode the conversion in progress when the ISR fires was
+// started with the previous multiplexer setting, so track both.
+static volatile uint8_t convertingChannel;
+static volatile uint8_t pendingChannel;
+
+
+/**
+ * ****************************************************************************
+ * INTERFACE FUNCTIONS
+ * ****************************************************************************
+ */
+
+void adcSamplerBegin() {
+#if defined(__AVR__)
+  // Stop any free-running conversions and their interrupt, so neither
+  // the ISR nor an auto-triggered ADSC gets in the way of the blocking
+  // reads below, and enable the ADC again if it was powered down.
+  ADCSRA = 0;
+  ADCSRA = _BV(ADEN) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+#endif
+
+  // Prefill filters so the first readings are valid immediately.
+  for (uint8_t channel = 0; channel < ADC_SAMPLER_NUM_CHANNELS; channel++) {
+    uint16_t sample = analogRead(A0 + channel);
+    for (uint8_t i = 0; i < ADC_SAMPLER_FILTER_LENGTH; i++) {
+      adcSamplerPush(channel, sample);
+    }
+  }
+  sampleCount = 0;
+
+#if defined(__AVR__)
+  noInterrupts();
+  // The first two conversions both use the hall channel; the ISR starts
+  // alternating from there.
+  convertingChannel = ADC_SAMPLER_HALL;
+  pendingChannel = ADC_SAMPLER_HALL;
+
+  // AVcc reference, start on the hall sensor channel.
+  ADMUX = _BV(REFS0) | ADC_SAMPLER_HALL;
+  // Free-running trigger source.
+  ADCSRB = 0;
+  // Enable, start, auto trigger, interrupt, prescaler 128.
+  ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+  interrupts();
+#endif
+}
+
+void adcSamplerEnd() {
+#if defined(__AVR__)
+  ADCSRA = 0;
+#endif
+}
+
+void adcSamplerPush(uint8_t channel, uint16_t sample) {
+  volatile struct adcFilter *filter = &filters[channel];
+
+  filter->sum -= filter->samples[filter->index];
+  filter->sum += sample;
+  filter->samples[filter->index] = sample;
+  filter->index = (filter->index + 1) & (ADC_SAMPLER_FILTER_LENGTH - 1);
+
+  sampleCount++;
+}
+
+uint16_t adcSamplerRead(uint8_t channel) {
+  uint16_t sum;
+
+  noInterrupts();
+  sum = filters[channel].sum;
+  interrupts();
+
+  return sum >> ADC_SAMPLER_FILTER_SHIFT;
+}
+
+uint16_t adcSamplerCount() {
+  uint16_t count;
+
+  noInterrupts();
+  count = sampleCount;
+  interrupts();
+
+  return count;
+}
+
+
+/**
+ * ****************************************************************************
+ * INTERRUPT HANDLERS
+ * ****************************************************************************
+ */
+
+#if defined(__AVR__)
+ISR(ADC_vect) {
+  uint16_t sample = ADC;
+
+  adcSamplerPush(convertingChannel, sample);
+
+  // The next conversion has already started on pendingChannel; select the
+  // channel for the one after that.
+  convertingChannel = pendingChannel;
+  pendingChannel = (pendingChannel + 1) % ADC_SAMPLER_NUM_CHANNELS;
+  ADMUX = _BV(REFS0) | pendingChannel;
+}
+#endif
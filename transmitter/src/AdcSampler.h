@@ -0,0 +1,79 @@
+/**
+ * @file   AdcSampler.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Interrupt-driven, free-running ADC sampler for the hall sensor and
+ *         battery measurement inputs.
+ *
+ * The ADC runs in free-running mode with a /128 prescaler, giving a fixed
+ * conversion rate of F_CPU / 128 / 13 (9615 Hz at 16 MHz). Conversions
+ * alternate between the two channels, so each channel is sampled at half
+ * that rate. Every sample is pushed into a per-channel ring buffer with a
+ * running sum, so reading the filtered value is a single (atomic) load and
+ * a shift.
+ */
+#ifndef ADC_SAMPLER_H
+#define ADC_SAMPLER_H
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <stdint.h>
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+// Number of channels sampled (alternating).
+#define ADC_SAMPLER_NUM_CHANNELS  2
+
+// Samples averaged per channel. Must be a power of two.
+#define ADC_SAMPLER_FILTER_SHIFT  3
+#define ADC_SAMPLER_FILTER_LENGTH (1 << ADC_SAMPLER_FILTER_SHIFT)
+
+// Conversion rate of the ADC (all channels), and rate per channel.
+#define ADC_SAMPLER_RATE_HZ         (F_CPU / 128UL / 13UL)
+#define ADC_SAMPLER_CHANNEL_RATE_HZ (ADC_SAMPLER_RATE_HZ / ADC_SAMPLER_NUM_CHANNELS)
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+// Sampled channels. Value is the ADC multiplexer input (A0 = 0, A1 = 1).
+enum adcSamplerChannel {
+  ADC_SAMPLER_HALL    = 0,
+  ADC_SAMPLER_BATTERY = 1
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+// Prefill the filters with a blocking reading and start free-running sampling.
+// Stops the sampler first if it is running.
+void adcSamplerBegin();
+
+// Stop sampling and power down the ADC.
+void adcSamplerEnd();
+
+// Push a new sample for a channel into its filter (called from the ADC ISR).
+void adcSamplerPush(uint8_t channel, uint16_t sample);
+
+// Return the filtered (averaged) value of a channel, 0-1023.
+uint16_t adcSamplerRead(uint8_t channel);
+
+// Return the number of samples taken since start (wraps).
+uint16_t adcSamplerCount();
+
+#endif /* ADC_SAMPLER_H */
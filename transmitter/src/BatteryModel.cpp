@@ -0,0 +1,175 @@
+/**
+ * @file   BatteryModel.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Board battery state of charge from pack voltage and current.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <Arduino.h>
+#include "BatteryModel.h"
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+struct batteryChemistry {
+  uint8_t resistance; // Internal resistance per series cell, mOhm
+  uint8_t soc[BATTERY_MODEL_POINTS];
+};
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE VARIABLES
+ * ****************************************************************************
+ */
+
+// Interpolated from typical 0.2C discharge curves, cell voltage (mV) at
+// 0, 10, ... 100 %:
+//   Li-ion (NMC 18650): 3000 3450 3550 3620 3680 3750 3830 3920 4000 4080 4190
+//   LiPo:               3270 3690 3730 3770 3790 3820 3870 3930 4000 4080 4200
+// Resistances are for a typical 4P 18650 pack and a 5 Ah LiPo, wiring included.
+static const struct batteryChemistry chemistries[] PROGMEM = {
+  { 15, {
+      0,   1,   2,   2,   3,   4,   5,   5,   6,   7,   7,   8,   9,  10,  10,  11,
+     12,  12,  13,  14,  15,  15,  16,  17,  17,  18,  19,  20,  21,  24,  28,  31,
+     34,  37,  41,  45,  50,  54,  59,  64,  69,  75,  80,  85,  89,  94,  98, 102,
+    106, 110, 114, 118, 122, 126, 129, 133, 136, 140, 144, 148, 152, 156, 160, 164,
+    168, 172, 176, 180, 183, 186, 189, 192, 195, 197, 200, 200, 200, 200, 200, 200,
+  } },
+  { 6, {
+      0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+      0,   0,   1,   2,   3,   4,   4,   5,   6,   7,   7,   8,   9,  10,  10,  11,
+     12,  13,  13,  14,  15,  16,  16,  17,  18,  19,  20,  23,  31,  39,  47,  55,
+     66,  81,  92, 102, 108, 114, 121, 126, 131, 137, 142, 146, 151, 155, 160, 164,
+    168, 172, 176, 180, 183, 185, 188, 191, 193, 196, 199, 200, 200, 200, 200, 200,
+  } }
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+static uint16_t lookup(uint8_t type, int32_t cellMillivolts);
+static void adaptResistance(struct batteryModel *model, int16_t cellMillivolts, int16_t currentCentiamps);
+
+
+/**
+ * ****************************************************************************
+ * INTERFACE FUNCTIONS
+ * ****************************************************************************
+ */
+
+void batteryModelBegin(struct batteryModel *model, uint8_t type, uint8_t cells) {
+  model->type = min(type, (uint8_t)BATTERY_LIPO);
+  model->cells = cells;
+  model->cellScale = (cells > 0) ? 65536UL / cells : 0;
+  model->sagScale = (pgm_read_byte(&chemistries[model->type].resistance) * 256 + 50) / 100;
+  model->sagMin = model->sagScale / 2;
+  model->sagMax = min(model->sagScale * 4, 255);
+  model->primed = false;
+  model->filtered = 0;
+}
+
+void batteryModelUpdate(struct batteryModel *model, uint16_t packMillivolts, int16_t currentCentiamps) {
+  if (model->cells == 0) {
+    return;
+  }
+
+  int16_t cellMillivolts = ((uint32_t)packMillivolts * model->cellScale) >> 16;
+
+  if (model->primed) {
+    adaptResistance(model, cellMillivolts, currentCentiamps);
+  }
+  model->lastCellMillivolts = cellMillivolts;
+  model->lastCurrent = currentCentiamps;
+
+  int32_t restMillivolts = cellMillivolts + (((int32_t)currentCentiamps * model->sagScale) >> 8);
+
+  // Same scale as filtered.
+  uint16_t estimate = lookup(model->type, restMillivolts);
+
+  if (model->primed == false) {
+    model->filtered = estimate;
+    model->primed = true;
+  } else {
+    model->filtered += ((int32_t)estimate - model->filtered) >> BATTERY_MODEL_FILTER_SHIFT;
+  }
+}
+
+uint16_t batteryModelSoc(const struct batteryModel *model) {
+  return ((uint32_t)model->filtered * 5) >> 8;
+}
+
+uint16_t batteryModelResistance(const struct batteryModel *model) {
+  return ((uint16_t)model->sagScale * 1000) >> 8;
+}
+
+uint16_t batteryModelLookup(uint8_t type, uint16_t cellMillivolts) {
+  return ((uint32_t)lookup(min(type, (uint8_t)BATTERY_LIPO), cellMillivolts) * 5) >> 8;
+}
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE FUNCTIONS
+ * ****************************************************************************
+ */
+
+// State of charge (0.5 %) scaled by 2^8.
+static uint16_t lookup(uint8_t type, int32_t cellMillivolts) {
+  const uint8_t *soc = chemistries[type].soc;
+
+  if (cellMillivolts <= BATTERY_MODEL_BASE_MV) {
+    return pgm_read_byte(&soc[0]) << 8;
+  }
+
+  uint16_t offset = min(cellMillivolts - BATTERY_MODEL_BASE_MV, (int32_t)(BATTERY_MODEL_POINTS - 1) << BATTERY_MODEL_STEP_SHIFT);
+  uint8_t index = offset >> BATTERY_MODEL_STEP_SHIFT;
+  uint8_t fraction = offset & ((1 << BATTERY_MODEL_STEP_SHIFT) - 1);
+
+  uint16_t low = pgm_read_byte(&soc[index]);
+  if (fraction == 0) {
+    return low << 8;
+  }
+  int16_t step = pgm_read_byte(&soc[index + 1]) - low;
+
+  return (low << 8) + ((step * fraction) << (8 - BATTERY_MODEL_STEP_SHIFT));
+}
+
+// Compare the voltage change over a large current step with what the
+// resistance predicts, and move the resistance towards the measurement.
+// The correction is a fixed fraction of the difference, which is less than
+// the full correction for steps up to 2^(8 + BATTERY_MODEL_ADAPT_SHIFT)
+// centiamps, so it never overshoots for realistic currents.
+static void adaptResistance(struct batteryModel *model, int16_t cellMillivolts, int16_t currentCentiamps) {
+  int16_t currentStep = currentCentiamps - model->lastCurrent;
+
+  if (currentStep > -BATTERY_MODEL_ADAPT_STEP_CA && currentStep < BATTERY_MODEL_ADAPT_STEP_CA) {
+    return;
+  }
+
+  int16_t predicted = ((int32_t)currentStep * model->sagScale) >> 8;
+  int16_t measured = model->lastCellMillivolts - cellMillivolts;
+
+  // Compare magnitudes of the drop (or rise, when the current falls).
+  int16_t difference = (currentStep > 0) ? measured - predicted : predicted - measured;
+
+  if (difference > -BATTERY_MODEL_ADAPT_MARGIN_MV && difference < BATTERY_MODEL_ADAPT_MARGIN_MV) {
+    return;
+  }
+
+  int16_t sagScale = model->sagScale + (difference >> BATTERY_MODEL_ADAPT_SHIFT);
+  model->sagScale = constrain(sagScale, model->sagMin, model->sagMax);
+}
@@ -0,0 +1,112 @@
+/**
+ * @file   BatteryModel.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Board battery state of charge from pack voltage and current.
+ *
+ * The pack voltage is divided into a cell voltage, and the voltage sag
+ * under load is added back using the input current and the internal
+ * resistance per series cell. The resistance starts at a typical value for
+ * the chemistry and is adjusted whenever the current steps by more than
+ * BATTERY_MODEL_ADAPT_STEP_CA, by a fraction of the difference between the
+ * voltage step measured and the one it predicts.
+ *
+ * The rest voltage is looked up in
+ * a discharge curve for the chemistry, tabulated every 16 mV so a lookup
+ * is an index, a mask and one interpolation. The result is smoothed with
+ * an exponential filter (time constant BATTERY_MODEL_FILTER_SHIFT updates).
+ *
+ * Everything is fixed point, with no division. Counted by hand for the
+ * ATmega328, an update is about 300 cycles (19 us at 16 MHz): the 32 bit
+ * multiply for the cell voltage ~55, the sag ~25, the lookup ~90, the
+ * filter ~40, the rest calls and loads. Adapting the resistance on a
+ * current step adds about 100.
+ */
+#ifndef BATTERY_MODEL_H
+#define BATTERY_MODEL_H
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <stdint.h>
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+// Discharge curves: state of charge (0.5 %) at cell voltages from
+// BATTERY_MODEL_BASE_MV, every 2^BATTERY_MODEL_STEP_SHIFT mV.
+#define BATTERY_MODEL_BASE_MV    3008
+#define BATTERY_MODEL_STEP_SHIFT 4
+#define BATTERY_MODEL_POINTS     80
+
+// Filter weight of a new estimate, 1 / 2^n. With an update every
+// BATTERY_MODEL_UPDATE_MS, 4 gives a time constant of about 4 s.
+#define BATTERY_MODEL_FILTER_SHIFT 4
+#define BATTERY_MODEL_UPDATE_MS    250
+
+// Smallest current step (0.01 A) the resistance is checked on, and the
+// voltage difference per cell (mV) ignored, about the VESC resolution.
+#define BATTERY_MODEL_ADAPT_STEP_CA   500
+#define BATTERY_MODEL_ADAPT_MARGIN_MV 8
+
+// Fraction (1 / 2^n) of the voltage step difference (mV) added to the
+// resistance (2^-8 mV per 0.01 A).
+#define BATTERY_MODEL_ADAPT_SHIFT 4
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+// Values of the batteryType setting.
+enum batteryType {
+  BATTERY_LI_ION = 0,
+  BATTERY_LIPO   = 1
+};
+
+struct batteryModel {
+  uint8_t type;
+  uint8_t cells;
+  uint32_t cellScale; // 2^16 / cells
+  uint8_t sagScale;   // Sag per cell (mV) per 0.01 A, scaled by 2^8
+  uint8_t sagMin;
+  uint8_t sagMax;
+  bool primed;
+  int16_t lastCellMillivolts;
+  int16_t lastCurrent;
+  uint16_t filtered;  // State of charge (0.5 %), scaled by 2^8
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+// Start a model for a battery type and number of series cells. With no
+// cells configured the model never leaves 0 %.
+void batteryModelBegin(struct batteryModel *model, uint8_t type, uint8_t cells);
+
+// Add a measurement: pack voltage in mV and input current in 0.01 A
+// (negative when charging, e.g. braking).
+void batteryModelUpdate(struct batteryModel *model, uint16_t packMillivolts, int16_t currentCentiamps);
+
+// Return the smoothed state of charge in 0.1 %.
+uint16_t batteryModelSoc(const struct batteryModel *model);
+
+// Return the internal resistance per series cell in use, in 0.1 mOhm.
+uint16_t batteryModelResistance(const struct batteryModel *model);
+
+// Return the state of charge (0.1 %) of a cell at rest, without smoothing.
+uint16_t batteryModelLookup(uint8_t type, uint16_t cellMillivolts);
+
+#endif /* BATTERY_MODEL_H */
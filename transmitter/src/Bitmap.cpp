@@ -0,0 +1,124 @@
+/**
+ * @file   Bitmap.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Draws bitmaps stored in flash straight into the U8g2 page buffer.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <Arduino.h>
+#include "Bitmap.h"
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+// Decoder state, one bitmap byte at a time.
+struct bitmapReader {
+  const uint8_t *data;
+  uint8_t format;
+  uint8_t count;  // Bytes left of the current literal or repeat
+  bool repeat;
+  uint8_t value;  // Repeated byte
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+static uint8_t readByte(struct bitmapReader *reader);
+
+
+/**
+ * ****************************************************************************
+ * INTERFACE FUNCTIONS
+ * ****************************************************************************
+ */
+
+void bitmapDraw(const struct bitmapPage *page, int x, int y, const struct bitmapAsset *asset) {
+  struct bitmapAsset bitmap;
+  memcpy_P(&bitmap, asset, sizeof(bitmap));
+
+  struct bitmapReader reader = { bitmap.data, bitmap.format, 0, false, 0 };
+
+  int pageTop = page->tileRow * 8;
+  int pageBottom = pageTop + page->tileHeight * 8;
+  int stride = page->tileWidth * 8;
+
+  for (uint8_t row = 0; row < bitmap.height; row++) {
+    int py = y + row;
+
+    if (py >= pageBottom) {
+      break;
+    }
+
+    // Rows above the page are decoded and skipped.
+    bool visible = py >= pageTop;
+    uint8_t *line = page->buffer + ((py - pageTop) >> 3) * stride;
+    uint8_t mask = 1 << ((py - pageTop) & 7);
+
+    for (uint8_t column = 0; column < bitmap.width; column += 8) {
+      uint8_t bits = readByte(&reader);
+
+      if (visible == false) {
+        continue;
+      }
+
+      for (uint8_t bit = 0; bit < 8 && column + bit < bitmap.width; bit++) {
+        int px = x + column + bit;
+
+        if (px < 0 || px >= stride) {
+          continue;
+        }
+
+        if (bits & (1 << bit)) {
+          line[px] |= mask;
+        } else {
+          line[px] &= ~mask;
+        }
+      }
+    }
+  }
+}
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE FUNCTIONS
+ * ****************************************************************************
+ */
+
+static uint8_t readByte(struct bitmapReader *reader) {
+  if (reader->format == BITMAP_RAW) {
+    return pgm_read_byte(reader->data++);
+  }
+
+  if (reader->count == 0) {
+    uint8_t control = pgm_read_byte(reader->data++);
+
+    reader->repeat = control & 0x80;
+    if (reader->repeat) {
+      reader->count = (control & 0x7F) + 2;
+      reader->value = pgm_read_byte(reader->data++);
+    } else {
+      reader->count = control + 1;
+    }
+  }
+
+  reader->count--;
+
+  if (reader->repeat) {
+    return reader->value;
+  }
+  return pgm_read_byte(reader->data++);
+}
@@ -0,0 +1,67 @@
+/**
+ * @file   Bitmap.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Draws bitmaps stored in flash straight into the U8g2 page buffer.
+ *
+ * Bitmaps use XBM bit order (rows of bytes, least significant bit is the
+ * leftmost pixel) and are stored either raw or PackBits compressed:
+ *
+ *   control < 0x80:  control + 1 literal bytes follow
+ *   control >= 0x80: the next byte repeats (control & 0x7F) + 2 times
+ *
+ * Tables are generated from images by tools/bitmap_assets.py. They are
+ * decoded while drawing, one byte at a time, so nothing but the page
+ * buffer is needed in RAM. Pixels are drawn solid (set and cleared) like
+ * drawXBM with the default bitmap mode, clipped to the current page.
+ */
+#ifndef BITMAP_H
+#define BITMAP_H
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <stdint.h>
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+enum bitmapFormat {
+  BITMAP_RAW      = 0,
+  BITMAP_PACKBITS = 1
+};
+
+// Bitmap in flash (the struct itself too).
+struct bitmapAsset {
+  uint8_t width;
+  uint8_t height;
+  uint8_t format;      // bitmapFormat
+  const uint8_t *data; // Flash address
+};
+
+// Page of a U8g2 page buffer (getBufferPtr(), getBufferTileWidth(), ...).
+struct bitmapPage {
+  uint8_t *buffer;
+  uint8_t tileWidth;
+  uint8_t tileRow;
+  uint8_t tileHeight;
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+// Draw the part of a bitmap with its top left corner at x, y that falls
+// within the page.
+void bitmapDraw(const struct bitmapPage *page, int x, int y, const struct bitmapAsset *asset);
+
+#endif /* BITMAP_H */
@@ -0,0 +1,41 @@
+/**
+ * @file   BitmapAssets.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Display bitmaps in flash.
+ *
+ * Generated by tools/bitmap_assets.py, do not edit.
+ */
+#include <Arduino.h>
+#include "BitmapAssets.h"
+
+// logo.xbm
+static const uint8_t bitmapLogoData[] PROGMEM = {
+  0x85, 0x00, 0x39, 0x7e, 0x00, 0x80, 0x3c, 0x01, 0xe0, 0x00, 0x07, 0x70,
+  0x18, 0x0e, 0x30, 0x18, 0x0c, 0x98, 0x99, 0x19, 0x80, 0xff, 0x01, 0x04,
+  0xc3, 0x20, 0x0c, 0x99, 0x30, 0xec, 0xa5, 0x37, 0xec, 0xa5, 0x37, 0x0c,
+  0x99, 0x30, 0x04, 0xc3, 0x20, 0x80, 0xff, 0x01, 0x98, 0x99, 0x19, 0x30,
+  0x18, 0x0c, 0x70, 0x18, 0x0e, 0xe0, 0x00, 0x07, 0x80, 0x3c, 0x01, 0x00,
+  0x7e, 0x85, 0x00
+};
+const struct bitmapAsset bitmapLogo PROGMEM = { 24, 24, BITMAP_PACKBITS, bitmapLogoData };
+
+// signal_connected.xbm
+static const uint8_t bitmapSignalConnectedData[] PROGMEM = {
+  0x18, 0x00, 0x0c, 0x00, 0xc6, 0x00, 0x66, 0x00, 0x23, 0x06, 0x33, 0x09,
+  0x33, 0x09, 0x23, 0x06, 0x66, 0x00, 0xc6, 0x00, 0x0c, 0x00, 0x18, 0x00
+};
+const struct bitmapAsset bitmapSignalConnected PROGMEM = { 12, 12, BITMAP_RAW, bitmapSignalConnectedData };
+
+// signal_noconnection.xbm
+static const uint8_t bitmapSignalNoconnectionData[] PROGMEM = {
+  0x87, 0x00, 0x06, 0x06, 0x00, 0x09, 0x00, 0x09, 0x00, 0x06, 0x86, 0x00
+};
+const struct bitmapAsset bitmapSignalNoconnection PROGMEM = { 12, 12, BITMAP_PACKBITS, bitmapSignalNoconnectionData };
+
+// signal_transmitting.xbm
+static const uint8_t bitmapSignalTransmittingData[] PROGMEM = {
+  0x18, 0x00, 0x0c, 0x00, 0xc6, 0x00, 0x66, 0x00, 0x23, 0x06, 0x33, 0x0f,
+  0x33, 0x0f, 0x23, 0x06, 0x66, 0x00, 0xc6, 0x00, 0x0c, 0x00, 0x18, 0x00
+};
+const struct bitmapAsset bitmapSignalTransmitting PROGMEM = { 12, 12, BITMAP_RAW, bitmapSignalTransmittingData };
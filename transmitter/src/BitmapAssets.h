@@ -0,0 +1,19 @@
+/**
+ * @file   BitmapAssets.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Display bitmaps in flash.
+ *
+ * Generated by tools/bitmap_assets.py, do not edit.
+ */
+#ifndef BITMAP_ASSETS_H
+#define BITMAP_ASSETS_H
+
+#include "Bitmap.h"
+
+extern const struct bitmapAsset bitmapLogo; // 24x24, 63 of 72 bytes
+extern const struct bitmapAsset bitmapSignalConnected; // 12x12, 24 of 24 bytes
+extern const struct bitmapAsset bitmapSignalNoconnection; // 12x12, 12 of 24 bytes
+extern const struct bitmapAsset bitmapSignalTransmitting; // 12x12, 24 of 24 bytes
+
+#endif /* BITMAP_ASSETS_H */
@@ -0,0 +1,80 @@
+/**
+ * @file   ChannelScan.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Picks the quietest radio channel from carrier detector sweeps.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <string.h>
+#include "ChannelScan.h"
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE VARIABLES
+ * ****************************************************************************
+ */
+
+// Weight of hits by distance from the channel, 0 - CHANNEL_SCAN_SPREAD.
+static const uint8_t spreadWeights[CHANNEL_SCAN_SPREAD + 1] = { 4, 2, 1 };
+
+
+/**
+ * ****************************************************************************
+ * INTERFACE FUNCTIONS
+ * ****************************************************************************
+ */
+
+void channelScanBegin(struct channelScan *scan) {
+  memset(scan->hits, 0, sizeof(scan->hits));
+}
+
+void channelScanRecord(struct channelScan *scan, uint8_t channel, bool carrier) {
+  if (channel < CHANNEL_SCAN_FIRST || channel > CHANNEL_SCAN_LAST || carrier == false) {
+    return;
+  }
+
+  uint8_t *hits = &scan->hits[channel - CHANNEL_SCAN_FIRST];
+  if (*hits < 255) {
+    (*hits)++;
+  }
+}
+
+uint16_t channelScanScore(const struct channelScan *scan, uint8_t channel) {
+  uint16_t score = 0;
+
+  for (int8_t offset = -CHANNEL_SCAN_SPREAD; offset <= CHANNEL_SCAN_SPREAD; offset++) {
+    int16_t neighbour = (int16_t)channel + offset;
+
+    // Outside the scanned range, assume the same as the nearest scanned channel.
+    if (neighbour < CHANNEL_SCAN_FIRST) {
+      neighbour = CHANNEL_SCAN_FIRST;
+    } else if (neighbour > CHANNEL_SCAN_LAST) {
+      neighbour = CHANNEL_SCAN_LAST;
+    }
+
+    score += scan->hits[neighbour - CHANNEL_SCAN_FIRST] * spreadWeights[offset < 0 ? -offset : offset];
+  }
+
+  return score;
+}
+
+uint8_t channelScanSelect(const struct channelScan *scan) {
+  uint8_t best = CHANNEL_SCAN_FIRST;
+  uint16_t bestScore = 0xFFFF;
+
+  for (uint8_t channel = CHANNEL_SCAN_FIRST; channel <= CHANNEL_SCAN_LAST; channel++) {
+    uint16_t score = channelScanScore(scan, channel);
+    if (score < bestScore) {
+      best = channel;
+      bestScore = score;
+    }
+  }
+
+  return best;
+}
@@ -0,0 +1,75 @@
+/**
+ * @file   ChannelScan.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Picks the quietest radio channel from carrier detector sweeps.
+ *
+ * The caller sweeps the channels CHANNEL_SCAN_FIRST - CHANNEL_SCAN_LAST a
+ * number of times, recording for each channel whether the received power
+ * detector saw a carrier. A channel's score weighs its own hits with those
+ * of the channels next to it, as a 2 Mbps link is 2 MHz wide and
+ * interferers (WiFi, other links) spill into neighbouring channels. The
+ * channel with the lowest score is selected.
+ *
+ * The scan has no hardware dependencies and can be fed synthetic data.
+ */
+#ifndef CHANNEL_SCAN_H
+#define CHANNEL_SCAN_H
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <stdint.h>
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+// Scanned channels, within the 2400 - 2483.5 MHz band with a guard at each end.
+#define CHANNEL_SCAN_FIRST    2
+#define CHANNEL_SCAN_LAST     80
+#define CHANNEL_SCAN_CHANNELS (CHANNEL_SCAN_LAST - CHANNEL_SCAN_FIRST + 1)
+
+// Sweeps over all channels per scan, and time listening on each (µs).
+#define CHANNEL_SCAN_SWEEPS   16
+#define CHANNEL_SCAN_DWELL_US 200
+
+// Neighbours on each side counted in the score.
+#define CHANNEL_SCAN_SPREAD   2
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+struct channelScan {
+  uint8_t hits[CHANNEL_SCAN_CHANNELS]; // Sweeps with a carrier, per channel
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+// Clear the scan.
+void channelScanBegin(struct channelScan *scan);
+
+// Record one reading of the carrier detector on a channel.
+void channelScanRecord(struct channelScan *scan, uint8_t channel, bool carrier);
+
+// Return the weighted interference score of a channel (lower is quieter).
+uint16_t channelScanScore(const struct channelScan *scan, uint8_t channel);
+
+// Return the quietest channel. Ties go to the lowest channel.
+uint8_t channelScanSelect(const struct channelScan *scan);
+
+#endif /* CHANNEL_SCAN_H */
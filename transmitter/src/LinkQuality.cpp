@@ -0,0 +1,125 @@
+/**
+ * @file   LinkQuality.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Link quality monitor choosing PA level, data rate and retries.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <Arduino.h>
+#include <EskProtocol.h>
+#include "LinkQuality.h"
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE VARIABLES
+ * ****************************************************************************
+ */
+
+// Retry delays are long enough for a telemetry ack payload at each rate.
+static const struct linkLevel linkLevels[LINK_QUALITY_LEVELS] PROGMEM = {
+  { 1, PROTOCOL_RATE_2MBPS,   0, 5  },
+  { 2, PROTOCOL_RATE_2MBPS,   0, 8  },
+  { 2, PROTOCOL_RATE_1MBPS,   1, 10 },
+  { 3, PROTOCOL_RATE_1MBPS,   1, 15 },
+  { 3, PROTOCOL_RATE_250KBPS, 3, 15 }
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+static void clearWindow(struct linkQuality *link);
+static void evaluateWindow(struct linkQuality *link);
+
+
+/**
+ * ****************************************************************************
+ * INTERFACE FUNCTIONS
+ * ****************************************************************************
+ */
+
+void linkQualityBegin(struct linkQuality *link) {
+  link->ackRate = 100;
+  link->retryRate = 0;
+  link->strongRate = 0;
+  linkQualitySetLevel(link, LINK_QUALITY_HOME_LEVEL);
+}
+
+uint8_t linkQualityRecord(struct linkQuality *link, bool acked, uint8_t retries, bool strong) {
+  link->packets++;
+  link->retries += retries;
+
+  if (acked) {
+    link->acked++;
+    if (strong) {
+      link->strong++;
+    }
+  }
+
+  if (link->packets >= LINK_QUALITY_WINDOW) {
+    evaluateWindow(link);
+  }
+
+  return link->level;
+}
+
+void linkQualitySetLevel(struct linkQuality *link, uint8_t level) {
+  link->level = min(level, (uint8_t)(LINK_QUALITY_LEVELS - 1));
+  link->goodWindows = 0;
+  clearWindow(link);
+}
+
+void linkQualityLevel(uint8_t level, struct linkLevel *settings) {
+  memcpy_P(settings, &linkLevels[min(level, (uint8_t)(LINK_QUALITY_LEVELS - 1))], sizeof(*settings));
+}
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE FUNCTIONS
+ * ****************************************************************************
+ */
+
+static void clearWindow(struct linkQuality *link) {
+  link->packets = 0;
+  link->acked = 0;
+  link->strong = 0;
+  link->retries = 0;
+}
+
+static void evaluateWindow(struct linkQuality *link) {
+  link->ackRate = (uint16_t)link->acked * 100 / link->packets;
+  link->retryRate = min(link->retries * 10 / link->packets, 255);
+  link->strongRate = link->acked ? (uint16_t)link->strong * 100 / link->acked : 0;
+
+  if (link->ackRate < LINK_QUALITY_MIN_ACK_RATE || link->retryRate > LINK_QUALITY_MAX_RETRIES) {
+    // Struggling, more power or a slower, more sensitive rate.
+    if (link->level < LINK_QUALITY_LEVELS - 1) {
+      linkQualitySetLevel(link, link->level + 1);
+      return;
+    }
+    link->goodWindows = 0;
+  } else if (link->acked == link->packets && link->retryRate <= LINK_QUALITY_GOOD_RETRIES) {
+    link->goodWindows++;
+
+    // Clean, try less power or a faster rate.
+    bool strong = link->strongRate >= LINK_QUALITY_STRONG_RATE;
+    if (link->level > 0 && (strong || link->goodWindows >= LINK_QUALITY_GOOD_WINDOWS)) {
+      linkQualitySetLevel(link, link->level - 1);
+      return;
+    }
+  } else {
+    link->goodWindows = 0;
+  }
+
+  clearWindow(link);
+}
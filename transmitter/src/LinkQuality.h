@@ -0,0 +1,113 @@
+/**
+ * @file   LinkQuality.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Link quality monitor choosing PA level, data rate and retries.
+ *
+ * Every write is recorded with whether it was acked, its auto retransmit
+ * count and the received power detector (RPD, above -64 dBm). Over each
+ * window of LINK_QUALITY_WINDOW writes the monitor works out ack rate,
+ * retransmits per packet and share of strong acks, and moves along a
+ * ladder of link levels:
+ *
+ *   level  PA    data rate  retry delay  retries
+ *   0      LOW   2 Mbps     250 us       5        Short range, low latency
+ *   1      HIGH  2 Mbps     250 us       8
+ *   2      HIGH  1 Mbps     500 us       10
+ *   3      MAX   1 Mbps     500 us       15       Home, used at start
+ *   4      MAX   250 kbps   1000 us      15       Long range
+ *
+ * A window with losses or many retransmits steps to the next more robust
+ * level. LINK_QUALITY_GOOD_WINDOWS clean windows in a row (a single one
+ * when most acks are strong) step to the next faster, lower power level.
+ *
+ * The monitor has no hardware dependencies; the caller applies the levels.
+ */
+#ifndef LINK_QUALITY_H
+#define LINK_QUALITY_H
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <stdint.h>
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+// Writes per evaluation.
+#define LINK_QUALITY_WINDOW 32
+
+#define LINK_QUALITY_LEVELS     5
+#define LINK_QUALITY_HOME_LEVEL 3
+
+// Step to a more robust level below this ack rate (%), i.e. on any failed
+// write in a window, or above this many retransmits per packet (x10).
+#define LINK_QUALITY_MIN_ACK_RATE  97
+#define LINK_QUALITY_MAX_RETRIES   10
+
+// A clean window has all writes acked and at most this many retransmits
+// per packet (x10).
+#define LINK_QUALITY_GOOD_RETRIES  2
+#define LINK_QUALITY_GOOD_WINDOWS  3
+
+// Share of strong acks (%) that allows stepping down after one clean window.
+#define LINK_QUALITY_STRONG_RATE   75
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+// Radio settings of a level.
+struct linkLevel {
+  uint8_t paLevel;    // RF24_PA_* value
+  uint8_t dataRate;   // protocolDataRate
+  uint8_t retryDelay; // (n + 1) * 250 us
+  uint8_t retryCount;
+};
+
+struct linkQuality {
+  uint8_t level;
+  uint8_t goodWindows;
+
+  // Current window
+  uint8_t packets;
+  uint8_t acked;
+  uint8_t strong;
+  uint16_t retries;
+
+  // Last complete window
+  uint8_t ackRate;     // %
+  uint8_t retryRate;   // Retransmits per packet x10
+  uint8_t strongRate;  // % of acks with RPD set
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+// Start at the home level with a clean history.
+void linkQualityBegin(struct linkQuality *link);
+
+// Record one write. Returns the level to use from now on.
+uint8_t linkQualityRecord(struct linkQuality *link, bool acked, uint8_t retries, bool strong);
+
+// Move to a level, e.g. back to the home level when the link is lost, or
+// back to the previous one when a change could not be announced.
+void linkQualitySetLevel(struct linkQuality *link, uint8_t level);
+
+// Get the radio settings of a level.
+void linkQualityLevel(uint8_t level, struct linkLevel *settings);
+
+#endif /* LINK_QUALITY_H */
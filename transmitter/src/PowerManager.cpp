@@ -0,0 +1,154 @@
+/**
+ * @file   PowerManager.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Power modes of the remote, with an estimate of the current drawn
+ *         in each and the time from waking to the first packet.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <string.h>
+#include "PowerManager.h"
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+static void addTime(struct powerModeTime *time, unsigned long *field, unsigned long duration);
+static uint16_t saturate(unsigned long value);
+
+
+/**
+ * ****************************************************************************
+ * INTERFACE FUNCTIONS
+ * ****************************************************************************
+ */
+
+void powerManagerBegin(struct powerManager *power, unsigned long now) {
+  memset(power, 0, sizeof(*power));
+  power->mode = POWER_ACTIVE;
+  power->lastActivity = now;
+  power->lastUpdate = now;
+}
+
+void powerManagerActivity(struct powerManager *power, unsigned long time) {
+  power->lastActivity = time;
+
+  if (power->mode != POWER_ACTIVE) {
+    power->mode = POWER_ACTIVE;
+    power->waking = true;
+    power->wakeStart = time;
+  }
+}
+
+uint8_t powerManagerUpdate(struct powerManager *power, unsigned long now) {
+  struct powerModeTime *time = &power->time[power->mode];
+  unsigned long inactive = now - power->lastActivity;
+
+  addTime(time, &time->total, now - power->lastUpdate);
+  power->lastUpdate = now;
+
+  // Only ever further down here, activity brings the remote back up. Once
+  // asleep the inactive time may wrap.
+  if (power->mode == POWER_ACTIVE && inactive >= POWER_IDLE_MS * 1000) {
+    power->mode = POWER_IDLE;
+  }
+  if (power->mode == POWER_IDLE && inactive >= POWER_SLEEP_MS * 1000) {
+    power->mode = POWER_SLEEP;
+  }
+
+  return power->mode;
+}
+
+void powerManagerSlept(struct powerManager *power, unsigned long duration) {
+  struct powerModeTime *time = &power->time[power->mode];
+  addTime(time, &time->slept, duration);
+}
+
+void powerManagerRadio(struct powerManager *power, unsigned long duration) {
+  struct powerModeTime *time = &power->time[power->mode];
+  addTime(time, &time->radio, duration);
+}
+
+void powerManagerSent(struct powerManager *power, unsigned long now) {
+  if (power->firstPacket == 0) {
+    power->firstPacket = now;
+  }
+  if (power->waking == false) {
+    return;
+  }
+  power->waking = false;
+
+  uint16_t latency = saturate(now - power->wakeStart);
+
+  if (power->wakes < 0xFFFF) {
+    power->wakes++;
+  }
+  if (latency > POWER_WAKE_BOUND_US && power->lateWakes < 0xFFFF) {
+    power->lateWakes++;
+  }
+  power->lastWake = latency;
+  if (latency > power->maxWake) {
+    power->maxWake = latency;
+  }
+}
+
+uint16_t powerManagerCurrent(const struct powerManager *power, uint8_t mode) {
+  const struct powerModeTime *time = &power->time[mode];
+  unsigned long scale = time->total >> 10;
+
+  if (scale == 0) {
+    return 0;
+  }
+
+  // Fractions of the time (1/1024) the MCU slept and the radio was busy.
+  unsigned long slept = time->slept / scale;
+  unsigned long radio = time->radio / scale;
+  slept = (slept > 1024) ? 1024 : slept;
+  radio = (radio > 1024) ? 1024 : radio;
+
+  // The radio is only powered down between packets when not active.
+  unsigned long radioIdle = (mode == POWER_ACTIVE) ? POWER_RADIO_STANDBY_UA : POWER_RADIO_DOWN_UA;
+  unsigned long current = (POWER_MCU_AWAKE_UA * (1024 - slept) + POWER_MCU_SLEEP_UA * slept) >> 10;
+  current += (POWER_RADIO_BUSY_UA * radio + radioIdle * (1024 - radio)) >> 10;
+
+  if (mode == POWER_ACTIVE) {
+    current += POWER_DISPLAY_ON_UA;
+  } else if (mode == POWER_IDLE) {
+    current += POWER_DISPLAY_DIM_UA;
+  } else {
+    current += POWER_DISPLAY_OFF_UA;
+  }
+
+  return saturate(current);
+}
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE FUNCTIONS
+ * ****************************************************************************
+ */
+
+// Add to one of the times of a mode. Past half the range all three are
+// halved, which keeps their ratios.
+static void addTime(struct powerModeTime *time, unsigned long *field, unsigned long duration) {
+  *field += duration;
+
+  if (*field >= 0x80000000UL) {
+    time->total >>= 1;
+    time->slept >>= 1;
+    time->radio >>= 1;
+  }
+}
+
+static uint16_t saturate(unsigned long value) {
+  return (value > 0xFFFF) ? 0xFFFF : value;
+}
@@ -0,0 +1,126 @@
+/**
+ * @file   PowerManager.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Power modes of the remote, with an estimate of the current drawn
+ *         in each and the time from waking to the first packet.
+ *
+ * The remote is active while the trigger is held or the throttle is away
+ * from neutral. After POWER_IDLE_MS without either it goes idle: the
+ * display is dimmed and the radio powered down between packets. After
+ * POWER_SLEEP_MS it sleeps: the display is blanked and the hall sampler
+ * stopped. Keepalives are sent in every mode, so the receiver keeps the
+ * link. Activity returns to active at once.
+ *
+ * The caller reports the time the MCU slept and the radio was busy. Per
+ * mode these give the fraction of time the MCU is awake and the radio
+ * sending, and with the data sheet currents of the parts an estimate of
+ * the average current. The regulator and power LED of the board come on
+ * top.
+ *
+ * A wake is timed from the activity (or the interrupt that caught it) to
+ * the first packet that got through, and counted as late above
+ * POWER_WAKE_BOUND_US. Power on is timed the same way, from the zero of the
+ * clock (micros() counts from reset, the bootloader not included) to the
+ * first packet.
+ *
+ * The manager has no hardware dependencies; time (µs) is passed in by the
+ * caller.
+ */
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <stdint.h>
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+// Time without activity before idling and sleeping (ms).
+#define POWER_IDLE_MS  10000UL
+#define POWER_SLEEP_MS 60000UL
+
+// Longest expected time from activity to the first packet (µs).
+#define POWER_WAKE_BOUND_US 10000
+
+// Current drawn by the parts (µA).
+#define POWER_MCU_AWAKE_UA      9000  // ATmega328P, 16 MHz at 5 V
+#define POWER_MCU_SLEEP_UA      2500  // Idle sleep
+#define POWER_RADIO_BUSY_UA     12000 // Sending, or waiting for the ack
+#define POWER_RADIO_STANDBY_UA  26
+#define POWER_RADIO_DOWN_UA     1
+#define POWER_DISPLAY_ON_UA     8000  // SSD1306 128x32, full contrast
+#define POWER_DISPLAY_DIM_UA    3000
+#define POWER_DISPLAY_OFF_UA    10
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+enum powerMode {
+  POWER_ACTIVE,
+  POWER_IDLE,
+  POWER_SLEEP,
+  POWER_NUM_MODES
+};
+
+// Time spent in a mode (µs), halved together so the ratios are kept.
+struct powerModeTime {
+  unsigned long total;
+  unsigned long slept;
+  unsigned long radio;
+};
+
+struct powerManager {
+  uint8_t mode;
+  unsigned long lastActivity;
+  unsigned long lastUpdate;
+  struct powerModeTime time[POWER_NUM_MODES];
+  // Wake to first packet
+  bool waking;
+  unsigned long wakeStart;
+  uint16_t wakes;
+  uint16_t lateWakes;
+  uint16_t lastWake; // µs
+  uint16_t maxWake;
+  unsigned long firstPacket; // µs from power on, 0 until a packet got through
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+// Start in active mode.
+void powerManagerBegin(struct powerManager *power, unsigned long now);
+
+// Record activity at a time (not after now). Wakes up if not active.
+void powerManagerActivity(struct powerManager *power, unsigned long time);
+
+// Account the time since the last update and move to the mode due. Returns the mode.
+uint8_t powerManagerUpdate(struct powerManager *power, unsigned long now);
+
+// Add time the MCU slept, and the radio was busy, to the current mode.
+void powerManagerSlept(struct powerManager *power, unsigned long duration);
+void powerManagerRadio(struct powerManager *power, unsigned long duration);
+
+// A packet got through. Ends the timing of a wake, or of the power on.
+void powerManagerSent(struct powerManager *power, unsigned long now);
+
+// Return the estimated average current in a mode (µA), 0 if never in it.
+uint16_t powerManagerCurrent(const struct powerManager *power, uint8_t mode);
+
+#endif /* POWER_MANAGER_H */
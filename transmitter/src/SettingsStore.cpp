@@ -0,0 +1,205 @@
+/**
+ * @file   SettingsStore.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Wear-leveled, log-structured settings store in EEPROM.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <EskProtocol.h>
+#include "SettingsStore.h"
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+#define SETTINGS_STORE_NO_BANK 0xFF
+
+// Record ids with a special meaning.
+#define RECORD_EMPTY  0xFF
+#define RECORD_HEADER 0xFE
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+static int slotAddress(uint8_t bank, uint8_t slot);
+static uint8_t recordCrc(uint16_t generation, uint8_t slot, uint8_t id, uint16_t value);
+static bool readRecord(uint8_t bank, uint8_t slot, uint16_t generation, uint8_t *id, uint16_t *value);
+static bool readHeader(uint8_t bank, uint16_t *generation);
+static void writeRecord(uint8_t bank, uint8_t slot, uint16_t generation, uint8_t id, uint16_t value);
+static void endLog(uint8_t bank, uint8_t slot);
+static void compact(struct settingsStore *store);
+
+
+/**
+ * ****************************************************************************
+ * INTERFACE FUNCTIONS
+ * ****************************************************************************
+ */
+
+bool settingsStoreBegin(struct settingsStore *store) {
+  uint16_t generations[2];
+  bool valid[2];
+
+  memset(store, 0, sizeof(*store));
+  store->bank = SETTINGS_STORE_NO_BANK;
+
+  valid[0] = readHeader(0, &generations[0]);
+  valid[1] = readHeader(1, &generations[1]);
+
+  if (valid[0] && valid[1]) {
+    // Newest generation, allowing for wrap around.
+    store->bank = ((int16_t)(generations[1] - generations[0]) > 0) ? 1 : 0;
+  } else if (valid[0]) {
+    store->bank = 0;
+  } else if (valid[1]) {
+    store->bank = 1;
+  } else {
+    return false;
+  }
+  store->generation = generations[store->bank];
+
+  // Replay up to the first empty or invalid slot.
+  uint8_t slot;
+  for (slot = 1; slot < SETTINGS_STORE_SLOTS; slot++) {
+    uint8_t id;
+    uint16_t value;
+
+    if (readRecord(store->bank, slot, store->generation, &id, &value) == false) {
+      break;
+    }
+    if (id < SETTINGS_STORE_MAX_FIELDS) {
+      store->values[id] = value;
+      store->stored |= 1 << id;
+    }
+  }
+  store->head = slot;
+
+  return true;
+}
+
+bool settingsStoreGet(const struct settingsStore *store, uint8_t id, uint16_t *value) {
+  if (id >= SETTINGS_STORE_MAX_FIELDS || (store->stored & (1 << id)) == 0) {
+    return false;
+  }
+
+  *value = store->values[id];
+  return true;
+}
+
+void settingsStoreSet(struct settingsStore *store, uint8_t id, uint16_t value) {
+  if (id >= SETTINGS_STORE_MAX_FIELDS) {
+    return;
+  }
+  if ((store->stored & (1 << id)) && store->values[id] == value) {
+    return;
+  }
+
+  store->values[id] = value;
+  store->stored |= 1 << id;
+
+  if (store->bank == SETTINGS_STORE_NO_BANK || store->head >= SETTINGS_STORE_SLOTS) {
+    compact(store);
+    return;
+  }
+
+  endLog(store->bank, store->head + 1);
+  writeRecord(store->bank, store->head, store->generation, id, value);
+  store->head++;
+}
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE FUNCTIONS
+ * ****************************************************************************
+ */
+
+static int slotAddress(uint8_t bank, uint8_t slot) {
+  return SETTINGS_STORE_START + bank * SETTINGS_STORE_BANK_SIZE + slot * SETTINGS_STORE_RECORD_SIZE;
+}
+
+static uint8_t recordCrc(uint16_t generation, uint8_t slot, uint8_t id, uint16_t value) {
+  uint8_t data[] = { (uint8_t)generation, (uint8_t)(generation >> 8), slot, id, (uint8_t)value, (uint8_t)(value >> 8) };
+  return protocolCrc8(data, sizeof(data));
+}
+
+static bool readRecord(uint8_t bank, uint8_t slot, uint16_t generation, uint8_t *id, uint16_t *value) {
+  int address = slotAddress(bank, slot);
+
+  *id = EEPROM.read(address);
+  *value = EEPROM.read(address + 1) | (EEPROM.read(address + 2) << 8);
+
+  if (*id == RECORD_EMPTY) {
+    return false;
+  }
+
+  return EEPROM.read(address + 3) == recordCrc(generation, slot, *id, *value);
+}
+
+static bool readHeader(uint8_t bank, uint16_t *generation) {
+  int address = slotAddress(bank, 0);
+  uint8_t id;
+
+  // The header holds its own generation.
+  *generation = EEPROM.read(address + 1) | (EEPROM.read(address + 2) << 8);
+
+  return readRecord(bank, 0, *generation, &id, generation) && id == RECORD_HEADER;
+}
+
+// Write a record so it only becomes valid with its last byte, the id.
+static void writeRecord(uint8_t bank, uint8_t slot, uint16_t generation, uint8_t id, uint16_t value) {
+  int address = slotAddress(bank, slot);
+
+  // Keep the slot empty until done.
+  EEPROM.update(address, RECORD_EMPTY);
+  EEPROM.update(address + 1, value);
+  EEPROM.update(address + 2, value >> 8);
+  EEPROM.update(address + 3, recordCrc(generation, slot, id, value));
+  EEPROM.update(address, id);
+}
+
+// Mark a slot empty, so replay stops there whatever was left in it.
+static void endLog(uint8_t bank, uint8_t slot) {
+  if (slot < SETTINGS_STORE_SLOTS) {
+    EEPROM.update(slotAddress(bank, slot), RECORD_EMPTY);
+  }
+}
+
+// Write all stored values to the other bank and make it the active one.
+static void compact(struct settingsStore *store) {
+  uint8_t bank = (store->bank == 0) ? 1 : 0;
+  uint16_t generation = store->generation + 1;
+  uint8_t slot = 1;
+
+  // The other bank is older; invalidate its header before reusing it.
+  EEPROM.update(slotAddress(bank, 0), RECORD_EMPTY);
+
+  for (uint8_t id = 0; id < SETTINGS_STORE_MAX_FIELDS; id++) {
+    if (store->stored & (1 << id)) {
+      endLog(bank, slot + 1);
+      writeRecord(bank, slot++, generation, id, store->values[id]);
+    }
+  }
+
+  // Switch banks.
+  endLog(bank, slot);
+  writeRecord(bank, 0, generation, RECORD_HEADER, generation);
+
+  store->bank = bank;
+  store->head = slot;
+  store->generation = generation;
+}
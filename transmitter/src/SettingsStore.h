@@ -0,0 +1,83 @@
+/**
+ * @file   SettingsStore.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Wear-leveled, log-structured settings store in EEPROM.
+ *
+ * Settings are 16 bit values with ids 0 - SETTINGS_STORE_MAX_FIELDS-1.
+ * Changing one appends a 4 byte record to the active bank instead of
+ * rewriting all settings:
+ *
+ *   id (u8), value (u16), crc
+ *
+ * The CRC-8 also covers the bank generation and the slot, so records left
+ * over from earlier generations never pass as current. The bytes are
+ * written value first and id last, with the id of the next slot cleared
+ * beforehand. Until the id lands the slot reads as empty, and a torn id
+ * byte fails the CRC, so power loss at any point leaves either the old or
+ * the new value.
+ *
+ * When a bank is full, the current values are written to the other bank,
+ * followed by its header (slot 0, value = generation). The bank with the
+ * newest valid header is loaded at boot by replaying its records up to the
+ * first empty or invalid slot.
+ */
+#ifndef SETTINGS_STORE_H
+#define SETTINGS_STORE_H
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <stdint.h>
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+// EEPROM area used, two banks.
+#define SETTINGS_STORE_START     0
+#define SETTINGS_STORE_BANK_SIZE 256
+#define SETTINGS_STORE_SIZE      (2 * SETTINGS_STORE_BANK_SIZE)
+
+#define SETTINGS_STORE_RECORD_SIZE 4
+#define SETTINGS_STORE_SLOTS       (SETTINGS_STORE_BANK_SIZE / SETTINGS_STORE_RECORD_SIZE)
+
+#define SETTINGS_STORE_MAX_FIELDS  16
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+struct settingsStore {
+  uint8_t bank;        // Active bank, SETTINGS_STORE_NO_BANK before the first write
+  uint8_t head;        // Next free slot in the active bank
+  uint16_t generation; // Generation of the active bank
+  uint16_t stored;     // Bit per field with a stored value
+  uint16_t values[SETTINGS_STORE_MAX_FIELDS];
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+// Load the newest valid state. Returns false if nothing has been stored.
+bool settingsStoreBegin(struct settingsStore *store);
+
+// Get a stored value. Returns false if the field has never been stored.
+bool settingsStoreGet(const struct settingsStore *store, uint8_t id, uint16_t *value);
+
+// Store a value. Writes nothing if it is unchanged.
+void settingsStoreSet(struct settingsStore *store, uint8_t id, uint16_t value);
+
+#endif /* SETTINGS_STORE_H */
@@ -0,0 +1,109 @@
+/**
+ * @file   SettingsTable.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Remote settings and their descriptor table in flash.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <Arduino.h>
+#include <stddef.h>
+#include "SettingsTable.h"
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+// Offset and width of a field in struct settings.
+#define SETTING_FIELD(field) offsetof(struct settings, field), sizeof(((struct settings *)0)->field)
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE VARIABLES
+ * ****************************************************************************
+ */
+
+// Format: label, unit, default, min, max, field.
+static const struct settingDescriptor settingDescriptors[] PROGMEM = {
+  { "Trigger",         "",   0,    0, 3,    SETTING_FIELD(triggerMode)     }, // 0 Killswitch, 1 cruise & 2 data toggle
+  { "Battery type",    "",   0,    0, 1,    SETTING_FIELD(batteryType)     }, // 0 Li-ion & 1 LiPo
+  { "Battery cells",   "S",  10,   0, 12,   SETTING_FIELD(batteryCells)    },
+  { "Motor poles",     "",   14,   0, 250,  SETTING_FIELD(motorPoles)      },
+  { "Motor pulley",    "T",  15,   0, 250,  SETTING_FIELD(motorPulley)     },
+  { "Wheel pulley",    "T",  40,   0, 250,  SETTING_FIELD(wheelPulley)     },
+  { "Wheel diameter",  "mm", 83,   0, 250,  SETTING_FIELD(wheelDiameter)   },
+  { "UART data",       "",   1,    0, 1,    SETTING_FIELD(useUart)         }, // Yes or no
+  { "Throttle min",    "",   0,    0, 1023, SETTING_FIELD(minHallValue)    },
+  { "Throttle center", "",   512,  0, 1023, SETTING_FIELD(centerHallValue) },
+  { "Throttle max",    "",   1023, 0, 1023, SETTING_FIELD(maxHallValue)    },
+  { "Throttle curve",  "",   0,    0, 2,    SETTING_FIELD(throttleCurve)   }, // 0 Linear, 1 exponential & 2 custom
+  { "Brake curve",     "",   0,    0, 2,    SETTING_FIELD(brakeCurve)      }  // 0 Linear, 1 exponential & 2 custom
+};
+
+static_assert(sizeof(settingDescriptors) / sizeof(settingDescriptors[0]) == SETTINGS_COUNT,
+              "One descriptor per setting");
+
+
+/**
+ * ****************************************************************************
+ * INTERFACE FUNCTIONS
+ * ****************************************************************************
+ */
+
+void settingsTableDescriptor(uint8_t index, struct settingDescriptor *descriptor) {
+  memcpy_P(descriptor, &settingDescriptors[index], sizeof(*descriptor));
+}
+
+int16_t settingsTableGet(const struct settings *settings, uint8_t index) {
+  const uint8_t *field = (const uint8_t *)settings + pgm_read_byte(&settingDescriptors[index].offset);
+
+  if (pgm_read_byte(&settingDescriptors[index].width) == 1) {
+    return *field;
+  }
+
+  int16_t value;
+  memcpy(&value, field, sizeof(value));
+  return value;
+}
+
+void settingsTableSet(struct settings *settings, uint8_t index, int16_t value) {
+  uint8_t *field = (uint8_t *)settings + pgm_read_byte(&settingDescriptors[index].offset);
+
+  if (pgm_read_byte(&settingDescriptors[index].width) == 1) {
+    *field = value;
+  } else {
+    memcpy(field, &value, sizeof(value));
+  }
+}
+
+bool settingsTableInRange(uint8_t index, int16_t value) {
+  return (int16_t)pgm_read_word(&settingDescriptors[index].minValue) <= value &&
+         value <= (int16_t)pgm_read_word(&settingDescriptors[index].maxValue);
+}
+
+void settingsTableReset(struct settings *settings) {
+  for (uint8_t i = 0; i < SETTINGS_COUNT; i++) {
+    settingsTableSet(settings, i, pgm_read_word(&settingDescriptors[i].defaultValue));
+  }
+}
+
+bool settingsTableValidate(struct settings *settings) {
+  bool valid = true;
+
+  for (uint8_t i = 0; i < SETTINGS_COUNT; i++) {
+    if (! settingsTableInRange(i, settingsTableGet(settings, i))) {
+      settingsTableSet(settings, i, pgm_read_word(&settingDescriptors[i].defaultValue));
+      valid = false;
+    }
+  }
+
+  return valid;
+}
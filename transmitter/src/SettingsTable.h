@@ -0,0 +1,112 @@
+/**
+ * @file   SettingsTable.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Remote settings and their descriptor table in flash.
+ *
+ * Each setting is described once: label and unit shown in the settings
+ * menu, default, allowed range and where it lives in struct settings. The
+ * menu, the EEPROM validation and the defaults all work from the table,
+ * so adding a setting means adding a field and a table row.
+ *
+ * Setting indexes are also the field ids used in the settings store, so
+ * only append new settings at the end.
+ */
+#ifndef SETTINGS_TABLE_H
+#define SETTINGS_TABLE_H
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <stdint.h>
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+// Longest label and unit, including null.
+#define SETTINGS_TABLE_LABEL_SIZE 16
+#define SETTINGS_TABLE_UNIT_SIZE  3
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+// Setting values while remote is turned on. Same layout as the settings
+// once stored as a whole at EEPROM address 0.
+struct settings {
+  uint8_t triggerMode;
+  uint8_t batteryType;
+  uint8_t batteryCells;
+  uint8_t motorPoles;
+  uint8_t motorPulley;
+  uint8_t wheelPulley;
+  uint8_t wheelDiameter;
+  bool useUart;
+  int16_t minHallValue;
+  int16_t centerHallValue;
+  int16_t maxHallValue;
+  uint8_t throttleCurve;
+  uint8_t brakeCurve;
+};
+
+// Setting indexes, in menu order.
+enum settingIndex {
+  SETTING_TRIGGER_MODE,
+  SETTING_BATTERY_TYPE,
+  SETTING_BATTERY_CELLS,
+  SETTING_MOTOR_POLES,
+  SETTING_MOTOR_PULLEY,
+  SETTING_WHEEL_PULLEY,
+  SETTING_WHEEL_DIAMETER,
+  SETTING_USE_UART,
+  SETTING_MIN_HALL,
+  SETTING_CENTER_HALL,
+  SETTING_MAX_HALL,
+  SETTING_THROTTLE_CURVE,
+  SETTING_BRAKE_CURVE,
+  SETTINGS_COUNT
+};
+
+struct settingDescriptor {
+  char label[SETTINGS_TABLE_LABEL_SIZE];
+  char unit[SETTINGS_TABLE_UNIT_SIZE];
+  int16_t defaultValue;
+  int16_t minValue;
+  int16_t maxValue;
+  uint8_t offset; // Field in struct settings
+  uint8_t width;  // 1 or 2 bytes
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+// Copy the descriptor of a setting from flash.
+void settingsTableDescriptor(uint8_t index, struct settingDescriptor *descriptor);
+
+// Get or set a setting value through its descriptor.
+int16_t settingsTableGet(const struct settings *settings, uint8_t index);
+void settingsTableSet(struct settings *settings, uint8_t index, int16_t value);
+
+// Return true if value is within the allowed range of a setting.
+bool settingsTableInRange(uint8_t index, int16_t value);
+
+// Set all settings to their defaults.
+void settingsTableReset(struct settings *settings);
+
+// Set settings out of range to their defaults. Returns false if any was.
+bool settingsTableValidate(struct settings *settings);
+
+#endif /* SETTINGS_TABLE_H */
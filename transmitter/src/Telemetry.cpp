@@ -0,0 +1,126 @@
+/**
+ * @file   Telemetry.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Telemetry snapshot rebuilt from the multiplexed ack payloads.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <Arduino.h>
+#include "Telemetry.h"
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+// Source of the fields sent in every frame; groups follow.
+#define SOURCE_FAST 0
+#define SOURCE_GROUP(group) (1 + (group))
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE VARIABLES
+ * ****************************************************************************
+ */
+
+// Source each field arrives in, indexed by enum telemetryField.
+static const uint8_t fieldSources[TELEMETRY_NUM_FIELDS] PROGMEM = {
+  SOURCE_FAST,                                 // TELEMETRY_RPM
+  SOURCE_FAST,                                 // TELEMETRY_INPUT_CURRENT
+  SOURCE_FAST,                                 // TELEMETRY_MOTOR_CURRENT
+  SOURCE_GROUP(PROTOCOL_GROUP_POWER),          // TELEMETRY_VOLTAGE
+  SOURCE_GROUP(PROTOCOL_GROUP_POWER),          // TELEMETRY_DUTY_CYCLE
+  SOURCE_GROUP(PROTOCOL_GROUP_POWER),          // TELEMETRY_FAULT
+  SOURCE_GROUP(PROTOCOL_GROUP_DISTANCE),       // TELEMETRY_TACHOMETER
+  SOURCE_GROUP(PROTOCOL_GROUP_ENERGY),         // TELEMETRY_AMP_HOURS
+  SOURCE_GROUP(PROTOCOL_GROUP_ENERGY),         // TELEMETRY_AMP_HOURS_CHARGED
+  SOURCE_GROUP(PROTOCOL_GROUP_THERMAL),        // TELEMETRY_TEMP_FET
+  SOURCE_GROUP(PROTOCOL_GROUP_THERMAL)         // TELEMETRY_TEMP_MOTOR
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+static void touchSource(struct telemetry *telemetry, uint8_t source, uint8_t measurement, unsigned long now);
+
+
+/**
+ * ****************************************************************************
+ * INTERFACE FUNCTIONS
+ * ****************************************************************************
+ */
+
+void telemetryBegin(struct telemetry *telemetry) {
+  memset(telemetry, 0, sizeof(*telemetry));
+}
+
+bool telemetryReceive(struct telemetry *telemetry, const uint8_t *frame, uint8_t size, struct vescValues *values, unsigned long now) {
+  uint8_t group;
+  uint8_t measurement;
+
+  if (!protocolDecodeTelemetry(frame, size, values, &group, &measurement)) {
+    return false;
+  }
+
+  touchSource(telemetry, SOURCE_FAST, measurement, now);
+  touchSource(telemetry, SOURCE_GROUP(group), measurement, now);
+
+  return true;
+}
+
+uint16_t telemetryAge(const struct telemetry *telemetry, uint8_t field, unsigned long now) {
+  uint8_t source = pgm_read_byte(&fieldSources[field]);
+
+  if (!(telemetry->received & (1 << source))) {
+    return TELEMETRY_AGE_UNKNOWN;
+  }
+
+  unsigned long age = now - telemetry->updated[source];
+  if (age >= TELEMETRY_AGE_UNKNOWN) {
+    age = TELEMETRY_AGE_UNKNOWN - 1;
+  }
+
+  return age;
+}
+
+bool telemetryFresh(const struct telemetry *telemetry, uint8_t field, unsigned long now, uint16_t interval) {
+  uint8_t source = pgm_read_byte(&fieldSources[field]);
+  uint8_t gap = (source == SOURCE_FAST) ? 1 : protocolTelemetryGap(source - 1);
+
+  return telemetryAge(telemetry, field, now) < TELEMETRY_STALE_MS + (unsigned long)gap * interval;
+}
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE FUNCTIONS
+ * ****************************************************************************
+ */
+
+// Restart the age of a source if the frame brings a measurement it has not
+// had yet. The count wraps at 16, so a source that missed exactly a
+// multiple of 16 measurements keeps its old time and reads too old, never
+// too young.
+static void touchSource(struct telemetry *telemetry, uint8_t source, uint8_t measurement, unsigned long now) {
+  uint8_t bit = 1 << source;
+
+  if ((telemetry->received & bit) && telemetry->measurement[source] == measurement) {
+    return;
+  }
+
+  telemetry->received |= bit;
+  telemetry->measurement[source] = measurement;
+  telemetry->updated[source] = now;
+}
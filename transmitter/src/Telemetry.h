@@ -0,0 +1,94 @@
+/**
+ * @file   Telemetry.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Telemetry snapshot rebuilt from the multiplexed ack payloads.
+ *
+ * Each ack carries the fast fields and one group of slow fields (see
+ * EskProtocol.h). Frames are decoded into a single struct vescValues, so it
+ * always holds the latest value of every field, and the time each group
+ * last brought a new VESC measurement is kept to give the age of a field.
+ * A frame repeating a measurement already seen does not make it younger.
+ */
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <stdint.h>
+#include <EskProtocol.h>
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+// Age returned for a field never received.
+#define TELEMETRY_AGE_UNKNOWN 0xFFFF
+
+// Age (ms) after which a field should no longer be relied on, a few VESC
+// request periods. Added on top is the time its group takes to come round
+// again at the packet interval, see telemetryFresh().
+#define TELEMETRY_STALE_MS 1000
+
+// Fields sent in every frame, plus one entry per group.
+#define TELEMETRY_NUM_SOURCES (1 + PROTOCOL_TELEMETRY_GROUPS)
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+// Fields of struct vescValues.
+enum telemetryField {
+  TELEMETRY_RPM = 0,
+  TELEMETRY_INPUT_CURRENT,
+  TELEMETRY_MOTOR_CURRENT,
+  TELEMETRY_VOLTAGE,
+  TELEMETRY_DUTY_CYCLE,
+  TELEMETRY_FAULT,
+  TELEMETRY_TACHOMETER,
+  TELEMETRY_AMP_HOURS,
+  TELEMETRY_AMP_HOURS_CHARGED,
+  TELEMETRY_TEMP_FET,
+  TELEMETRY_TEMP_MOTOR,
+  TELEMETRY_NUM_FIELDS
+};
+
+struct telemetry {
+  unsigned long updated[TELEMETRY_NUM_SOURCES]; // millis() of the last new measurement
+  uint8_t measurement[TELEMETRY_NUM_SOURCES];   // Its measurement count
+  uint8_t received;                             // Bit per source heard from
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+// Forget all fields.
+void telemetryBegin(struct telemetry *telemetry);
+
+// Decode a telemetry frame received at now (ms) into values. Returns false,
+// leaving values alone, if the frame is invalid.
+bool telemetryReceive(struct telemetry *telemetry, const uint8_t *frame, uint8_t size, struct vescValues *values, unsigned long now);
+
+// Return the age (ms) of a field at now, saturating below
+// TELEMETRY_AGE_UNKNOWN, or TELEMETRY_AGE_UNKNOWN if never received.
+uint16_t telemetryAge(const struct telemetry *telemetry, uint8_t field, unsigned long now);
+
+// Return true if a field is younger than TELEMETRY_STALE_MS plus the
+// frames between two of its group at interval (ms) per frame, the longest
+// time between packets at present.
+bool telemetryFresh(const struct telemetry *telemetry, uint8_t field, unsigned long now, uint16_t interval);
+
+#endif /* TELEMETRY_H */
@@ -0,0 +1,101 @@
+/**
+ * @file   TextFormat.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Allocation-free number formatting into caller supplied buffers.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <math.h>
+#include "TextFormat.h"
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE VARIABLES
+ * ****************************************************************************
+ */
+
+static const uint32_t powersOfTen[] = {
+  1UL, 10UL, 100UL, 1000UL, 10000UL,
+  100000UL, 1000000UL, 10000000UL, 100000000UL, 1000000000UL
+};
+
+
+/**
+ * ****************************************************************************
+ * INTERFACE FUNCTIONS
+ * ****************************************************************************
+ */
+
+char *formatUnsigned(char *buffer, uint32_t value, uint8_t minDigits) {
+  char digits[TEXT_FORMAT_MAX_DIGITS];
+  uint8_t count = 0;
+
+  // Values shown on the display fit in 16 bits; avoid 32 bit division for them.
+  if (value <= 0xFFFF) {
+    uint16_t small = value;
+    do {
+      digits[count++] = '0' + (small % 10);
+      small /= 10;
+    } while (small != 0);
+  } else {
+    do {
+      digits[count++] = '0' + (value % 10);
+      value /= 10;
+    } while (value != 0);
+  }
+
+  while (count < minDigits && count < TEXT_FORMAT_MAX_DIGITS) {
+    digits[count++] = '0';
+  }
+
+  while (count > 0) {
+    *buffer++ = digits[--count];
+  }
+  *buffer = '\0';
+
+  return buffer;
+}
+
+char *formatFixed(char *buffer, uint32_t value, uint8_t decimals, uint8_t minDigits) {
+  uint32_t scale = formatScale(decimals);
+
+  buffer = formatUnsigned(buffer, value / scale, minDigits);
+
+  if (decimals > 0) {
+    *buffer++ = '.';
+    buffer = formatUnsigned(buffer, value % scale, decimals);
+  }
+
+  return buffer;
+}
+
+char *formatString(char *buffer, const char *str) {
+  while (*str != '\0') {
+    *buffer++ = *str++;
+  }
+  *buffer = '\0';
+
+  return buffer;
+}
+
+uint32_t formatScale(uint8_t decimals) {
+  if (decimals >= sizeof(powersOfTen) / sizeof(powersOfTen[0])) {
+    decimals = sizeof(powersOfTen) / sizeof(powersOfTen[0]) - 1;
+  }
+  return powersOfTen[decimals];
+}
+
+uint32_t formatRound(float value, uint8_t decimals) {
+  float scaled = fabs(value) * formatScale(decimals) + 0.5f;
+
+  if (scaled >= 4294967295.0f) {
+    return 0xFFFFFFFF;
+  }
+  return scaled;
+}
@@ -0,0 +1,55 @@
+/**
+ * @file   TextFormat.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Allocation-free number formatting into caller supplied buffers.
+ *
+ * Replaces building Arduino Strings for the display. All functions write a
+ * null terminated string and return a pointer to the terminating null, so
+ * calls can be chained to append text.
+ */
+#ifndef TEXT_FORMAT_H
+#define TEXT_FORMAT_H
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <stdint.h>
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+// Largest number of characters written for a 32 bit value, excluding null.
+#define TEXT_FORMAT_MAX_DIGITS 10
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+// Write value in decimal, zero padded to at least minDigits digits.
+char *formatUnsigned(char *buffer, uint32_t value, uint8_t minDigits);
+
+// Write fixed-point value (scaled by 10^decimals) as "<integer>.<decimals>",
+// with the integer part zero padded to at least minDigits digits.
+char *formatFixed(char *buffer, uint32_t value, uint8_t decimals, uint8_t minDigits);
+
+// Append a null terminated string.
+char *formatString(char *buffer, const char *str);
+
+// Return 10^decimals for 0-9 decimals.
+uint32_t formatScale(uint8_t decimals);
+
+// Return the magnitude of value as fixed point scaled by 10^decimals,
+// rounded to the nearest. Saturates at the largest 32 bit value.
+uint32_t formatRound(float value, uint8_t decimals);
+
+#endif /* TEXT_FORMAT_H */
@@ -0,0 +1,130 @@
+/**
+ * @file   ThrottleCurve.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Throttle and brake response curves.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <Arduino.h>
+#include "ThrottleCurve.h"
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+struct curveTable {
+  uint16_t values[THROTTLE_CURVE_TABLE_SIZE];
+};
+
+// Compile-time sequence 0..N-1, used to expand one call per table entry.
+template<unsigned... I> struct curveIndices {};
+template<unsigned N, unsigned... I> struct makeCurveIndices : makeCurveIndices<N - 1, N - 1, I...> {};
+template<unsigned... I> struct makeCurveIndices<0, I...> { typedef curveIndices<I...> type; };
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE VARIABLES
+ * ****************************************************************************
+ */
+
+// Custom curve: soft start, then linear to full. Must start at 0, end at
+// 1000 and have increasing inputs.
+static constexpr struct throttleCurvePoint customCurve[] = {
+  {    0,    0 },
+  {  250,  100 },
+  {  500,  300 },
+  {  750,  600 },
+  { 1000, 1000 }
+};
+
+
+/**
+ * ****************************************************************************
+ * COMPILE-TIME CURVE DEFINITIONS
+ * ****************************************************************************
+ */
+
+// Round a fraction of full travel (0.0 - 1.0) to the curve range.
+static constexpr uint16_t toRange(double fraction) {
+  return (uint16_t)(fraction * THROTTLE_CURVE_RANGE + 0.5);
+}
+
+static constexpr double entryFraction(unsigned index) {
+  return (double)index / THROTTLE_CURVE_SEGMENTS;
+}
+
+static constexpr uint16_t linearEntry(unsigned index) {
+  return toRange(entryFraction(index));
+}
+
+static constexpr double expo(double x) {
+  return (1.0 - THROTTLE_CURVE_EXPO / 100.0) * x + (THROTTLE_CURVE_EXPO / 100.0) * x * x * x;
+}
+
+static constexpr uint16_t exponentialEntry(unsigned index) {
+  return toRange(expo(entryFraction(index)));
+}
+
+// Linear interpolation on the custom curve, starting from segment n.
+static constexpr double customOutput(double input, unsigned n) {
+  return (input <= customCurve[n + 1].input || n + 2 >= sizeof(customCurve) / sizeof(customCurve[0]))
+    ? customCurve[n].output + (input - customCurve[n].input)
+        * (double)(customCurve[n + 1].output - customCurve[n].output)
+        / (double)(customCurve[n + 1].input - customCurve[n].input)
+    : customOutput(input, n + 1);
+}
+
+static constexpr uint16_t customEntry(unsigned index) {
+  return toRange(customOutput(entryFraction(index) * 1000.0, 0) / 1000.0);
+}
+
+template<uint16_t (*Entry)(unsigned), unsigned... I>
+static constexpr struct curveTable buildTable(curveIndices<I...>) {
+  return {{ Entry(I)... }};
+}
+
+// Indexed by throttleCurveType.
+static const struct curveTable curveTables[THROTTLE_CURVE_COUNT] PROGMEM = {
+  buildTable<linearEntry>(makeCurveIndices<THROTTLE_CURVE_TABLE_SIZE>::type()),
+  buildTable<exponentialEntry>(makeCurveIndices<THROTTLE_CURVE_TABLE_SIZE>::type()),
+  buildTable<customEntry>(makeCurveIndices<THROTTLE_CURVE_TABLE_SIZE>::type())
+};
+
+
+/**
+ * ****************************************************************************
+ * INTERFACE FUNCTIONS
+ * ****************************************************************************
+ */
+
+uint16_t throttleCurveApply(uint8_t curve, uint16_t travel) {
+  if (curve >= THROTTLE_CURVE_COUNT) {
+    curve = THROTTLE_CURVE_LINEAR;
+  }
+  if (travel >= THROTTLE_CURVE_RANGE) {
+    return pgm_read_word(&curveTables[curve].values[THROTTLE_CURVE_SEGMENTS]);
+  }
+
+  const uint8_t shift = THROTTLE_CURVE_RANGE_BITS - THROTTLE_CURVE_SEGMENT_BITS;
+  uint8_t index = travel >> shift;
+  uint8_t fraction = travel & ((1 << shift) - 1);
+
+  uint16_t low = pgm_read_word(&curveTables[curve].values[index]);
+  uint16_t high = pgm_read_word(&curveTables[curve].values[index + 1]);
+
+  // Tables are monotonic, so high >= low.
+  return low + (((high - low) * fraction) >> shift);
+}
+
+uint16_t throttleCurveEntry(uint8_t curve, uint8_t index) {
+  return pgm_read_word(&curveTables[curve].values[index]);
+}
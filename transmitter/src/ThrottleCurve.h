@@ -0,0 +1,74 @@
+/**
+ * @file   ThrottleCurve.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Throttle and brake response curves.
+ *
+ * Each curve maps trigger travel from neutral (0 - THROTTLE_CURVE_RANGE) to
+ * an output in the same range. The curves are computed by the compiler
+ * into lookup tables in flash, so applying one at runtime is a table read
+ * and a linear interpolation between two neighbouring entries.
+ */
+#ifndef THROTTLE_CURVE_H
+#define THROTTLE_CURVE_H
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <stdint.h>
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+// Input and output range of a curve.
+#define THROTTLE_CURVE_RANGE_BITS 9
+#define THROTTLE_CURVE_RANGE      (1 << THROTTLE_CURVE_RANGE_BITS)
+
+// Table entries, one more than the number of segments.
+#define THROTTLE_CURVE_SEGMENT_BITS 6
+#define THROTTLE_CURVE_SEGMENTS     (1 << THROTTLE_CURVE_SEGMENT_BITS)
+#define THROTTLE_CURVE_TABLE_SIZE   (THROTTLE_CURVE_SEGMENTS + 1)
+
+// Share of cubic response in the exponential curve, in percent.
+#define THROTTLE_CURVE_EXPO 60
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+enum throttleCurveType {
+  THROTTLE_CURVE_LINEAR,
+  THROTTLE_CURVE_EXPONENTIAL,
+  THROTTLE_CURVE_CUSTOM,
+  THROTTLE_CURVE_COUNT
+};
+
+// Point of the custom curve, both axes in permille of full travel.
+struct throttleCurvePoint {
+  uint16_t input;
+  uint16_t output;
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+// Apply a curve to a travel value (0 - THROTTLE_CURVE_RANGE).
+uint16_t throttleCurveApply(uint8_t curve, uint16_t travel);
+
+// Return a table entry of a curve.
+uint16_t throttleCurveEntry(uint8_t curve, uint8_t index);
+
+#endif /* THROTTLE_CURVE_H */
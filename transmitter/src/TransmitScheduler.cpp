@@ -0,0 +1,68 @@
+/**
+ * @file   TransmitScheduler.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Adaptive transmit rate for throttle frames.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <EskProtocol.h>
+#include "TransmitScheduler.h"
+
+
+/**
+ * ****************************************************************************
+ * INTERFACE FUNCTIONS
+ * ****************************************************************************
+ */
+
+void transmitSchedulerBegin(struct transmitScheduler *scheduler, uint16_t throttle, unsigned long now) {
+  scheduler->lastTransmission = now;
+  scheduler->lastChange = now;
+  scheduler->lastThrottle = throttle;
+  scheduler->lastFailed = true;
+  scheduler->changed = true;
+}
+
+bool transmitSchedulerDue(struct transmitScheduler *scheduler, uint16_t throttle, unsigned long now) {
+  uint16_t delta = (throttle > scheduler->lastThrottle) ? throttle - scheduler->lastThrottle : scheduler->lastThrottle - throttle;
+
+  // Always send the exact neutral, so the board never rolls on a small residual.
+  if (delta >= TRANSMIT_CHANGE_THRESHOLD || (delta > 0 && throttle == PROTOCOL_THROTTLE_NEUTRAL)) {
+    scheduler->changed = true;
+    scheduler->lastChange = now;
+  }
+
+  if (scheduler->changed) {
+    return true;
+  }
+
+  return (now - scheduler->lastTransmission) >= transmitSchedulerInterval(scheduler, throttle, now);
+}
+
+uint16_t transmitSchedulerInterval(const struct transmitScheduler *scheduler, uint16_t throttle, unsigned long now) {
+  if (scheduler->lastFailed || (now - scheduler->lastChange) < TRANSMIT_MOVING_HOLD) {
+    return TRANSMIT_FAST_INTERVAL;
+  }
+
+  return transmitSchedulerKeepalive(throttle);
+}
+
+uint16_t transmitSchedulerKeepalive(uint16_t throttle) {
+  if (throttle != PROTOCOL_THROTTLE_NEUTRAL) {
+    return TRANSMIT_CRUISE_INTERVAL;
+  }
+
+  return TRANSMIT_KEEPALIVE_INTERVAL;
+}
+
+void transmitSchedulerSent(struct transmitScheduler *scheduler, uint16_t throttle, bool success, unsigned long now) {
+  scheduler->lastTransmission = now;
+  scheduler->lastThrottle = throttle;
+  scheduler->lastFailed = !success;
+  scheduler->changed = false;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file   TransmitScheduler.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Adaptive transmit rate for throttle frames.
+ *
+ * A frame is sent right away when the throttle moves more than
+ * TRANSMIT_CHANGE_THRESHOLD, and then at the fast rate for as long as the
+ * throttle keeps moving. A steady throttle away from neutral is sent at the
+ * cruise rate, and a released throttle only as a slow keepalive. After a
+ * failed transmission the fast rate is used until a frame gets through.
+ *
+ * The scheduler has no hardware dependencies; time is passed in by the
+ * caller.
+ */
+#ifndef TRANSMIT_SCHEDULER_H
+#define TRANSMIT_SCHEDULER_H
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <stdint.h>
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+// Transmit intervals in ms.
+#define TRANSMIT_FAST_INTERVAL      10  // Throttle moving (100 Hz)
+#define TRANSMIT_CRUISE_INTERVAL    50  // Steady throttle, not neutral (20 Hz)
+#define TRANSMIT_KEEPALIVE_INTERVAL 200 // Neutral and idle (5 Hz)
+
+// Smallest throttle change that is sent immediately (of 0-1023). Smaller
+// changes go out with the next scheduled frame.
+#define TRANSMIT_CHANGE_THRESHOLD   8
+
+// Time in ms to stay at the fast rate after the last throttle change.
+#define TRANSMIT_MOVING_HOLD        250
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+struct transmitScheduler {
+  unsigned long lastTransmission;
+  unsigned long lastChange;
+  uint16_t lastThrottle;  // Throttle of the last frame sent
+  bool lastFailed;
+  bool changed;           // Throttle moved past threshold since last frame
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+// Reset the scheduler, so the next call to transmitSchedulerDue() is due.
+void transmitSchedulerBegin(struct transmitScheduler *scheduler, uint16_t throttle, unsigned long now);
+
+// Return true if a frame with this throttle should be sent now.
+bool transmitSchedulerDue(struct transmitScheduler *scheduler, uint16_t throttle, unsigned long now);
+
+// Return the current interval in ms.
+uint16_t transmitSchedulerInterval(const struct transmitScheduler *scheduler, uint16_t throttle, unsigned long now);
+
+// Return the keepalive period in ms, the longest time until the next frame
+// for as long as the throttle stays at this value.
+uint16_t transmitSchedulerKeepalive(uint16_t throttle);
+
+// Register that a frame with this throttle was sent.
+void transmitSchedulerSent(struct transmitScheduler *scheduler, uint16_t throttle, bool success, unsigned long now);
+
+#endif /* TRANSMIT_SCHEDULER_H */
@@ -0,0 +1,264 @@
+/**
+ * @file   TripLog.cpp
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Ride statistics and a delta-encoded trip log in EEPROM.
+ */
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <EskProtocol.h>
+#include "TripLog.h"
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+#define SEQ_MASK      0x7FFF
+#define SEQ_TRIP_FLAG 0x8000
+
+// Delta fields: bits and position.
+#define SPEED_BITS    6
+#define SPEED_SHIFT   9
+#define VOLTAGE_BITS  5
+#define VOLTAGE_SHIFT 4
+#define AMP_HOURS_BITS 4
+
+#define SIGNED_MIN(bits) (-(1 << ((bits) - 1)))
+#define SIGNED_MAX(bits) ((1 << ((bits) - 1)) - 1)
+#define FIELD_MASK(bits) ((1 << (bits)) - 1)
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+static int blockAddress(uint8_t block);
+static bool readBlockHeader(uint8_t block, uint16_t *seq);
+static void startBlock(struct tripLog *log, uint8_t speed, uint16_t voltage, uint16_t ampHours);
+static char hexDigit(uint8_t value);
+
+
+/**
+ * ****************************************************************************
+ * INTERFACE FUNCTIONS
+ * ****************************************************************************
+ */
+
+void tripStatsBegin(struct stats *stats) {
+  memset(stats, 0, sizeof(*stats));
+}
+
+void tripStatsUpdate(struct stats *stats, float speed, long rpm, float voltage) {
+  if (speed < 0) {
+    speed = -speed;
+  }
+  if (rpm < 0) {
+    rpm = -rpm;
+  }
+
+  stats->maxSpeed = max(stats->maxSpeed, speed);
+  stats->maxRpm = max(stats->maxRpm, rpm);
+
+  if (voltage > 0.0) {
+    if (stats->minVoltage == 0.0 || voltage < stats->minVoltage) {
+      stats->minVoltage = voltage;
+    }
+    stats->maxVoltage = max(stats->maxVoltage, voltage);
+  }
+}
+
+void tripLogBegin(struct tripLog *log) {
+  bool found = false;
+
+  memset(log, 0, sizeof(*log));
+  log->block = TRIP_LOG_BLOCKS - 1;
+  log->newTrip = true;
+
+  // Continue after the newest block, allowing for wrap around.
+  for (uint8_t block = 0; block < TRIP_LOG_BLOCKS; block++) {
+    uint16_t seq;
+
+    if (readBlockHeader(block, &seq) &&
+        (!found || (int16_t)((seq - log->seq) << 1) > 0)) {
+      log->block = block;
+      log->seq = seq;
+      found = true;
+    }
+  }
+}
+
+bool tripLogRecord(struct tripLog *log, uint8_t speed, uint16_t voltage, uint16_t ampHours) {
+  if (log->dirty != 0 || log->commit != 0) {
+    return false;
+  }
+
+  if (log->newTrip || log->samples > TRIP_LOG_DELTAS) {
+    startBlock(log, speed, voltage, ampHours);
+    return true;
+  }
+
+  int16_t speedDelta = speed - log->speed;
+  int16_t voltageDelta = voltage - log->voltage;
+  uint16_t ampHoursDelta = ampHours - log->ampHours;
+
+  if (speed == 0 && speedDelta == 0 && voltageDelta == 0 && ampHoursDelta == 0) {
+    return false;
+  }
+
+  if (speedDelta < SIGNED_MIN(SPEED_BITS) || speedDelta > SIGNED_MAX(SPEED_BITS) ||
+      voltageDelta < SIGNED_MIN(VOLTAGE_BITS) || voltageDelta > SIGNED_MAX(VOLTAGE_BITS) ||
+      ampHoursDelta > FIELD_MASK(AMP_HOURS_BITS)) {
+    startBlock(log, speed, voltage, ampHours);
+    return true;
+  }
+
+  uint16_t delta = ((speedDelta & FIELD_MASK(SPEED_BITS)) << SPEED_SHIFT) |
+                   ((voltageDelta & FIELD_MASK(VOLTAGE_BITS)) << VOLTAGE_SHIFT) |
+                   ampHoursDelta;
+  uint8_t index = TRIP_LOG_HEADER_SIZE + 2 * (log->samples - 1);
+
+  log->image[index] = delta;
+  log->image[index + 1] = (delta >> 8) | 0x80;
+  log->dirty |= 3UL << index;
+  log->commit = index + 1;
+
+  log->speed = speed;
+  log->voltage = voltage;
+  log->ampHours = ampHours;
+  log->samples++;
+
+  return true;
+}
+
+bool tripLogFlush(struct tripLog *log) {
+  int address = blockAddress(log->block);
+
+  if (log->dirty == 0 && log->commit == 0) {
+    return false;
+  }
+
+#if defined(__AVR__)
+  // Never wait for a write in progress.
+  if (!eeprom_is_ready()) {
+    return true;
+  }
+#endif
+
+  // Flipping the stored CRC fails the header whatever it held.
+  if (log->invalidate) {
+    uint8_t crc = EEPROM.read(address + TRIP_LOG_HEADER_SIZE - 1);
+    EEPROM.write(address + TRIP_LOG_HEADER_SIZE - 1, crc ^ 0xFF);
+    log->invalidate = false;
+    return true;
+  }
+
+  // Deltas in order, then the header with the CRC last.
+  for (uint8_t i = 0; i < TRIP_LOG_BLOCK_SIZE; i++) {
+    uint8_t index = (i + TRIP_LOG_HEADER_SIZE) % TRIP_LOG_BLOCK_SIZE;
+
+    if (log->dirty & (1UL << index)) {
+      EEPROM.update(address + index, log->image[index]);
+      log->dirty &= ~(1UL << index);
+      return log->dirty != 0 || log->commit != 0;
+    }
+  }
+
+  // All written, make the delta valid.
+  log->image[log->commit] &= 0x7F;
+  EEPROM.update(address + log->commit, log->image[log->commit]);
+  log->commit = 0;
+
+  return false;
+}
+
+char *tripLogFormatBlock(char *line, uint8_t block) {
+  int address = blockAddress(block);
+
+  *line++ = 'L';
+  *line++ = hexDigit(block >> 4);
+  *line++ = hexDigit(block);
+  *line++ = ' ';
+
+  for (uint8_t i = 0; i < TRIP_LOG_BLOCK_SIZE; i++) {
+    uint8_t value = EEPROM.read(address + i);
+    *line++ = hexDigit(value >> 4);
+    *line++ = hexDigit(value);
+  }
+  *line = '\0';
+
+  return line;
+}
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE FUNCTIONS
+ * ****************************************************************************
+ */
+
+static int blockAddress(uint8_t block) {
+  return TRIP_LOG_START + block * TRIP_LOG_BLOCK_SIZE;
+}
+
+// Read the sequence number of a block, without the trip flag. Returns
+// false if the header is invalid.
+static bool readBlockHeader(uint8_t block, uint16_t *seq) {
+  uint8_t header[TRIP_LOG_HEADER_SIZE];
+  int address = blockAddress(block);
+
+  for (uint8_t i = 0; i < TRIP_LOG_HEADER_SIZE; i++) {
+    header[i] = EEPROM.read(address + i);
+  }
+
+  if (protocolCrc8(header, TRIP_LOG_HEADER_SIZE - 1) != header[TRIP_LOG_HEADER_SIZE - 1]) {
+    return false;
+  }
+
+  *seq = (header[0] | (header[1] << 8)) & SEQ_MASK;
+  return true;
+}
+
+// Stage the next block, starting with a sample.
+static void startBlock(struct tripLog *log, uint8_t speed, uint16_t voltage, uint16_t ampHours) {
+  uint16_t seq = (log->seq + 1) & SEQ_MASK;
+  uint16_t flags = log->newTrip ? SEQ_TRIP_FLAG : 0;
+  uint8_t *p = log->image;
+
+  log->block = (log->block + 1) % TRIP_LOG_BLOCKS;
+  log->seq = seq;
+  log->newTrip = false;
+  log->samples = 1;
+  log->speed = speed;
+  log->voltage = voltage;
+  log->ampHours = ampHours;
+
+  seq |= flags;
+  *p++ = seq;
+  *p++ = seq >> 8;
+  *p++ = speed;
+  *p++ = voltage;
+  *p++ = voltage >> 8;
+  *p++ = ampHours;
+  *p++ = ampHours >> 8;
+  *p = protocolCrc8(log->image, TRIP_LOG_HEADER_SIZE - 1);
+
+  memset(&log->image[TRIP_LOG_HEADER_SIZE], 0xFF, TRIP_LOG_BLOCK_SIZE - TRIP_LOG_HEADER_SIZE);
+  log->dirty = 0xFFFFFFFFUL;
+  log->invalidate = true;
+}
+
+static char hexDigit(uint8_t value) {
+  value &= 0x0F;
+  return (value < 10) ? '0' + value : 'A' + value - 10;
+}
@@ -0,0 +1,122 @@
+/**
+ * @file   TripLog.h
+ * @author Simon Lövgren, 2018
+ *
+ * @brief  Ride statistics and a delta-encoded trip log in EEPROM.
+ *
+ * The log fills the EEPROM after the settings store as a ring of 32 byte
+ * blocks. A block starts with the absolute values of a sample, followed by
+ * up to TRIP_LOG_DELTAS samples as the difference from the one before:
+ *
+ *   Header: seq (u16), speed (u8), voltage (u16), ampHours (u16), crc
+ *   Delta:  u16, bit 15 clear: speed (s6), voltage (s5), ampHours (u4)
+ *
+ * Speed is in 0.5 km/h, voltage in 0.1 V and amp hours in 10 mAh, all
+ * little endian. The sequence number orders the blocks; bit 15 marks the
+ * first block of a trip (power on). Unused delta slots read 0xFFFF. A
+ * sample that does not fit a delta, or a full block, starts a new block.
+ *
+ * Writing never blocks: a sample is staged in RAM and tripLogFlush() writes
+ * at most one byte per call, when the EEPROM is ready. A reused block has
+ * its header invalidated first, then its deltas cleared and the new header
+ * written, CRC last. A delta is written with bit 15 still set, which is
+ * then cleared by a last write changing only that bit. Power loss thus
+ * only loses the sample being written, and the oldest block once it is
+ * being reused.
+ *
+ * Readable over Serial with tripLogFormatBlock(), one line per block, and
+ * decoded on the host by tools/trip_log.py.
+ */
+#ifndef TRIP_LOG_H
+#define TRIP_LOG_H
+
+/**
+ * ****************************************************************************
+ * INCLUDES
+ * ****************************************************************************
+ */
+#include <stdint.h>
+#include "SettingsStore.h"
+
+
+/**
+ * ****************************************************************************
+ * DEFINES
+ * ****************************************************************************
+ */
+
+// EEPROM area used, after the settings store.
+#define TRIP_LOG_START      (SETTINGS_STORE_START + SETTINGS_STORE_SIZE)
+#define TRIP_LOG_BLOCK_SIZE 32
+#define TRIP_LOG_BLOCKS     16
+#define TRIP_LOG_SIZE       (TRIP_LOG_BLOCKS * TRIP_LOG_BLOCK_SIZE)
+
+#define TRIP_LOG_HEADER_SIZE 8
+#define TRIP_LOG_DELTAS      ((TRIP_LOG_BLOCK_SIZE - TRIP_LOG_HEADER_SIZE) / 2)
+
+// Sample period. With 13 samples per block this keeps up to 17 minutes
+// of riding; samples standing still are not logged.
+#define TRIP_LOG_PERIOD_MS 5000
+
+// Length of a line written by tripLogFormatBlock(), including null.
+#define TRIP_LOG_LINE_SIZE (4 + 2 * TRIP_LOG_BLOCK_SIZE + 1)
+
+
+/**
+ * ****************************************************************************
+ * TYPEDEFS
+ * ****************************************************************************
+ */
+
+// Ride statistics since power on.
+struct stats {
+  float maxSpeed;
+  long maxRpm;
+  float minVoltage;
+  float maxVoltage;
+};
+
+struct tripLog {
+  uint8_t block;    // Block being written
+  uint8_t samples;  // Samples in it, header included
+  uint16_t seq;     // Its sequence number, without the trip flag
+  bool newTrip;     // Next block starts a trip
+  // Last sample logged, as decoded
+  uint8_t speed;
+  uint16_t voltage;
+  uint16_t ampHours;
+  uint8_t image[TRIP_LOG_BLOCK_SIZE]; // Contents of the block
+  uint32_t dirty;                     // Bit per image byte not yet written
+  bool invalidate;                    // Old header to be invalidated first
+  uint8_t commit;                     // Delta byte to clear bit 15 in last, 0 if none
+};
+
+
+/**
+ * ****************************************************************************
+ *  PROTOTYPES
+ * ****************************************************************************
+ */
+
+// Clear statistics.
+void tripStatsBegin(struct stats *stats);
+
+// Add a telemetry snapshot: speed (km/h), erpm and pack voltage (V). A
+// voltage of 0 (no reading) is ignored.
+void tripStatsUpdate(struct stats *stats, float speed, long rpm, float voltage);
+
+// Find the end of the log. The next sample starts a new trip.
+void tripLogBegin(struct tripLog *log);
+
+// Log a sample: speed (0.5 km/h), voltage (0.1 V) and amp hours (10 mAh).
+// Returns false if it was skipped, standing still or with the last sample
+// still being written.
+bool tripLogRecord(struct tripLog *log, uint8_t speed, uint16_t voltage, uint16_t ampHours);
+
+// Write at most one staged byte to EEPROM. Returns true while bytes remain.
+bool tripLogFlush(struct tripLog *log);
+
+// Write block as "L<block> <bytes>" in hex. Returns a pointer to the null.
+char *tripLogFormatBlock(char *line, uint8_t block);
+
+#endif /* TRIP_LOG_H */
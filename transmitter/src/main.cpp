@@ -17,7 +17,25 @@
 #include <SPI.h>
 #include <EEPROM.h>
 #include <RF24.h>
+#include <avr/sleep.h>
 #include "VescUart.h"
+#include <EskProtocol.h>
+#include "AdcSampler.h"
+#include "TextFormat.h"
+#include "TransmitScheduler.h"
+#include "ThrottleCurve.h"
+#include "LinkQuality.h"
+#include "ChannelScan.h"
+#include "SettingsStore.h"
+#include "SettingsTable.h"
+#include "Bitmap.h"
+#include "BitmapAssets.h"
+#include "BatteryModel.h"
+#include "Telemetry.h"
+#include "TripLog.h"
+#include "PowerManager.h"
+#include <TaskScheduler.h>
+#include <LoopTiming.h>
 
 
 /**
@@ -35,6 +53,56 @@
   #define DEBUG_PRINT(x)
 #endif
 
+// Measure loop and stage durations. Shown on a diagnostics page after the
+// last setting, and sent as binary frames over Serial (tools/loop_timing.py).
+// #define LOOP_TIMING
+
+#ifdef LOOP_TIMING
+  #define TIMING_START(start)         unsigned long start = micros()
+  #define TIMING_RECORD(stage, start) loopTimingRecord(&timingStages[stage], micros() - (start))
+#else
+  #define TIMING_START(start)
+  #define TIMING_RECORD(stage, start)
+#endif
+
+// Answer an 'L' over Serial (115200 baud) with the trip log and the ride
+// statistics, one line per loop pass (tools/trip_log.py). Not together
+// with LOOP_TIMING, which uses Serial for its own frames.
+// #define TRIP_LOG_SERIAL
+
+// Print the estimated current per power mode and the wake timing over
+// Serial (115200 baud) every 10 s, as "P <mode> <active µA> <idle µA>
+// <sleep µA> <wakes> <last wake µs> <max wake µs> <late wakes> <power on
+// to first packet µs>". Not together with the other Serial options.
+// #define POWER_SERIAL
+
+// Print the statistics of one task over Serial (115200 baud) every 100 ms,
+// the next task each time, and clear them: "T <task> <runs> <overruns>
+// <skipped> <min late µs> <avg late µs> <max late µs> <max run µs>". Not
+// together with the other Serial options.
+// #define TASK_STATS_SERIAL
+
+// Give up on a packet the radio never reports back on (µs), as the blocking
+// write of the library does.
+#define RADIO_SEND_TIMEOUT_US 95000UL
+
+// Transmitter settling time of the radio before each attempt (µs).
+#define RADIO_SETTLE_US 130
+
+// Time from powering the radio up until it may send (µs), Tpd2stby of the
+// nRF24L01+ with its crystal. The library's own wait for it is built out
+// (RF24_POWERUP_DELAY in platformio.ini), so the loop carries on meanwhile.
+#define RADIO_POWER_UP_US 1500UL
+
+// Power the radio up this long before a packet is due when it is powered
+// down between packets (ms), a control period, so it is up by the pass
+// that sends.
+#define RADIO_POWER_UP_AHEAD_MS 2
+
+// Channel scan readings per control pass while the link is lost, to find a
+// channel sooner. Each takes a little over CHANNEL_SCAN_DWELL_US.
+#define CHANNEL_SCAN_LOST_READINGS 8
+
 
 /**
  * ****************************************************************************
@@ -42,37 +110,61 @@
  * ****************************************************************************
  */
 
-// Defining struct to hold UART data.
-struct vescValues {
-  float ampHours;
-  float inpVoltage;
-  long rpm;
-  long tachometerAbs;
+// Icons shown in the signal position of the main screen.
+enum signalIcon {
+  SIGNAL_NOCONNECTION,
+  SIGNAL_CONNECTED,
+  SIGNAL_TRANSMITTING
 };
 
-// Defining struct to hold stats 
-struct stats {
-  float maxSpeed;
-  long maxRpm;
-  float minVoltage;
-  float maxVoltage;
+// Screens shown while booting, drawn by the render scheduler.
+enum splashScreen {
+  SPLASH_NONE,
+  SPLASH_LOGO,
+  SPLASH_TITLE
 };
 
-// Defining struct to hold setting values while remote is turned on.
-struct settings {
-  byte triggerMode;
-  byte batteryType;
-  byte batteryCells;
-  byte motorPoles;
-  byte motorPulley;
-  byte wheelPulley;
-  byte wheelDiameter;
-  bool useUart;
-  int minHallValue;
-  int centerHallValue;
-  int maxHallValue;
+// Packet the radio is sending, finished by a later control pass.
+enum radioSend {
+  RADIO_SEND_NONE,
+  RADIO_SEND_THROTTLE,
+  RADIO_SEND_LINK
 };
 
+// Timed parts of the loop.
+enum timingStage {
+  TIMING_LOOP,
+  TIMING_THROTTLE,
+  TIMING_TRANSMIT,
+  TIMING_DISPLAY,
+  TIMING_NUM_STAGES
+};
+
+// Defining struct to hold everything shown on the display. A new frame is
+// only rendered when this differs from the last rendered state.
+struct displayState {
+  byte splash;
+  bool settings;
+  // Main screen
+  short throttleBar;  // Positive: throttle width, negative: brake width
+  byte page;
+  unsigned long pageValue; // Fixed-point, scaled by 10^pageDecimals
+  byte pageDecimals;
+  byte batteryBars;
+  byte signal;
+  byte linkAckRate;
+  unsigned int boardVoltage; // 0.1 V
+  // Settings screen
+  byte setting;
+  int settingValue;
+  bool settingSelected;
+#ifdef LOOP_TIMING
+  // Diagnostics page, stage in settingValue
+  unsigned int timingAverage;
+  unsigned int timingMax;
+  byte timingBars[LOOP_TIMING_BUCKETS];
+#endif
+};
 
 /**
  * ****************************************************************************
@@ -83,62 +175,34 @@ struct settings {
 // Defining the type of display used (128x32)
 U8G2_SSD1306_128X32_UNIVISION_1_HW_I2C u8g2(U8G2_R0, U8X8_PIN_NONE);
 
-static unsigned char logo_bits[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7e, 0x00, 0x80, 0x3c, 0x01, 0xe0, 0x00, 0x07, 0x70, 0x18, 0x0e, 0x30, 0x18, 0x0c, 0x98, 0x99, 0x19, 0x80, 0xff, 0x01, 0x04, 0xc3, 0x20, 0x0c, 0x99, 0x30, 0xec, 0xa5, 0x37, 0xec, 0xa5, 0x37, 0x0c, 0x99, 0x30, 0x04, 0xc3, 0x20, 0x80, 0xff, 0x01, 0x98, 0x99, 0x19, 0x30, 0x18, 0x0c, 0x70, 0x18, 0x0e, 0xe0, 0x00, 0x07, 0x80, 0x3c, 0x01, 0x00, 0x7e, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
-
-static unsigned char signal_transmitting_bits[] = {
-  0x18, 0x00, 0x0c, 0x00, 0xc6, 0x00, 0x66, 0x00, 0x23, 0x06, 0x33, 0x0f,
-  0x33, 0x0f, 0x23, 0x06, 0x66, 0x00, 0xc6, 0x00, 0x0c, 0x00, 0x18, 0x00
-};
-
-static unsigned char signal_connected_bits[] = {
-  0x18, 0x00, 0x0c, 0x00, 0xc6, 0x00, 0x66, 0x00, 0x23, 0x06, 0x33, 0x09,
-  0x33, 0x09, 0x23, 0x06, 0x66, 0x00, 0xc6, 0x00, 0x0c, 0x00, 0x18, 0x00
-};
-
-static unsigned char signal_noconnection_bits[] = {
-  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x06, 0x00, 0x09,
-  0x00, 0x09, 0x00, 0x06, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
-};
-
 // Defining variables for speed and distance calculation
 float gearRatio;
 float ratioRpmSpeed;
 float ratioPulseDistance;
 
+// Board battery state of charge
+struct batteryModel boardBattery;
+
+// Ride statistics and trip log
+struct stats rideStats;
+struct tripLog tripLog;
+#ifdef TRIP_LOG_SERIAL
+byte tripLogDumpLine = TRIP_LOG_BLOCKS + 1; // Next line to send, past the end when idle
+#endif
+
 byte currentSetting = 0;
-const byte numOfSettings = 11;
-
-String settingPages[numOfSettings][2] = {
-  {"Trigger",         ""},
-  {"Battery type",    ""},
-  {"Battery cells",   "S"},
-  {"Motor poles",     ""},
-  {"Motor pulley",    "T"},
-  {"Wheel pulley",    "T"},
-  {"Wheel diameter",  "mm"},
-  {"UART data",       ""},
-  {"Throttle min",    ""},
-  {"Throttle center", ""},
-  {"Throttle max",    ""}
-};
+const byte numOfSettings = SETTINGS_COUNT;
 
-// Setting rules format: default, min, max.
-int settingRules[numOfSettings][3] {
-  {0, 0, 3}, // 0 Killswitch, 1 cruise & 2 data toggle
-  {0, 0, 1}, // 0 Li-ion & 1 LiPo
-  {10, 0, 12},
-  {14, 0, 250},
-  {15, 0, 250},
-  {40, 0, 250},
-  {83, 0, 250},
-  {1, 0, 1}, // Yes or no
-  {0, 0, 1023},
-  {512, 0, 1023},
-  {1023, 0, 1023}
-};
+#ifdef LOOP_TIMING
+const byte numOfPages = numOfSettings + 1; // Diagnostics page after the last setting
+#else
+const byte numOfPages = numOfSettings;
+#endif
 
 struct vescValues data;
+struct telemetry telemetryState; // Age of the fields in data
 struct settings remoteSettings;
+struct settingsStore settingsLog;
 
 // Pin defination
 const byte triggerPin = 2;
@@ -153,21 +217,69 @@ const float refVoltage = 5.0; // Set to 4.5V if you are testing connected to USB
 
 // Defining variables for Hall Effect throttle.
 short hallMeasurement, throttle;
-byte hallCenterMargin = 4;
+byte hallCenterMargin = 16;
 
 // Defining variables for NRF24 communication
 bool connected = false;
 short failCount;
 const uint64_t pipe = 0xE8E8F0F0E1LL; // If you change the pipe, you will need to update it on the receiver to.
-unsigned long lastTransmission;
+struct transmitScheduler txScheduler;
+struct linkQuality radioLink;
+byte radioLinkLevel; // Level the radio is set to
+byte radioChannel = PROTOCOL_RENDEZVOUS_CHANNEL; // Channel the radio is on
+byte selectedChannel = PROTOCOL_RENDEZVOUS_CHANNEL; // Quietest channel found
+bool channelsScanned = false; // Scan started since the link was lost
+byte radioSending = RADIO_SEND_NONE; // Packet on the air
+unsigned long radioSendStart;
+bool radioPowered = false; // Powered up, and since when (µs)
+unsigned long radioPowerUpStart;
+short sentThrottle; // Throttle in the packet on the air, and when it was started (ms)
+unsigned long sentTime;
+byte announcedLevel; // Level and channel in the link packet on the air
+byte announcedChannel;
+struct channelScan backgroundScan; // Scan taken alongside the link after boot
+unsigned int backgroundScanLeft; // Readings still to take
+
+// Power modes. The wake interrupt catches the trigger or the hall sensor
+// moving while the MCU sleeps.
+struct powerManager powerState;
+byte poweredMode = POWER_ACTIVE; // Mode the hardware is set to
+volatile bool wakePending = false;
+volatile unsigned long wakeTime;
+const byte displayContrast = 255;
+const byte displayDimContrast = 8;
 
 // Defining variables for OLED display
-char displayBuffer[20];
-String displayString;
 short displayData = 0;
+bool signalBlink = false;
 unsigned long lastSignalBlink;
 unsigned long lastDataRotation;
 
+// Defining variables for the display render scheduler
+const byte displayMaxFps = 20; // Upper limit of redraws per second
+const unsigned long displayFramePeriod = 1000 / displayMaxFps;
+struct displayState renderedState;
+bool displayRedraw = true; // Force a redraw on next frame
+bool displayRendering = false;
+unsigned long lastDisplayFrame;
+
+// A frame is drawn a page (8 pixel rows) at a time, and each page sent
+// displaySliceTiles tiles (8x8 pixels) at a time: 32 bytes, about 0.8 ms at
+// 400 kHz, where a whole page would hold up the control task for 3 ms.
+const byte displaySliceTiles = 4;
+byte displayRow; // Page of the frame being drawn or sent
+byte displayTile; // Next tile of it to send
+bool displayDrawn = false; // Page drawn, being sent
+
+// The display is started by the display task, after the first packet, and
+// switched on once the first frame has filled its memory. The boot screens
+// are then each shown for splashPeriod (ms) while the remote already runs.
+bool displayStarted = false;
+bool displayShown = false;
+const unsigned long splashPeriod = 1500;
+byte splash = SPLASH_LOGO;
+unsigned long splashStart;
+
 // Instantiating RF24 object for NRF24 communication
 RF24 radio(9, 10);
 
@@ -179,6 +291,17 @@ bool settingsLoopFlag = false;
 bool settingsChangeFlag = false;
 bool settingsChangeValueFlag = false;
 
+#ifdef LOOP_TIMING
+// Defining variables for loop timing
+const char *timingStageNames[TIMING_NUM_STAGES] = {"Loop", "Throttle", "Transmit", "Display"};
+const unsigned int timingReportPeriod = 1000;
+const byte timingBarHeight = 20;
+struct loopTimingStage timingStages[TIMING_NUM_STAGES];
+struct loopTimingStage timingReport[TIMING_NUM_STAGES]; // Last complete period
+struct loopTimingExport timingExport;
+unsigned long lastTimingReport;
+#endif
+
 
 /**
  * ****************************************************************************
@@ -193,21 +316,81 @@ void setDefaultEEPROMSettings();
 void loadEEPROMSettings();
 void updateEEPROMSettings();
 void calculateRatios();
-int getSettingValue(int index);
-void setSettingValue(int index, int value);
 bool inRange(int val, int minimum, int maximum);
 boolean triggerActive();
 void transmitToVesc();
+bool radioReady();
+void radioPowerDown();
+void startSend(byte sending, const uint8_t *frame, uint8_t size);
+bool finishSend();
+unsigned long sendDuration();
+void throttleSent(bool sendSuccess);
+void changeLinkLevel(byte level);
+void applyLinkLevel(byte level);
+void changeChannel(byte channel);
+void announceLink(byte level, byte channel);
+void linkSent(bool acked);
+void startChannelScan();
+void scanNextChannel();
 void calculateThrottlePosition();
 int batteryLevel();
 float batteryVoltage();
+void updateControl();
+void updatePower();
+void applyPowerMode(byte mode);
+void enableWakeInterrupt(bool enable);
+void sleepUntilInterrupt();
+#ifdef POWER_SERIAL
+void reportPower();
+#endif
+#ifdef TASK_STATS_SERIAL
+void reportTaskStats();
+#endif
+void updateBoardBattery();
+void flushTripLog();
+void updateTripLog();
+bool tripTelemetryFresh(unsigned long now);
+#ifdef TRIP_LOG_SERIAL
+void sendTripLog();
+#endif
+void updateDisplay();
 void updateMainDisplay();
+void renderDisplaySlice();
+void drawScreen();
+void updateDisplayState(struct displayState *state);
 void drawStartScreen();
-void drawTitleScreen(String title);
+void drawTitleScreen(const char *title);
 void drawPage();
 void drawThrottle();
 void drawSignal();
+void drawBitmap(int x, int y, const struct bitmapAsset *asset);
 void drawBatteryLevel();
+void updateLoopTiming();
+void updateTimingState(struct displayState *state);
+void drawTimingPage();
+
+// Tasks run from loop(), highest priority first. Periods and deadlines in
+// µs. The control task samples the throttle and leaves the transmit rate to
+// the transmit scheduler; its period bounds how late a throttle change goes
+// out.
+const struct task tasks[] = {
+  { updateControl,      2000,                            5000 },
+  { flushTripLog,       5000,                            5000 },
+  { updateBoardBattery, BATTERY_MODEL_UPDATE_MS * 1000UL, 10000 },
+  { updateTripLog,      TRIP_LOG_PERIOD_MS * 1000UL,      10000 },
+  { updateDisplay,      5000,                            20000 },
+#ifdef LOOP_TIMING
+  { updateLoopTiming,   5000,                            20000 },
+#endif
+#ifdef POWER_SERIAL
+  { reportPower,        10000000UL,                      20000 },
+#endif
+#ifdef TASK_STATS_SERIAL
+  { reportTaskStats,    100000UL,                        20000 },
+#endif
+};
+struct taskState taskStates[sizeof(tasks) / sizeof(tasks[0])];
+struct taskScheduler scheduler;
 
 
 /**
@@ -222,42 +405,102 @@ void setup() {
   #ifdef DEBUG
     Serial.begin(9600);
   #endif
+
+  #ifdef TRIP_LOG_SERIAL
+    Serial.begin(115200);
+  #endif
+
+  #ifdef POWER_SERIAL
+    Serial.begin(115200);
+  #endif
+
+  #ifdef TASK_STATS_SERIAL
+    Serial.begin(115200);
+  #endif
+
+  #ifdef LOOP_TIMING
+    Serial.begin(115200);
+    for (byte i = 0; i < TIMING_NUM_STAGES; i++) {
+      loopTimingReset(&timingStages[i]);
+      loopTimingReset(&timingReport[i]);
+    }
+  #endif
   
   loadEEPROMSettings();
+  tripStatsBegin(&rideStats);
+  tripLogBegin(&tripLog);
 
   pinMode(triggerPin, INPUT_PULLUP);
   pinMode(hallSensorPin, INPUT);
   pinMode(batteryMeasurePin, INPUT);
 
-  u8g2.begin();
-
-  drawStartScreen();
+  // Start background sampling of hall sensor and battery.
+  adcSamplerBegin();
 
   if (triggerActive()) {
     changeSettings = true;
-    drawTitleScreen("Remote Settings");
+    // Held to enter the menu, not a press in it.
+    settingsChangeFlag = true;
   }
 
-  // Start radio communication
+  // Start radio communication on the rendezvous channel. A quiet channel is
+  // searched for alongside the link, see scanNextChannel().
   radio.begin();
-  radio.setPALevel(RF24_PA_MAX);
+  radioPowered = true;
+  radioPowerUpStart = micros();
+  linkQualityBegin(&radioLink);
+  telemetryBegin(&telemetryState);
+  applyLinkLevel(radioLink.level);
   radio.enableAckPayload();
   radio.enableDynamicPayloads();
   radio.openWritingPipe(pipe);
 
+  startChannelScan();
+
+  transmitSchedulerBegin(&txScheduler, throttle, millis());
+
   #ifdef DEBUG
     printf_begin();
     radio.printDetails();
   #endif
+
+  // The control task runs first and sends the throttle at once, the display
+  // is started by its own task after that.
+  powerManagerBegin(&powerState, micros());
+  taskSchedulerBegin(&scheduler, tasks, taskStates, sizeof(tasks) / sizeof(tasks[0]), micros);
 }
 
 void loop() {
-  
+  TIMING_START(loopStart);
+
+  if (taskSchedulerRun(&scheduler)) {
+    TIMING_RECORD(TIMING_LOOP, loopStart);
+  } else {
+    sleepUntilInterrupt();
+  }
+}
+
+
+/**
+ * ****************************************************************************
+ * PRIVATE FUNCTIONS
+ * ****************************************************************************
+ */
+
+// Read the throttle, and either drive the settings menu or transmit it.
+void updateControl() {
+  TIMING_START(controlStart);
+
   calculateThrottlePosition();
+  TIMING_RECORD(TIMING_THROTTLE, controlStart);
+
+  updatePower();
 
   if (changeSettings == true) {
-    // Use throttle and trigger to change settings
-    controlSettingsMenu();
+    // Use throttle and trigger to change settings, once the menu is shown
+    if (splash == SPLASH_NONE) {
+      controlSettingsMenu();
+    }
   }
   else
   {
@@ -268,34 +511,169 @@ void loop() {
     }
     else
     {
-      // 127 is the middle position - no throttle and no brake/reverse
-      throttle = 127;
+      // Neutral is the middle position - no throttle and no brake/reverse
+      throttle = PROTOCOL_THROTTLE_NEUTRAL;
     }
     // Transmit to receiver
+    TIMING_START(transmitStart);
     transmitToVesc();
+    TIMING_RECORD(TIMING_TRANSMIT, transmitStart);
+  }
+}
+
+// Follow the power mode from the trigger and the throttle, and set the
+// display, radio and sampler to it.
+void updatePower() {
+  unsigned long now = micros();
+  bool woken;
+  unsigned long wokenAt;
+
+  noInterrupts();
+  woken = wakePending;
+  wokenAt = wakeTime;
+  wakePending = false;
+  interrupts();
+
+  if (woken && poweredMode == POWER_SLEEP) {
+    // The sampler is stopped while asleep, see what moved. Only the wake
+    // interrupt leads out of sleep, so this is where it starts again.
+    adcSamplerBegin();
+    calculateThrottlePosition();
+  }
+
+  if (changeSettings || triggerActive() || throttle != PROTOCOL_THROTTLE_NEUTRAL) {
+    powerManagerActivity(&powerState, woken ? wokenAt : now);
   }
 
-  // Call function to update display and LED
-  updateMainDisplay();
+  byte mode = powerManagerUpdate(&powerState, now);
+
+  if (mode != poweredMode) {
+    applyPowerMode(mode);
+  } else if (woken && mode == POWER_SLEEP) {
+    // Noise on the hall sensor pin, back to sleep.
+    adcSamplerEnd();
+  }
 }
 
+void applyPowerMode(byte mode) {
+  if (mode == POWER_ACTIVE) {
+    if (poweredMode == POWER_SLEEP) {
+      u8g2.setPowerSave(0);
+    }
+    u8g2.setContrast(displayContrast);
+    displayRedraw = true;
+    enableWakeInterrupt(false);
+    // Start the radio's oscillator while the throttle packet is prepared.
+    radioReady();
+
+    // Send the throttle at once.
+    transmitSchedulerBegin(&txScheduler, throttle, millis());
+  } else {
+    if (poweredMode == POWER_ACTIVE) {
+      u8g2.setContrast(displayDimContrast);
+      enableWakeInterrupt(true);
+      if (radioSending == RADIO_SEND_NONE) {
+        radioPowerDown();
+      }
+    }
+    if (mode == POWER_SLEEP) {
+      u8g2.setPowerSave(1);
+      adcSamplerEnd();
+    }
+  }
 
-/**
- * ****************************************************************************
- * PRIVATE FUNCTIONS
- * ****************************************************************************
- */
+  poweredMode = mode;
+}
+
+// Interrupt on any change of the trigger (D2, PCINT18) or the hall sensor
+// (A0, PCINT8). The hall sensor only crosses the logic levels well away
+// from center, smaller movements are seen by the sampler when idle.
+void enableWakeInterrupt(bool enable) {
+#if defined(__AVR__)
+  noInterrupts();
+  PCMSK1 = enable ? _BV(PCINT8) : 0;
+  PCMSK2 = enable ? _BV(PCINT18) : 0;
+  PCIFR = _BV(PCIF1) | _BV(PCIF2);
+  PCICR = enable ? (_BV(PCIE1) | _BV(PCIE2)) : 0;
+  interrupts();
+#else
+  (void)enable;
+#endif
+}
+
+// Sleep until the next interrupt: the timer tick every 1 ms, an ADC
+// sample, or the wake interrupt.
+void sleepUntilInterrupt() {
+  unsigned long start = micros();
+
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  sleep_mode();
+
+  powerManagerSlept(&powerState, micros() - start);
+}
+
+#ifdef POWER_SERIAL
+void reportPower() {
+  Serial.print(F("P "));
+  Serial.print(poweredMode);
+  for (byte mode = 0; mode < POWER_NUM_MODES; mode++) {
+    Serial.print(' ');
+    Serial.print(powerManagerCurrent(&powerState, mode));
+  }
+  Serial.print(' ');
+  Serial.print(powerState.wakes);
+  Serial.print(' ');
+  Serial.print(powerState.lastWake);
+  Serial.print(' ');
+  Serial.print(powerState.maxWake);
+  Serial.print(' ');
+  Serial.print(powerState.lateWakes);
+  Serial.print(' ');
+  Serial.println(powerState.firstPacket);
+}
+#endif
+
+#ifdef TASK_STATS_SERIAL
+// One line fits the transmit buffer, so printing never waits.
+void reportTaskStats() {
+  static byte task = 0;
+  struct taskStats *stats = &taskStates[task].stats;
+
+  Serial.print(F("T "));
+  Serial.print(task);
+  Serial.print(' ');
+  Serial.print(stats->runs);
+  Serial.print(' ');
+  Serial.print(stats->overruns);
+  Serial.print(' ');
+  Serial.print(stats->skipped);
+  Serial.print(' ');
+  Serial.print(stats->minLateness);
+  Serial.print(' ');
+  Serial.print(taskStatsAverageLateness(stats));
+  Serial.print(' ');
+  Serial.print(stats->maxLateness);
+  Serial.print(' ');
+  Serial.println(stats->maxDuration);
+  taskStatsReset(stats);
+
+  task = (task + 1) % (sizeof(tasks) / sizeof(tasks[0]));
+}
+#endif
 
 void controlSettingsMenu() {
   if (triggerActive()) {
     if (settingsChangeFlag == false) {
 
-      // Save settings to EEPROM
-      if (changeSelectedSetting == true) {
-        updateEEPROMSettings();
-      }
+      // Pages after the settings have nothing to select.
+      if (currentSetting < numOfSettings) {
+        // Save settings to EEPROM
+        if (changeSelectedSetting == true) {
+          updateEEPROMSettings();
+        }
 
-      changeSelectedSetting = !changeSelectedSetting;
+        changeSelectedSetting = !changeSelectedSetting;
+      }
       settingsChangeFlag = true;
     }
   } else {
@@ -305,10 +683,10 @@ void controlSettingsMenu() {
   if (hallMeasurement >= (remoteSettings.maxHallValue - 150) && settingsLoopFlag == false) {
     // Up
     if (changeSelectedSetting == true) {
-      int val = getSettingValue(currentSetting) + 1;
+      int val = settingsTableGet(&remoteSettings, currentSetting) + 1;
 
-      if (inRange(val, settingRules[currentSetting][1], settingRules[currentSetting][2])) {
-        setSettingValue(currentSetting, val);
+      if (settingsTableInRange(currentSetting, val)) {
+        settingsTableSet(&remoteSettings, currentSetting, val);
         settingsLoopFlag = true;
       }
     } else {
@@ -321,14 +699,14 @@ void controlSettingsMenu() {
   else if (hallMeasurement <= (remoteSettings.minHallValue + 150) && settingsLoopFlag == false) {
     // Down
     if (changeSelectedSetting == true) {
-      int val = getSettingValue(currentSetting) - 1;
+      int val = settingsTableGet(&remoteSettings, currentSetting) - 1;
 
-      if (inRange(val, settingRules[currentSetting][1], settingRules[currentSetting][2])) {
-        setSettingValue(currentSetting, val);
+      if (settingsTableInRange(currentSetting, val)) {
+        settingsTableSet(&remoteSettings, currentSetting, val);
         settingsLoopFlag = true;
       }
     } else {
-      if (currentSetting < (numOfSettings - 1)) {
+      if (currentSetting < (numOfPages - 1)) {
         currentSetting++;
         settingsLoopFlag = true;
       }
@@ -346,60 +724,69 @@ void drawSettingNumber() {
   u8g2.drawRFrame(x + 102, y - 10, 22, 32, 4);
 
   // Draw current setting number
-  displayString = (String)(currentSetting + 1);
-  displayString.toCharArray(displayBuffer, displayString.length() + 1);
+  char buffer[4];
+  formatUnsigned(buffer, renderedState.setting + 1, 1);
 
   u8g2.setFont(u8g2_font_profont22_tn);
-  u8g2.drawStr(x + 108, 22, displayBuffer);
+  u8g2.drawStr(x + 108, 22, buffer);
 }
 
 void drawSettingsMenu() {
   // Position on OLED
   int x = 0; int y = 10;
 
-  // Draw setting title
-  displayString = settingPages[currentSetting][0];
-  displayString.toCharArray(displayBuffer, displayString.length() + 1);
+  struct settingDescriptor descriptor;
+  settingsTableDescriptor(renderedState.setting, &descriptor);
 
+  // Draw setting title
   u8g2.setFont(u8g2_font_profont12_tr);
-  u8g2.drawStr(x, y, displayBuffer);
+  u8g2.drawStr(x, y, descriptor.label);
 
-  int val = getSettingValue(currentSetting);
+  // Draw value and unit
+  char buffer[TEXT_FORMAT_MAX_DIGITS + SETTINGS_TABLE_UNIT_SIZE];
+  char *end = formatUnsigned(buffer, renderedState.settingValue, 1);
+  formatString(end, descriptor.unit);
 
-  displayString = (String)val + "" + settingPages[currentSetting][1];
-  displayString.toCharArray(displayBuffer, displayString.length() + 1);
   u8g2.setFont(u8g2_font_10x20_tr  );
 
-  if (changeSelectedSetting == true) {
-    u8g2.drawStr(x + 10, y + 20, displayBuffer);
+  if (renderedState.settingSelected == true) {
+    u8g2.drawStr(x + 10, y + 20, buffer);
   } else {
-    u8g2.drawStr(x, y + 20, displayBuffer);
+    u8g2.drawStr(x, y + 20, buffer);
   }
 }
 
 void setDefaultEEPROMSettings() {
-  for (int i = 0; i < numOfSettings; i++) {
-    setSettingValue(i, settingRules[i][0]);
-  }
-
+  settingsTableReset(&remoteSettings);
   updateEEPROMSettings();
 }
 
 void loadEEPROMSettings() {
-  // Load settings from EEPROM to custom struct
-  EEPROM.get(0, remoteSettings);
-
   bool rewriteSettings = false;
 
-  // Loop through all settings to check if everything is fine
-  for (int i = 0; i < numOfSettings; i++) {
-    int val = getSettingValue(i);
+  if (settingsStoreBegin(&settingsLog)) {
+    settingsTableReset(&remoteSettings);
+
+    for (int i = 0; i < numOfSettings; i++) {
+      uint16_t val;
 
-    if (! inRange(val, settingRules[i][1], settingRules[i][2])) {
-      // Setting is damaged or never written. Rewrite default.
-      rewriteSettings = true;
-      setSettingValue(i, settingRules[i][0]);
+      if (settingsStoreGet(&settingsLog, i, &val)) {
+        settingsTableSet(&remoteSettings, i, val);
+      } else {
+        // Never written. Rewrite default.
+        rewriteSettings = true;
+      }
     }
+  } else {
+    // Nothing in the store yet; take settings from the old layout (whole
+    // struct at address 0), which the validation rejects if not present.
+    EEPROM.get(0, remoteSettings);
+    rewriteSettings = true;
+  }
+
+  // Check if everything is fine, damaged settings are set to default.
+  if (settingsTableValidate(&remoteSettings) == false) {
+    rewriteSettings = true;
   }
 
   if (rewriteSettings == true) {
@@ -410,9 +797,11 @@ void loadEEPROMSettings() {
   }
 }
 
-// Write settings to the EEPROM then exiting settings menu.
+// Write changed settings to the EEPROM then exiting settings menu.
 void updateEEPROMSettings() {
-  EEPROM.put(0, remoteSettings);
+  for (int i = 0; i < numOfSettings; i++) {
+    settingsStoreSet(&settingsLog, i, settingsTableGet(&remoteSettings, i));
+  }
   calculateRatios();
 }
 
@@ -423,42 +812,8 @@ void calculateRatios() {
   ratioRpmSpeed = (gearRatio * 60 * (float)remoteSettings.wheelDiameter * 3.14156) / (((float)remoteSettings.motorPoles / 2) * 1000000); // ERPM to Km/h
 
   ratioPulseDistance = (gearRatio * (float)remoteSettings.wheelDiameter * 3.14156) / (((float)remoteSettings.motorPoles * 3) * 1000000); // Pulses to km travelled
-}
 
-// Get settings value by index (usefull when iterating through settings).
-int getSettingValue(int index) {
-  int value;
-  switch (index) {
-    case 0: value = remoteSettings.triggerMode;     break;
-    case 1: value = remoteSettings.batteryType;     break;
-    case 2: value = remoteSettings.batteryCells;    break;
-    case 3: value = remoteSettings.motorPoles;      break;
-    case 4: value = remoteSettings.motorPulley;     break;
-    case 5: value = remoteSettings.wheelPulley;     break;
-    case 6: value = remoteSettings.wheelDiameter;   break;
-    case 7: value = remoteSettings.useUart;         break;
-    case 8: value = remoteSettings.minHallValue;    break;
-    case 9: value = remoteSettings.centerHallValue; break;
-    case 10: value = remoteSettings.maxHallValue;   break;
-  }
-  return value;
-}
-
-// Set a value of a specific setting by index.
-void setSettingValue(int index, int value) {
-  switch (index) {
-    case 0: remoteSettings.triggerMode = value;     break;
-    case 1: remoteSettings.batteryType = value;     break;
-    case 2: remoteSettings.batteryCells = value;    break;
-    case 3: remoteSettings.motorPoles = value;      break;
-    case 4: remoteSettings.motorPulley = value;     break;
-    case 5: remoteSettings.wheelPulley = value;     break;
-    case 6: remoteSettings.wheelDiameter = value;   break;
-    case 7: remoteSettings.useUart = value;         break;
-    case 8: remoteSettings.minHallValue = value;    break;
-    case 9: remoteSettings.centerHallValue = value; break;
-    case 10: remoteSettings.maxHallValue = value;   break;
-  }
+  batteryModelBegin(&boardBattery, remoteSettings.batteryType, remoteSettings.batteryCells);
 }
 
 // Check if an integer is within a min and max value
@@ -475,63 +830,310 @@ boolean triggerActive() {
 }
 
 // Function used to transmit the throttle value, and receive the VESC realtime data.
+// The radio sends and retries on its own: a packet is started here and its
+// outcome picked up by a later pass, so a weak link never holds up the loop.
 void transmitToVesc() {
-  // Transmit once every 50 millisecond
-  if (millis() - lastTransmission >= 50) {
+  if (radioSending != RADIO_SEND_NONE && finishSend() == false) {
+    return;
+  }
+
+  // Scan while the radio is free, more so once the link is lost. Finishing
+  // may have started a link packet.
+  if (radioSending == RADIO_SEND_NONE && poweredMode == POWER_ACTIVE) {
+    byte readings = (connected || failCount == 0) ? 1 : CHANNEL_SCAN_LOST_READINGS;
+
+    for (; readings > 0 && backgroundScanLeft > 0; readings--) {
+      scanNextChannel();
+    }
+  }
 
-    lastTransmission = millis();
+  // Start the oscillator of a powered down radio a pass ahead of the packet.
+  unsigned long now = millis();
+  if (radioPowered == false && radioSending == RADIO_SEND_NONE &&
+      now + RADIO_POWER_UP_AHEAD_MS - txScheduler.lastTransmission >= transmitSchedulerInterval(&txScheduler, throttle, now)) {
+    radioReady();
+  }
 
-    boolean sendSuccess = false;
-    // Transmit the speed value (0-255).
-    sendSuccess = radio.write(&throttle, sizeof(throttle));
+  // Transmit at once on throttle change, otherwise at the scheduled rate.
+  // A throttle change may still find the radio powered down, it then goes
+  // out on a later pass.
+  if (radioSending == RADIO_SEND_NONE && transmitSchedulerDue(&txScheduler, throttle, now)) {
+    uint8_t frame[PROTOCOL_MAX_FRAME_SIZE];
+    uint8_t size;
 
-    // Listen for an acknowledgement reponse (return of VESC data).
-    while (radio.isAckPayloadAvailable()) {
-      radio.read(&data, sizeof(data));
+    if (radioReady() == false) {
+      return;
     }
 
-    if (sendSuccess == true)
-    {
-      // Transmission was a succes
-      failCount = 0;
-      sendSuccess = false;
+    // Transmit the speed value (0-1023), and how long the receiver may have to wait for the next.
+    size = protocolEncodeThrottle(frame, throttle, transmitSchedulerKeepalive(throttle));
+    sentThrottle = throttle;
+    sentTime = millis();
+    startSend(RADIO_SEND_THROTTLE, frame, size);
+  }
+}
 
-      DEBUG_PRINT("Transmission succes");
-    } else {
-      // Transmission was not a succes
-      failCount++;
+// Power the radio up if it is down, and return whether its oscillator has
+// had the time to start.
+bool radioReady() {
+  if (radioPowered == false) {
+    radio.powerUp();
+    radioPowered = true;
+    radioPowerUpStart = micros();
+  }
+
+  return micros() - radioPowerUpStart >= RADIO_POWER_UP_US;
+}
+
+void radioPowerDown() {
+  radio.powerDown();
+  radioPowered = false;
+}
+
+void startSend(byte sending, const uint8_t *frame, uint8_t size) {
+  radio.startWrite(frame, size, false);
+  radioSending = sending;
+  radioSendStart = micros();
+}
+
+// Pick up the outcome of the packet on the air, false while it is still
+// being sent.
+bool finishSend() {
+  bool sent, failed, received;
+
+  radio.whatHappened(sent, failed, received);
+  if (sent == false && failed == false && micros() - radioSendStart < RADIO_SEND_TIMEOUT_US) {
+    return false;
+  }
+
+  // A packet that ran out of retries stays in the FIFO.
+  if (sent == false) {
+    radio.flush_tx();
+  }
+
+  byte sending = radioSending;
+  radioSending = RADIO_SEND_NONE;
+  powerManagerRadio(&powerState, sendDuration());
+
+  if (sending == RADIO_SEND_LINK) {
+    linkSent(sent);
+  } else {
+    throttleSent(sent);
+  }
+
+  // Powered down between packets when not active, unless a link packet
+  // followed.
+  if (radioSending == RADIO_SEND_NONE && poweredMode != POWER_ACTIVE) {
+    radioPowerDown();
+  }
+  return true;
+}
+
+// Time the radio was busy with the last packet (µs). Each attempt settles
+// the transmitter, then sends and waits for the ack within the retransmit
+// delay. The outcome is polled up to a control period late, so the time
+// since the start would overstate it.
+unsigned long sendDuration() {
+  struct linkLevel settings;
+
+  linkQualityLevel(radioLinkLevel, &settings);
+  return (radio.getARC() + 1UL) * (RADIO_SETTLE_US + (settings.retryDelay + 1UL) * 250);
+}
+
+// Follow up on a throttle packet: read the telemetry in the ack, and keep
+// the link level and channel.
+void throttleSent(bool sendSuccess) {
+  uint8_t frame[PROTOCOL_MAX_FRAME_SIZE];
+  uint8_t size;
 
-      DEBUG_PRINT("Failed transmission");
+  transmitSchedulerSent(&txScheduler, sentThrottle, sendSuccess, sentTime);
+
+  if (sendSuccess) {
+    powerManagerSent(&powerState, radioSendStart + sendDuration());
+  }
+
+  // Received power of the ack is only meaningful when there was one.
+  bool strongSignal = sendSuccess && radio.testRPD();
+  byte level = linkQualityRecord(&radioLink, sendSuccess, radio.getARC(), strongSignal);
+
+  // Listen for an acknowledgement reponse (return of VESC data).
+  while (radio.isAckPayloadAvailable()) {
+    size = radio.getDynamicPayloadSize();
+    if (size > sizeof(frame)) {
+      size = sizeof(frame);
     }
+    radio.read(frame, size);
 
-    // If lost more than 5 transmissions, we can assume that connection is lost.
-    if (failCount < 5) {
-      connected = true;
-    } else {
-      connected = false;
+    // Corrupt or foreign frames are dropped, keeping the last good data.
+    if (telemetryReceive(&telemetryState, frame, size, &data, millis())) {
+      tripStatsUpdate(&rideStats, ratioRpmSpeed * data.rpm, data.rpm, data.inpVoltage);
+    }
+  }
+
+  if (sendSuccess == true)
+  {
+    // Transmission was a succes
+    failCount = 0;
+
+    DEBUG_PRINT("Transmission succes");
+  } else {
+    // Transmission was not a succes
+    failCount++;
+
+    DEBUG_PRINT("Failed transmission");
+  }
+
+  // If lost more than 5 transmissions, we can assume that connection is lost.
+  if (failCount < 5) {
+    connected = true;
+  } else {
+    connected = false;
+  }
+
+  if (connected == false) {
+    // The receiver returns to the home rate and rendezvous channel when it
+    // loses us, meet it there. The channel may have gone bad, find a new one.
+    if (radioLinkLevel != LINK_QUALITY_HOME_LEVEL) {
+      linkQualitySetLevel(&radioLink, LINK_QUALITY_HOME_LEVEL);
+      applyLinkLevel(LINK_QUALITY_HOME_LEVEL);
+    }
+    if (radioChannel != PROTOCOL_RENDEZVOUS_CHANNEL) {
+      radio.setChannel(PROTOCOL_RENDEZVOUS_CHANNEL);
+      radioChannel = PROTOCOL_RENDEZVOUS_CHANNEL;
     }
+    if (channelsScanned == false) {
+      startChannelScan();
+    }
+  } else if (level != radioLinkLevel) {
+    changeLinkLevel(level);
+  } else if (failCount == 0 && backgroundScanLeft == 0 && radioChannel != selectedChannel) {
+    changeChannel(selectedChannel);
+  }
+
+  if (failCount == 0) {
+    channelsScanned = false;
   }
 }
 
-void calculateThrottlePosition() {
-  // Hall sensor reading can be noisy, lets make an average reading.
-  int total = 0;
-  for (int i = 0; i < 10; i++) {
-    total += analogRead(hallSensorPin);
+// Move the radio to a new link level, taking the receiver along on a data rate change.
+void changeLinkLevel(byte level) {
+  struct linkLevel current;
+  struct linkLevel next;
+
+  linkQualityLevel(radioLinkLevel, &current);
+  linkQualityLevel(level, &next);
+
+  if (next.dataRate != current.dataRate) {
+    announceLink(level, radioChannel);
+    return;
+  }
+
+  applyLinkLevel(level);
+}
+
+// Move the radio and the receiver to a new channel.
+void changeChannel(byte channel) {
+  announceLink(radioLinkLevel, channel);
+}
+
+// Tell the receiver to move to the data rate of a link level and a channel.
+// It switches once it has acked, so only follow then, see linkSent().
+void announceLink(byte level, byte channel) {
+  struct linkLevel settings;
+  uint8_t frame[PROTOCOL_MAX_FRAME_SIZE];
+
+  linkQualityLevel(level, &settings);
+  announcedLevel = level;
+  announcedChannel = channel;
+  startSend(RADIO_SEND_LINK, frame, protocolEncodeLink(frame, settings.dataRate, channel));
+}
+
+void linkSent(bool acked) {
+  // Without an ack, stay put.
+  if (acked == false) {
+    if (announcedLevel != radioLinkLevel) {
+      linkQualitySetLevel(&radioLink, radioLinkLevel);
+    }
+    return;
+  }
+
+  if (announcedLevel != radioLinkLevel) {
+    applyLinkLevel(announcedLevel);
   }
-  hallMeasurement = total / 10;
+  if (announcedChannel != radioChannel) {
+    radio.setChannel(announcedChannel);
+    radioChannel = announcedChannel;
+  }
+}
+
+// Start a scan for the quietest channel, taken alongside the link by
+// scanNextChannel(). Restarted when the link is lost, as the channel in
+// use may have gone bad.
+void startChannelScan() {
+  channelScanBegin(&backgroundScan);
+  backgroundScanLeft = CHANNEL_SCAN_SWEEPS * CHANNEL_SCAN_CHANNELS;
+  channelsScanned = true;
+}
+
+// Take one reading of the background scan and return to the link channel.
+// Spreads a scan over a few seconds of control passes, where sweeping all
+// channels at once would hold up the link. When done the link moves to the
+// quietest channel.
+void scanNextChannel() {
+  byte channel = CHANNEL_SCAN_FIRST + backgroundScanLeft % CHANNEL_SCAN_CHANNELS;
+
+  radio.setChannel(channel);
+  radio.startListening();
+  delayMicroseconds(CHANNEL_SCAN_DWELL_US);
+  radio.stopListening();
+  channelScanRecord(&backgroundScan, channel, radio.testRPD());
+  radio.setChannel(radioChannel);
+
+  backgroundScanLeft--;
+  if (backgroundScanLeft == 0) {
+    selectedChannel = channelScanSelect(&backgroundScan);
+  }
+}
+
+void applyLinkLevel(byte level) {
+  struct linkLevel settings;
+
+  linkQualityLevel(level, &settings);
+  radio.setPALevel(settings.paLevel);
+  radio.setDataRate((rf24_datarate_e)settings.dataRate);
+  radio.setRetries(settings.retryDelay, settings.retryCount);
+
+  radioLinkLevel = level;
+}
+
+void calculateThrottlePosition() {
+  // Hall sensor reading can be noisy, use the averaged reading from the sampler.
+  hallMeasurement = adcSamplerRead(ADC_SAMPLER_HALL);
 
   DEBUG_PRINT( (String)hallMeasurement );
   
-  if (hallMeasurement >= remoteSettings.centerHallValue) {
-    throttle = constrain(map(hallMeasurement, remoteSettings.centerHallValue, remoteSettings.maxHallValue, 127, 255), 127, 255);
+  // Travel from center towards max (throttle) or min (brake), 0 - THROTTLE_CURVE_RANGE.
+  bool braking = hallMeasurement < remoteSettings.centerHallValue;
+  int travel;
+
+  if (braking == false) {
+    travel = constrain(map(hallMeasurement, remoteSettings.centerHallValue, remoteSettings.maxHallValue, 0, THROTTLE_CURVE_RANGE), 0, THROTTLE_CURVE_RANGE);
   } else {
-    throttle = constrain(map(hallMeasurement, remoteSettings.minHallValue, remoteSettings.centerHallValue, 0, 127), 0, 127);
+    travel = constrain(map(hallMeasurement, remoteSettings.centerHallValue, remoteSettings.minHallValue, 0, THROTTLE_CURVE_RANGE), 0, THROTTLE_CURVE_RANGE);
   }
 
   // removeing center noise
-  if (abs(throttle - 127) < hallCenterMargin) {
-    throttle = 127;
+  if (travel < hallCenterMargin) {
+    travel = 0;
+  }
+
+  // Shape the response, then scale to each side of neutral.
+  if (braking == false) {
+    long output = throttleCurveApply(remoteSettings.throttleCurve, travel);
+    throttle = PROTOCOL_THROTTLE_NEUTRAL + ((output * (PROTOCOL_THROTTLE_MAX - PROTOCOL_THROTTLE_NEUTRAL)) >> THROTTLE_CURVE_RANGE_BITS);
+  } else {
+    long output = throttleCurveApply(remoteSettings.brakeCurve, travel);
+    throttle = PROTOCOL_THROTTLE_NEUTRAL - ((output * PROTOCOL_THROTTLE_NEUTRAL) >> THROTTLE_CURVE_RANGE_BITS);
   }
 }
 
@@ -551,68 +1153,235 @@ int batteryLevel() {
 // Function to calculate and return the remotes battery voltage.
 float batteryVoltage() {
   float batteryVoltage = 0.0;
-  int total = 0;
 
-  for (int i = 0; i < 10; i++) {
-    total += analogRead(batteryMeasurePin);
+  batteryVoltage = (refVoltage / 1024.0) * (float)adcSamplerRead(ADC_SAMPLER_BATTERY);
+
+  return batteryVoltage;
+}
+
+// Estimate the board battery state of charge from the telemetry.
+void updateBoardBattery() {
+  unsigned long now = millis();
+  uint16_t interval = transmitSchedulerKeepalive(throttle);
+
+  // No voltage until the receiver has heard from the VESC, and none
+  // trusted once it stops hearing from it.
+  if (data.inpVoltage > 0.0 && telemetryFresh(&telemetryState, TELEMETRY_VOLTAGE, now, interval)
+      && telemetryFresh(&telemetryState, TELEMETRY_INPUT_CURRENT, now, interval)) {
+    batteryModelUpdate(&boardBattery, data.inpVoltage * 1000, data.inputCurrent * 100);
   }
+}
 
-  batteryVoltage = (refVoltage / 1024.0) * ((float)total / 10.0);
+// Write out what is staged in the trip log a byte at a time.
+void flushTripLog() {
+  tripLogFlush(&tripLog);
 
-  return batteryVoltage;
+#ifdef TRIP_LOG_SERIAL
+  sendTripLog();
+#endif
 }
 
+// Log a trip sample, every TRIP_LOG_PERIOD_MS, while the telemetry is
+// current.
+void updateTripLog() {
+  if (tripTelemetryFresh(millis())) {
+    float speed = abs(ratioRpmSpeed * data.rpm) * 2 + 0.5; // 0.5 km/h
+    tripLogRecord(&tripLog, min(speed, 255.0), data.inpVoltage * 10 + 0.5, data.ampHours * 100 + 0.5);
+  }
+}
+
+// Return true if the telemetry logged in the trip is current. Between
+// packets the remote waits up to the keepalive interval.
+bool tripTelemetryFresh(unsigned long now) {
+  uint16_t interval = transmitSchedulerKeepalive(throttle);
+
+  return connected && telemetryFresh(&telemetryState, TELEMETRY_RPM, now, interval)
+      && telemetryFresh(&telemetryState, TELEMETRY_VOLTAGE, now, interval)
+      && telemetryFresh(&telemetryState, TELEMETRY_AMP_HOURS, now, interval);
+}
+
+#ifdef TRIP_LOG_SERIAL
+// Send a line of the trip log dump: the blocks, then the statistics as
+// "S <max speed, 0.1 km/h> <max erpm> <min voltage, 0.01 V> <max voltage>".
+void sendTripLog() {
+  char line[TRIP_LOG_LINE_SIZE];
+
+  if (Serial.available() && Serial.read() == 'L') {
+    tripLogDumpLine = 0;
+  }
+
+  if (tripLogDumpLine < TRIP_LOG_BLOCKS) {
+    tripLogFormatBlock(line, tripLogDumpLine);
+    Serial.println(line);
+  } else if (tripLogDumpLine == TRIP_LOG_BLOCKS) {
+    char *p = formatString(line, "S ");
+    p = formatUnsigned(p, rideStats.maxSpeed * 10, 1);
+    p = formatString(p, " ");
+    p = formatUnsigned(p, rideStats.maxRpm, 1);
+    p = formatString(p, " ");
+    p = formatUnsigned(p, rideStats.minVoltage * 100, 1);
+    p = formatString(p, " ");
+    formatUnsigned(p, rideStats.maxVoltage * 100, 1);
+    Serial.println(line);
+  } else {
+    return;
+  }
+  tripLogDumpLine++;
+}
+#endif
+
+// Display task, timed as a stage of its own.
+void updateDisplay() {
+  if (poweredMode == POWER_SLEEP) {
+    return;
+  }
+
+  TIMING_START(displayStart);
+  if (displayStarted == false) {
+    // Not done in setup() to get the first packet out sooner, so wait for
+    // the radio to come up and send it. Only the init sequence: begin()
+    // would also clear the whole display at once, the first frame does so
+    // in slices.
+    if (radioPowered && micros() - radioPowerUpStart < RADIO_POWER_UP_US) {
+      return;
+    }
+    u8g2.setBusClock(400000);
+    u8g2.initDisplay();
+    displayStarted = true;
+    splashStart = millis();
+  } else {
+    updateMainDisplay();
+  }
+  TIMING_RECORD(TIMING_DISPLAY, displayStart);
+}
+
+// Render scheduler for the display. A frame is only started when something
+// shown has changed, and at most displayMaxFps times per second. The frame
+// is then drawn a page at a time and sent in slices, until a higher
+// priority task is due; the next call carries on. So the control task
+// never waits for more than a slice of a page transfer.
 void updateMainDisplay() {
+  if (displayRendering == false) {
+    if (millis() - lastDisplayFrame < displayFramePeriod) {
+      return;
+    }
 
-  u8g2.firstPage();
-  do {
+    struct displayState state;
+    updateDisplayState(&state);
 
-    if (changeSettings == true) {
-      drawSettingsMenu();
-      drawSettingNumber();
-    } else {
-      drawThrottle();
-      drawPage();
-      drawBatteryLevel();
-      drawSignal();
+    if (displayRedraw == false && memcmp(&state, &renderedState, sizeof(state)) == 0) {
+      // Nothing changed since last frame.
+      return;
     }
 
-  } while ( u8g2.nextPage() );
-}
+    renderedState = state;
+    displayRedraw = false;
+    lastDisplayFrame = millis();
+    displayRendering = true;
+    displayRow = 0;
+  }
 
-void drawStartScreen() {
-  u8g2.firstPage();
   do {
-    u8g2.drawXBM( 4, 4, 24, 24, logo_bits);
+    renderDisplaySlice();
+  } while (displayRendering && taskSchedulerPreempted(&scheduler) == false);
+}
+
+// Draw the next page of the frame, or send the next slice of it.
+void renderDisplaySlice() {
+  if (displayDrawn == false) {
+    u8g2.setBufferCurrTileRow(displayRow);
+    u8g2.clearBuffer();
+    drawScreen();
+    displayDrawn = true;
+    displayTile = 0;
+    return;
+  }
+
+  byte width = u8g2.getBufferTileWidth();
+  byte tiles = width - displayTile;
+  if (tiles > displaySliceTiles) {
+    tiles = displaySliceTiles;
+  }
+  u8x8_DrawTile(u8g2.getU8x8(), displayTile, displayRow, tiles, u8g2.getBufferPtr() + displayTile * 8);
+  displayTile += tiles;
+
+  if (displayTile < width) {
+    return;
+  }
+
+  // Page sent, on to the next.
+  displayDrawn = false;
+  displayRow++;
+  displayRendering = displayRow < u8g2.getDisplayHeight() / 8;
 
-    displayString = "Esk8 remote";
-    displayString.toCharArray(displayBuffer, 12);
-    u8g2.setFont(u8g2_font_helvR10_tr  );
-    u8g2.drawStr(34, 22, displayBuffer);
-  } while ( u8g2.nextPage() );
-  delay(1500);
+  if (displayRendering == false && displayShown == false) {
+    u8g2.setPowerSave(0);
+    displayShown = true;
+  }
 }
 
-void drawTitleScreen(String title) {
-  u8g2.firstPage();
-  do {
-    title.toCharArray(displayBuffer, 20);
-    u8g2.setFont(u8g2_font_helvR10_tr  );
-    u8g2.drawStr(12, 20, displayBuffer);
-  } while ( u8g2.nextPage() );
-  delay(1500);
+// Draw the page of the frame in the buffer.
+void drawScreen() {
+  if (renderedState.splash == SPLASH_LOGO) {
+    drawStartScreen();
+  } else if (renderedState.splash == SPLASH_TITLE) {
+    drawTitleScreen("Remote Settings");
+  } else if (renderedState.settings == true) {
+    #ifdef LOOP_TIMING
+      if (renderedState.setting >= numOfSettings) {
+        drawTimingPage();
+      } else {
+        drawSettingsMenu();
+      }
+    #else
+      drawSettingsMenu();
+    #endif
+    drawSettingNumber();
+  } else {
+    drawThrottle();
+    drawPage();
+    drawBatteryLevel();
+    drawSignal();
+  }
 }
 
-void drawPage() {
-  int decimals;
-  float value;
-  String suffix;
-  String prefix;
+// Collect the values to be shown on the display.
+void updateDisplayState(struct displayState *state) {
+  // Clear padding, states are compared with memcmp.
+  memset(state, 0, sizeof(*state));
 
-  int first, last;
+  // Boot screens first: the logo, then the title when entering the menu.
+  if (splash != SPLASH_NONE && millis() - splashStart >= splashPeriod) {
+    splash = (splash == SPLASH_LOGO && changeSettings) ? SPLASH_TITLE : SPLASH_NONE;
+    splashStart = millis();
+  }
+  state->splash = splash;
 
-  int x = 0;
-  int y = 16;
+  if (splash != SPLASH_NONE) {
+    return;
+  }
+
+  state->settings = changeSettings;
+
+  if (changeSettings == true) {
+    state->setting = currentSetting;
+    #ifdef LOOP_TIMING
+      if (currentSetting >= numOfSettings) {
+        updateTimingState(state);
+        return;
+      }
+    #endif
+    state->settingValue = settingsTableGet(&remoteSettings, currentSetting);
+    state->settingSelected = changeSelectedSetting;
+    return;
+  }
+
+  // Throttle bar
+  if (throttle >= PROTOCOL_THROTTLE_NEUTRAL) {
+    state->throttleBar = map(throttle, PROTOCOL_THROTTLE_NEUTRAL, PROTOCOL_THROTTLE_MAX, 0, 49);
+  } else {
+    state->throttleBar = -map(throttle, 0, PROTOCOL_THROTTLE_NEUTRAL - 1, 49, 0);
+  }
 
   // Rotate the realtime data each 4s.
   if ((millis() - lastDataRotation) >= 4000) {
@@ -620,65 +1389,133 @@ void drawPage() {
     lastDataRotation = millis();
     displayData++;
 
-    if (displayData > 2) {
+    if (displayData > 3) {
       displayData = 0;
     }
   }
 
+  state->page = displayData;
+
+  float value;
+
   switch (displayData) {
+    case 0: value = ratioRpmSpeed * data.rpm;                state->pageDecimals = 1; break;
+    case 1: value = ratioPulseDistance * data.tachometerAbs; state->pageDecimals = 2; break;
+    case 2: value = batteryModelSoc(&boardBattery) / 10.0;   state->pageDecimals = 1; break;
+    case 3: value = radioLink.retryRate / 10.0;              state->pageDecimals = 1; break;
+  }
+
+  if (displayData == 2) {
+    state->boardVoltage = data.inpVoltage * 10;
+  } else if (displayData == 3) {
+    state->linkAckRate = radioLink.ackRate;
+  }
+
+  // Only the shown resolution counts as a change.
+  state->pageValue = formatRound(value, state->pageDecimals);
+
+  // Battery level
+  int level = batteryLevel();
+
+  for (int i = 0; i < 5; i++) {
+    int p = round((100 / 5) * i);
+    if (p <= level)
+    {
+      state->batteryBars++;
+    }
+  }
+
+  // Signal icon
+  if (connected == true) {
+    if (triggerActive()) {
+      state->signal = SIGNAL_TRANSMITTING;
+    } else {
+      state->signal = SIGNAL_CONNECTED;
+    }
+  } else {
+    if (millis() - lastSignalBlink > 500) {
+      signalBlink = !signalBlink;
+      lastSignalBlink = millis();
+    }
+
+    if (signalBlink == true) {
+      state->signal = SIGNAL_CONNECTED;
+    } else {
+      state->signal = SIGNAL_NOCONNECTION;
+    }
+  }
+}
+
+void drawStartScreen() {
+  drawBitmap(4, 4, &bitmapLogo);
+
+  u8g2.setFont(u8g2_font_helvR10_tr  );
+  u8g2.drawStr(34, 22, "Esk8 remote");
+}
+
+void drawTitleScreen(const char *title) {
+  u8g2.setFont(u8g2_font_helvR10_tr  );
+  u8g2.drawStr(12, 20, title);
+}
+
+void drawPage() {
+  const char *suffix;
+  const char *prefix;
+  char title[12];
+  char *end;
+
+  int x = 0;
+  int y = 16;
+
+  switch (renderedState.page) {
     case 0:
-      value = ratioRpmSpeed * data.rpm;
       suffix = "KMH";
       prefix = "SPEED";
-      decimals = 1;
       break;
     case 1:
-      value = ratioPulseDistance * data.tachometerAbs;
       suffix = "KM";
       prefix = "DISTANCE";
-      decimals = 2;
       break;
     case 2:
-      value = data.inpVoltage;
-      suffix = "V";
-      prefix = "BATTERY";
-      decimals = 1;
+      // Pack voltage in the title, state of charge as value.
+      end = formatString(title, "BATT ");
+      end = formatFixed(end, renderedState.boardVoltage, 1, 1);
+      formatString(end, "V");
+      suffix = "%";
+      prefix = title;
+      break;
+    default:
+      // Ack rate in the title, retransmits per packet as value.
+      end = formatString(title, "LINK ");
+      end = formatUnsigned(end, renderedState.linkAckRate, 1);
+      formatString(end, "%");
+      suffix = "RT";
+      prefix = title;
       break;
   }
 
   // Display prefix (title)
-  displayString = prefix;
-  displayString.toCharArray(displayBuffer, 10);
   u8g2.setFont(u8g2_font_profont12_tr);
-  u8g2.drawStr(x, y - 1, displayBuffer);
+  u8g2.drawStr(x, y - 1, prefix);
 
-  // Split up the float value: a number, b decimals.
-  first = abs(floor(value));
-  last = value * pow(10, 3) - first * pow(10, 3);
+  // Format the value with a leading zero, then split it at the decimal point.
+  char buffer[TEXT_FORMAT_MAX_DIGITS + 2];
+  formatFixed(buffer, renderedState.pageValue, renderedState.pageDecimals, 2);
 
-  // Add leading zero
-  if (first <= 9) {
-    displayString = "0" + (String)first;
-  } else {
-    displayString = (String)first;
-  }
-
-  // Display numbers
-  displayString.toCharArray(displayBuffer, 10);
-  u8g2.setFont(u8g2_font_logisoso22_tn );
-  u8g2.drawStr(x + 55, y + 13, displayBuffer);
+  char *point = strchr(buffer, '.');
 
   // Display decimals
-  displayString = "." + (String)last;
-  displayString.toCharArray(displayBuffer, decimals + 2);
   u8g2.setFont(u8g2_font_profont12_tr);
-  u8g2.drawStr(x + 86, y - 1, displayBuffer);
+  u8g2.drawStr(x + 86, y - 1, point);
+
+  // Display numbers
+  *point = '\0';
+  u8g2.setFont(u8g2_font_logisoso22_tn );
+  u8g2.drawStr(x + 55, y + 13, buffer);
 
   // Display suffix
-  displayString = suffix;
-  displayString.toCharArray(displayBuffer, 10);
   u8g2.setFont(u8g2_font_profont12_tr);
-  u8g2.drawStr(x + 86 + 2, y + 13, displayBuffer);
+  u8g2.drawStr(x + 86 + 2, y + 13, suffix);
 
 }
 
@@ -693,8 +1530,8 @@ void drawThrottle() {
   u8g2.drawHLine(x, y + 10, 5);
   u8g2.drawHLine(x + 52 - 4, y + 10, 5);
 
-  if (throttle >= 127) {
-    int width = map(throttle, 127, 255, 0, 49);
+  if (renderedState.throttleBar >= 0) {
+    int width = renderedState.throttleBar;
 
     for (int i = 0; i < width; i++) {
       //if( (i % 2) == 0){
@@ -702,7 +1539,7 @@ void drawThrottle() {
       //}
     }
   } else {
-    int width = map(throttle, 0, 126, 49, 0);
+    int width = -renderedState.throttleBar;
     for (int i = 0; i < width; i++) {
       //if( (i % 2) == 0){
       u8g2.drawVLine(x + 50 - i, y + 2, 7);
@@ -712,46 +1549,125 @@ void drawThrottle() {
   }
 }
 
-bool signalBlink = false;
-
 void drawSignal() {
   // Position on OLED
   int x = 114; int y = 17;
 
-  if (connected == true) {
-    if (triggerActive()) {
-      u8g2.drawXBM(x, y, 12, 12, signal_transmitting_bits);
-    } else {
-      u8g2.drawXBM(x, y, 12, 12, signal_connected_bits);
-    }
-  } else {
-    if (millis() - lastSignalBlink > 500) {
-      signalBlink = !signalBlink;
-      lastSignalBlink = millis();
-    }
-
-    if (signalBlink == true) {
-      u8g2.drawXBM(x, y, 12, 12, signal_connected_bits);
-    } else {
-      u8g2.drawXBM(x, y, 12, 12, signal_noconnection_bits);
-    }
+  switch (renderedState.signal) {
+    case SIGNAL_TRANSMITTING:
+      drawBitmap(x, y, &bitmapSignalTransmitting);
+      break;
+    case SIGNAL_CONNECTED:
+      drawBitmap(x, y, &bitmapSignalConnected);
+      break;
+    default:
+      drawBitmap(x, y, &bitmapSignalNoconnection);
+      break;
   }
 }
 
-void drawBatteryLevel() {
-  int level = batteryLevel();
+// Draw a bitmap from flash into the page being rendered.
+void drawBitmap(int x, int y, const struct bitmapAsset *asset) {
+  struct bitmapPage page = {
+    u8g2.getBufferPtr(),
+    u8g2.getBufferTileWidth(),
+    u8g2.getBufferCurrTileRow(),
+    u8g2.getBufferTileHeight()
+  };
+
+  bitmapDraw(&page, x, y, asset);
+}
 
+void drawBatteryLevel() {
   // Position on OLED
   int x = 108; int y = 4;
 
   u8g2.drawFrame(x + 2, y, 18, 9);
   u8g2.drawBox(x, y + 2, 2, 5);
 
-  for (int i = 0; i < 5; i++) {
-    int p = round((100 / 5) * i);
-    if (p <= level)
-    {
-      u8g2.drawBox(x + 4 + (3 * i), y + 2, 2, 5);
+  for (int i = 0; i < renderedState.batteryBars; i++) {
+    u8g2.drawBox(x + 4 + (3 * i), y + 2, 2, 5);
+  }
+}
+
+#ifdef LOOP_TIMING
+// Start a new timing period and send the last one, once per report period.
+void updateLoopTiming() {
+  loopTimingExportUpdate(&timingExport);
+
+  if (millis() - lastTimingReport < timingReportPeriod || loopTimingExportBusy(&timingExport)) {
+    return;
+  }
+  lastTimingReport = millis();
+
+  for (byte i = 0; i < TIMING_NUM_STAGES; i++) {
+    timingReport[i] = timingStages[i];
+    loopTimingReset(&timingStages[i]);
+  }
+
+  loopTimingExportStart(&timingExport, LOOP_TIMING_TRANSMITTER, timingReport, TIMING_NUM_STAGES);
+}
+
+// Show the stages of the last period in turn, 2s each.
+void updateTimingState(struct displayState *state) {
+  byte stage = (millis() / 2000) % TIMING_NUM_STAGES;
+  struct loopTimingStage *report = &timingReport[stage];
+
+  state->settingValue = stage;
+  state->timingAverage = loopTimingAverage(report);
+  state->timingMax = report->max;
+
+  for (byte i = 0; i < LOOP_TIMING_BUCKETS; i++) {
+    if (report->count > 0) {
+      state->timingBars[i] = (unsigned long)report->histogram[i] * timingBarHeight / report->count;
     }
   }
 }
+
+void drawTimingPage() {
+  // Position on OLED
+  int x = 0; int y = 10;
+  char buffer[TEXT_FORMAT_MAX_DIGITS + 8];
+  char *end;
+
+  u8g2.setFont(u8g2_font_profont12_tr);
+  u8g2.drawStr(x, y, timingStageNames[renderedState.settingValue]);
+
+  end = formatString(buffer, "avg ");
+  end = formatUnsigned(end, renderedState.timingAverage, 1);
+  formatString(end, "us");
+  u8g2.drawStr(x, y + 11, buffer);
+
+  end = formatString(buffer, "max ");
+  end = formatUnsigned(end, renderedState.timingMax, 1);
+  formatString(end, "us");
+  u8g2.drawStr(x, y + 22, buffer);
+
+  // Histogram, shortest durations to the left.
+  for (byte i = 0; i < LOOP_TIMING_BUCKETS; i++) {
+    byte height = renderedState.timingBars[i];
+    u8g2.drawBox(x + 68 + 4 * i, y + 21 - height, 3, height);
+  }
+  u8g2.drawHLine(x + 68, y + 21, 4 * LOOP_TIMING_BUCKETS - 1);
+}
+#endif
+
+
+/**
+ * ****************************************************************************
+ * INTERRUPT HANDLERS
+ * ****************************************************************************
+ */
+
+#if defined(__AVR__)
+// Trigger or hall sensor moved, only enabled when not active. The time is
+// where the wake timing starts.
+ISR(PCINT1_vect) {
+  if (wakePending == false) {
+    wakeTime = micros();
+    wakePending = true;
+  }
+}
+
+ISR(PCINT2_vect, ISR_ALIASOF(PCINT1_vect));
+#endif